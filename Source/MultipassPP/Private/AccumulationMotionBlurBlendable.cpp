@@ -3,6 +3,9 @@
 
 #include "AccumulationMotionBlurBlendable.h"
 
+#include "MultipassPPEffectRegistry.h"
+#include "AccumulationMotionBlurSceneExtension.h"
+
 #include "Runtime/Launch/Resources/Version.h"
 #if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 3
 #include "SceneRendering.h"
@@ -18,9 +21,13 @@ void UAccumulationMotionBlurBlendable::OverrideBlendableSettings(FSceneView& Vie
 		return;
 	}
 
+	// The extension is created on first use, so it starts rendering the frame after the blendable is first applied
+	FMultipassPPEffectRegistry::Get().RequestEffect(FAccumulationMotionBlurSceneExtension::GetEffectName());
+
 	FFinalPostProcessSettings& Dest = View.FinalPostProcessSettings;
 
 	FAccumulationMotionBlurNode Node;
 	Node.MotionBlurScale = MotionBlurScale;
+	Node.HistoryScale = HistoryScale;
 	FAccumulationMotionBlurNode* PushedNode = Dest.BlendableManager.PushBlendableData(Weight, Node);
 }
@@ -10,9 +10,83 @@
 #include "ScenePrivate.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "AccumulationMotionBlurBlendable.h"
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPPAutoTune.h"
+#include "RenderGraphUtils.h"
+
+static FMultipassPPEffectRegistration AccumulationMotionBlurRegistration(
+	FAccumulationMotionBlurSceneExtension::GetEffectName(),
+	[]() -> TSharedPtr<FMultipassPPSceneExtension> { return FSceneViewExtensions::NewExtension<FAccumulationMotionBlurSceneExtension>(); },
+	{ TEXT("r.AccumulationMotionBlur.Scale"), TEXT("r.AccumulationMotionBlur.Weight") });
 
 IMPLEMENT_GLOBAL_SHADER(FAccumulationMotionBlurPixelShader, "/MultipassPP/Private/AccumulationMotionBlurPP.usf", "AccumulationMotionBlurPS", SF_Pixel);
 
+bool FAccumulationMotionBlurPixelShader::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FAccumulationMotionBlurSceneExtension::GetEffectName());
+}
+
+IMPLEMENT_GLOBAL_SHADER(FAccumulationMotionBlurCompositePS, "/MultipassPP/Private/AccumulationMotionBlurPP.usf", "AccumulationMotionBlurCompositePS", SF_Pixel);
+
+bool FAccumulationMotionBlurCompositePS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FAccumulationMotionBlurSceneExtension::GetEffectName());
+}
+
+IMPLEMENT_GLOBAL_SHADER(FAccumulationMotionBlurClassifyCS, "/MultipassPP/Private/AccumulationMotionBlurTiles.usf", "ClassifyCS", SF_Compute);
+IMPLEMENT_GLOBAL_SHADER(FAccumulationMotionBlurBlendCS, "/MultipassPP/Private/AccumulationMotionBlurTiles.usf", "BlendCS", SF_Compute);
+
+bool FAccumulationMotionBlurClassifyCS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5)
+		&& FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FAccumulationMotionBlurSceneExtension::GetEffectName());
+}
+
+void FAccumulationMotionBlurClassifyCS::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("CLASSIFY"), 1);
+}
+
+bool FAccumulationMotionBlurBlendCS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return FAccumulationMotionBlurClassifyCS::ShouldCompilePermutation(Parameters);
+}
+
+void FAccumulationMotionBlurBlendCS::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("CLASSIFY"), 0);
+}
+
+// Candidates of the tile size tunable, in FTileSizeDim order
+static const int32 GAccumulationMotionBlurTileSizes[] = { 8, 16 };
+static FMultipassPPTunableRegistration GAccumulationMotionBlurTileSizeTunable(FAccumulationMotionBlurSceneExtension::TileSizeTunable, { TEXT("8x8"), TEXT("16x16") });
+
+static TAutoConsoleVariable<int32> CVarAccumulationMotionBlurTileSkip(
+	TEXT("r.AccumulationMotionBlur.TileSkip"),
+	0,
+	TEXT("Classifies 8x8 or 16x16 tiles, see r.MultipassPP.AutoTune, against the history first and only blends the tiles that still changed, with an indirect dispatch.\n")
+	TEXT("Cheaper when most of the screen is static. Needs SM5, and isn't used with a region mask"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarAccumulationMotionBlurTileSkipThreshold(
+	TEXT("r.AccumulationMotionBlur.TileSkipThreshold"),
+	1.f / 255.f,
+	TEXT("Largest difference between the current frame and the history, over a tile, for the tile to be considered converged"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarAccumulationMotionBlurHistoryScale(
+	TEXT("r.AccumulationMotionBlur.HistoryScale"),
+	-1,
+	TEXT("Keeps the history at a fraction of the view resolution on each axis. The output stays at full resolution, the current frame\n")
+	TEXT("is blended with the history upsampled by how close its luma is to the frame's.\n")
+	TEXT("-1: use the blendables (default)\n")
+	TEXT(" 1: full resolution\n")
+	TEXT(" 2: half resolution, a quarter of the memory and bandwidth\n")
+	TEXT(" 4: quarter resolution, a sixteenth of the memory and bandwidth"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
 static TAutoConsoleVariable<float> CVarAccumulationMotionBlurScale(
 	TEXT("r.AccumulationMotionBlur.Scale"),
 	-1.f,
@@ -34,66 +108,52 @@ FAccumulationMotionBlurSceneExtension::FAccumulationMotionBlurSceneExtension(con
 	PostProcessingPasses = { EPostProcessingPass::Tonemap };
 }
 
-void FAccumulationMotionBlurSceneExtension::SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView)
+void FAccumulationMotionBlurSceneExtension::SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& InViewData)
 {
-	BaseT::SetupView(InViewFamily, InView);
+	FAccumulationMotionBlurViewData& ViewData = static_cast<FAccumulationMotionBlurViewData&>(InViewData);
 
-	TSharedPtr<FAccumulationMotionBlurViewData> ViewData = StaticCastSharedPtr<FAccumulationMotionBlurViewData>(GetViewData(InView));
-	if (ViewData != nullptr)
-	{
-		ViewData->Weight = 0.f;
-		ViewData->Scale = 0.f;
+	const float ScaleCVar = CVarAccumulationMotionBlurScale.GetValueOnAnyThread();
+	const float WeightCVar = CVarAccumulationMotionBlurWeight.GetValueOnAnyThread();
+	const int32 HistoryScaleCVar = CVarAccumulationMotionBlurHistoryScale.GetValueOnAnyThread();
 
-		if (CVarAccumulationMotionBlurScale.GetValueOnAnyThread() >= 0.f)
-		{
-			ViewData->Scale = FMath::Clamp(CVarAccumulationMotionBlurScale.GetValueOnAnyThread(), 0, 1);
-		}
-		else
+	// One pass over the blendables for all of them, and none if the cvars override them
+	float BlendableScale = 0.f;
+	float BlendableWeight = 0.f;
+	float BlendableHistoryScale = 0.f;
+	int32 NumEntries = 0;
+	if (ScaleCVar < 0.f || WeightCVar < 0.f || HistoryScaleCVar < 0)
+	{
+		NumEntries = ForEachBlendable<FAccumulationMotionBlurNode>(View, [&](const FAccumulationMotionBlurNode& Node, float Weight)
 		{
-			const FFinalPostProcessSettings& Dest = InView.FinalPostProcessSettings;
-			FBlendableEntry* BlendableIt = nullptr;
-			int32 NumEntries = 0;
-			while (FAccumulationMotionBlurNode* DataPtr = Dest.BlendableManager.IterateBlendables<FAccumulationMotionBlurNode>(BlendableIt))
-			{
-				if (DataPtr)
-				{
-					ViewData->Scale += DataPtr->MotionBlurScale;
-					NumEntries++;
-				}
-			}
-
-			if (NumEntries > 0)
-			{
-				ViewData->Scale /= NumEntries;
-			}
-		}
+			BlendableScale += Node.MotionBlurScale;
+			BlendableWeight += Weight;
+			BlendableHistoryScale += Node.HistoryScale;
+		});
+	}
 
-		if (CVarAccumulationMotionBlurWeight.GetValueOnAnyThread() >= 0.f)
-		{
-			ViewData->Weight = FMath::Clamp(CVarAccumulationMotionBlurWeight.GetValueOnAnyThread(), 0, 1);
-		}
-		else
-		{
-			const FFinalPostProcessSettings& Dest = InView.FinalPostProcessSettings;
-			FBlendableEntry* BlendableIt = nullptr;
-			int32 NumEntries = 0;
-			while (FAccumulationMotionBlurNode* DataPtr = Dest.BlendableManager.IterateBlendables<FAccumulationMotionBlurNode>(BlendableIt))
-			{
-				if (BlendableIt)
-				{
-					ViewData->Weight += BlendableIt->Weight;
-					NumEntries++;
-				}
-			}
-
-			if (NumEntries > 0)
-			{
-				ViewData->Weight /= NumEntries;
-			}
-		}
+	ViewData.Scale = ScaleCVar >= 0.f ? FMath::Clamp(ScaleCVar, 0, 1) : (NumEntries > 0 ? BlendableScale / NumEntries : 0.f);
+	ViewData.Weight = WeightCVar >= 0.f ? FMath::Clamp(WeightCVar, 0, 1) : (NumEntries > 0 ? BlendableWeight / NumEntries : 0.f);
+
+	const int32 HistoryScale = GetHistoryScale(HistoryScaleCVar >= 0 ? float(HistoryScaleCVar) : (NumEntries > 0 ? BlendableHistoryScale / NumEntries : 1.f));
+	if (HistoryScale != ViewData.HistoryScale)
+	{
+		// The RT is reallocated at the new size, it starts over from the next frame
+		ViewData.HistoryScale = HistoryScale;
+		ViewData.LastFrameNumber = 0;
 	}
 }
 
+int32 FAccumulationMotionBlurSceneExtension::GetHistoryScale(float Scale)
+{
+	return Scale < 1.5f ? 1 : (Scale < 3.f ? 2 : 4);
+}
+
+float FAccumulationMotionBlurSceneExtension::GetResolutionFraction(const IMultipassPPViewData& InViewData) const
+{
+	const FAccumulationMotionBlurViewData& ViewData = static_cast<const FAccumulationMotionBlurViewData&>(InViewData);
+	return FMath::Min(BaseT::GetResolutionFraction(InViewData), 1.f / ViewData.HistoryScale);
+}
+
 bool FAccumulationMotionBlurSceneExtension::IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const
 {
 	check(IsInGameThread());
@@ -134,14 +194,213 @@ FScreenPassTexture FAccumulationMotionBlurSceneExtension::PostProcessPass_Render
 		return ReturnUntouchedSceneColorForPostProcessing(GraphBuilder, View, ViewInfo, InOutInputs);
 	}
 
-	return BaseT::PostProcessPass_RenderThread(GraphBuilder, View, InOutInputs, Pass);
+	// The region mask's fill needs the history at the output's resolution, it's upsampled as is then
+	if (ViewData->ResolutionFraction >= 1.f || RegionMask_RenderThread.IsEnabled())
+	{
+		return BaseT::PostProcessPass_RenderThread(GraphBuilder, View, InOutInputs, Pass);
+	}
+
+	// Reduced resolution history. Only the blurred part comes from it, the current frame keeps its full resolution
+	const FScreenPassTexture& SceneColor = InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor);
+	FRDGTextureRef HistoryTexture = GraphBuilder.RegisterExternalTexture(ViewData->GetRT());
+	const FIntPoint HistorySize(
+		FMath::Clamp(FMath::CeilToInt(ViewInfo.ViewRect.Width() * ViewData->ResolutionFraction), 1, HistoryTexture->Desc.Extent.X),
+		FMath::Clamp(FMath::CeilToInt(ViewInfo.ViewRect.Height() * ViewData->ResolutionFraction), 1, HistoryTexture->Desc.Extent.Y));
+	const FScreenPassRenderTarget History(HistoryTexture, FIntRect(FIntPoint::ZeroValue, HistorySize), ERenderTargetLoadAction::ELoad);
+
+	FScreenPassRenderTarget Output = InOutInputs.OverrideOutput;
+	if (!Output.IsValid())
+	{
+		FRDGTextureDesc Desc = SceneColor.Texture->Desc;
+		Desc.Flags |= TexCreate_RenderTargetable | TexCreate_ShaderResource;
+		Output = FScreenPassRenderTarget(GraphBuilder.CreateTexture(Desc, TEXT("AccumulationMotionBlur.Composite")), SceneColor.ViewRect, ERenderTargetLoadAction::ENoAction);
+	}
+
+	// Reads last frame's history, so it goes before this frame is accumulated
+	AddCompositePass_RenderThread(GraphBuilder, ViewInfo, SceneColor, History, Output);
+	AddPass_RenderThread(GraphBuilder, View, ViewInfo, SceneColor, History);
+
+	return MoveTemp(Output);
+}
+
+void FAccumulationMotionBlurSceneExtension::AddCompositePass_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassTexture& History, const FScreenPassRenderTarget& Output)
+{
+	TSharedPtr<FAccumulationMotionBlurViewData> ViewData = StaticCastSharedPtr<FAccumulationMotionBlurViewData>(GetViewData(ViewInfo));
+
+	FAccumulationMotionBlurCompositePS::FParameters* Parameters = GraphBuilder.AllocParameters<FAccumulationMotionBlurCompositePS::FParameters>();
+	Parameters->InputTexture = Input.Texture;
+	Parameters->HistoryTexture = History.Texture;
+	Parameters->InputViewMin = Input.ViewRect.Min;
+	Parameters->OutputViewMin = Output.ViewRect.Min;
+	Parameters->OutputViewSize = Output.ViewRect.Size();
+	Parameters->HistoryViewSize = History.ViewRect.Size();
+	Parameters->LastFrameNumber = ViewData->LastFrameNumber;
+	Parameters->HistoryWeight = GetHistoryWeight(ViewInfo.ViewState->LastRenderTimeDelta, ViewData->Scale, ViewData->Weight);
+	Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+
+	TShaderMapRef<FScreenPassVS> VertexShader(ViewInfo.ShaderMap);
+	TShaderMapRef<FAccumulationMotionBlurCompositePS> PixelShader(ViewInfo.ShaderMap);
+
+	AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("%s Composite %dx%d -> %dx%d", *PostProcessingPassName, History.ViewRect.Width(), History.ViewRect.Height(), Output.ViewRect.Width(), Output.ViewRect.Height()),
+		ViewInfo, FScreenPassTextureViewport(Output), FScreenPassTextureViewport(Input), VertexShader, PixelShader, TStaticBlendState<>::GetRHI(),
+		FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI(), Parameters, EScreenPassDrawFlags::None);
+}
+
+// Offset, in input UV, of the four bilinear taps that average the input pixels an output pixel covers. A single tap covers up to
+// 2x2 pixels, so it's only needed below half resolution
+static FVector2f GetInputFootprintOffset(const FScreenPassTexture& Input, const FIntPoint& OutputSize)
+{
+	const FVector2f Ratio = FVector2f(Input.ViewRect.Size()) / FVector2f(FMath::Max(OutputSize.X, 1), FMath::Max(OutputSize.Y, 1));
+	if (Ratio.X <= 2.f && Ratio.Y <= 2.f)
+	{
+		return FVector2f::ZeroVector;
+	}
+
+	return 0.25f * Ratio / FVector2f(Input.Texture->Desc.Extent);
+}
+
+float FAccumulationMotionBlurSceneExtension::GetHistoryWeight(float DeltaTime, float Scale, float Weight)
+{
+	if (DeltaTime <= 0.f || Scale <= 0.f)
+	{
+		return 0.f;
+	}
+
+	return FMath::Clamp(FMath::Exp(FMath::Loge(FMath::Max(Weight, UE_SMALL_NUMBER)) * DeltaTime / Scale), 0.f, 1.f);
+}
+
+int32 FAccumulationMotionBlurSceneExtension::GetOutputReuseSettleFrames(const FSceneView& View) const
+{
+	const FSceneViewState* ViewState = static_cast<const FSceneViewState*>(View.State);
+	if (ViewState == nullptr)
+	{
+		return -1;
+	}
+
+	TSharedPtr<const FAccumulationMotionBlurViewData> ViewData = StaticCastSharedPtr<const FAccumulationMotionBlurViewData>(GetViewData(View));
+	if (ViewData == nullptr || ViewState->LastRenderTimeDelta <= 0.f || ViewData->Scale <= 0.f)
+	{
+		return -1;
+	}
+
+	const float HistoryWeight = GetHistoryWeight(ViewState->LastRenderTimeDelta, ViewData->Scale, ViewData->Weight);
+	if (HistoryWeight <= UE_SMALL_NUMBER)
+	{
+		return 0;
+	}
+
+	const float FramesToSettle = FMath::Loge(1.f / 255.f) / FMath::Loge(HistoryWeight);
+	return FMath::Min(FMath::CeilToInt(FramesToSettle), 240);
+}
+
+uint32 FAccumulationMotionBlurSceneExtension::GetOutputReuseParameterHash(const FSceneView& View)
+{
+	TSharedPtr<FAccumulationMotionBlurViewData> ViewData = StaticCastSharedPtr<FAccumulationMotionBlurViewData>(GetViewData(View));
+	return ViewData != nullptr ? HashCombine(HashCombine(::GetTypeHash(ViewData->Scale), ::GetTypeHash(ViewData->Weight)), ::GetTypeHash(ViewData->HistoryScale)) : 0;
+}
+
+void FAccumulationMotionBlurSceneExtension::AddPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output)
+{
+	const bool bUseTiles = CVarAccumulationMotionBlurTileSkip.GetValueOnRenderThread() > 0
+		&& !RegionMask_RenderThread.IsEnabled()
+		&& ViewInfo.GetFeatureLevel() >= ERHIFeatureLevel::SM5
+		&& EnumHasAnyFlags(Output.Texture->Desc.Flags, TexCreate_UAV);
+
+	if (bUseTiles)
+	{
+		AddTiledPasses_RenderThread(GraphBuilder, ViewInfo, Input, Output);
+	}
+	else
+	{
+		BaseT::AddPass_RenderThread(GraphBuilder, View, ViewInfo, Input, Output);
+	}
+}
+
+void FAccumulationMotionBlurSceneExtension::AddTiledPasses_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output)
+{
+	TSharedPtr<FAccumulationMotionBlurViewData> ViewData = StaticCastSharedPtr<FAccumulationMotionBlurViewData>(GetViewData(ViewInfo));
+
+	const FIntPoint OutputSize = Output.ViewRect.Size();
+	FMultipassPPAutoTuneScope AutoTune(GraphBuilder, TileSizeTunable, OutputSize);
+	const int32 TileSize = GAccumulationMotionBlurTileSizes[AutoTune.GetCandidate()];
+	const FIntPoint TileCount = FIntPoint::DivideAndRoundUp(OutputSize, TileSize);
+	const FIntPoint InputExtent = Input.Texture->Desc.Extent;
+
+	FAccumulationMotionBlurTileParameters CommonParameters;
+	CommonParameters.InputTexture = Input.Texture;
+	CommonParameters.InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
+	CommonParameters.InputUVScaleBias = FVector4f(
+		float(Input.ViewRect.Width()) / InputExtent.X,
+		float(Input.ViewRect.Height()) / InputExtent.Y,
+		float(Input.ViewRect.Min.X) / InputExtent.X,
+		float(Input.ViewRect.Min.Y) / InputExtent.Y);
+	CommonParameters.InputFootprintOffset = GetInputFootprintOffset(Input, OutputSize);
+	CommonParameters.OutputViewMin = Output.ViewRect.Min;
+	CommonParameters.OutputViewSize = OutputSize;
+	CommonParameters.HistoryWeight = GetHistoryWeight(ViewInfo.ViewState->LastRenderTimeDelta, ViewData->Scale, ViewData->Weight);
+	CommonParameters.ChangeThreshold = FMath::Max(CVarAccumulationMotionBlurTileSkipThreshold.GetValueOnRenderThread(), 0.f);
+	CommonParameters.bResetHistory = ViewData->LastFrameNumber++ == 0 ? 1 : 0;
+
+	FRDGBufferRef TileList = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), TileCount.X * TileCount.Y), TEXT("AccumulationMotionBlur.TileList"));
+	FRDGBufferRef IndirectArgs = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateIndirectDesc<FRHIDispatchIndirectParameters>(1), TEXT("AccumulationMotionBlur.IndirectArgs"));
+	FRDGBufferUAVRef IndirectArgsUAV = GraphBuilder.CreateUAV(IndirectArgs, PF_R32_UINT);
+	AddClearUAVPass(GraphBuilder, IndirectArgsUAV, 0);
+
+	FAccumulationMotionBlurClassifyCS::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FAccumulationMotionBlurClassifyCS::FTileSizeDim>(TileSize);
+
+	{
+		FAccumulationMotionBlurClassifyCS::FParameters* Parameters = GraphBuilder.AllocParameters<FAccumulationMotionBlurClassifyCS::FParameters>();
+		Parameters->Common = CommonParameters;
+		Parameters->HistoryTexture = Output.Texture;
+		Parameters->TileListUAV = GraphBuilder.CreateUAV(TileList, PF_R32_UINT);
+		Parameters->IndirectArgsUAV = IndirectArgsUAV;
+
+		TShaderMapRef<FAccumulationMotionBlurClassifyCS> ComputeShader(ViewInfo.ShaderMap, PermutationVector);
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("%s Classify %dx%d tiles", *PostProcessingPassName, TileCount.X, TileCount.Y), ComputeShader, Parameters, FIntVector(TileCount.X, TileCount.Y, 1));
+	}
+
+	{
+		FAccumulationMotionBlurBlendCS::FParameters* Parameters = GraphBuilder.AllocParameters<FAccumulationMotionBlurBlendCS::FParameters>();
+		Parameters->Common = CommonParameters;
+		Parameters->TileList = GraphBuilder.CreateSRV(TileList, PF_R32_UINT);
+		Parameters->OutputTexture = GraphBuilder.CreateUAV(Output.Texture);
+		Parameters->IndirectDispatchArgs = IndirectArgs;
+
+		TShaderMapRef<FAccumulationMotionBlurBlendCS> ComputeShader(ViewInfo.ShaderMap, PermutationVector);
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("%s Blend changed tiles", *PostProcessingPassName), ComputeShader, Parameters, IndirectArgs, 0);
+	}
+}
+
+void FAccumulationMotionBlurSceneExtension::PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap)
+{
+	BaseT::PrecachePSOs_RenderThread(RHICmdList, ShaderMap);
+
+	if (CVarAccumulationMotionBlurTileSkip.GetValueOnRenderThread() > 0)
+	{
+		// Every tile size, the auto tuner may pick any of them
+		for (int32 PermutationId = 0; PermutationId < FAccumulationMotionBlurClassifyCS::FPermutationDomain::PermutationCount; ++PermutationId)
+		{
+			const FAccumulationMotionBlurClassifyCS::FPermutationDomain PermutationVector(PermutationId);
+			MultipassPPPSOPrecache::PrecacheCompute(RHICmdList, TShaderMapRef<FAccumulationMotionBlurClassifyCS>(ShaderMap, PermutationVector));
+			MultipassPPPSOPrecache::PrecacheCompute(RHICmdList, TShaderMapRef<FAccumulationMotionBlurBlendCS>(ShaderMap, PermutationVector));
+		}
+	}
+
+	// The composite of a reduced resolution history writes the scene color's format
+	if (CVarAccumulationMotionBlurHistoryScale.GetValueOnRenderThread() != 1)
+	{
+		MultipassPPPSOPrecache::PrecacheScreenPassForFormats(RHICmdList, TShaderMapRef<FScreenPassVS>(ShaderMap), TShaderMapRef<FAccumulationMotionBlurCompositePS>(ShaderMap),
+			TStaticBlendState<>::GetRHI(), FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI(), MultipassPPPSOPrecache::GetSceneColorFormats());
+	}
 }
 
 void FAccumulationMotionBlurSceneExtension::SetupParameters(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output, FAccumulationMotionBlurPixelShader::FParameters* Parameters)
 {
 	TSharedPtr<FAccumulationMotionBlurViewData> ViewData = StaticCastSharedPtr<FAccumulationMotionBlurViewData>(GetViewData(View));
 	Parameters->InputTexture = Input.Texture;
-	Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
+	// Bilinear for the footprint taps of a reduced resolution history. Same as point at full resolution, it samples texel centers
+	Parameters->InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
 	Parameters->MotionBlurTexture = Output.Texture;
 	Parameters->MotionBlurSampler = TStaticSamplerState<>::GetRHI();
 
@@ -150,10 +409,8 @@ void FAccumulationMotionBlurSceneExtension::SetupParameters(FRDGBuilder& GraphBu
 	Parameters->InputTextureSize = Input.Texture->Desc.Extent;
 	Parameters->OutputTextureSize = Output.Texture->Desc.Extent;
 
-	Parameters->DeltaTime = ViewInfo.ViewState->LastRenderTimeDelta;
-
-	Parameters->FadeTime = ViewData->Scale;
-	Parameters->FadeWeight = ViewData->Weight;
+	Parameters->HistoryWeight = GetHistoryWeight(ViewInfo.ViewState->LastRenderTimeDelta, ViewData->Scale, ViewData->Weight);
+	Parameters->InputFootprintOffset = GetInputFootprintOffset(Input, Output.ViewRect.Size());
 
 	Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
 }
@@ -7,8 +7,15 @@
 #include "CommonRenderResources.h"
 #include "PostProcess/PostProcessing.h"
 #include "PostProcess/PostProcessMaterial.h"
+#include "Runtime/Launch/Resources/Version.h"
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1
+#include "PostProcess/PostProcessUpscale.h"
+#endif
 #include "ScenePrivate.h"
+#include "SystemTextures.h"
 #include "Engine/TextureRenderTarget2D.h"
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPP.h"
 
 static TAutoConsoleVariable<int32> CVarAdaptiveSharpeningEnabled(
 	TEXT("r.AdaptiveSharpening.Enabled"),
@@ -22,74 +29,189 @@ static TAutoConsoleVariable<float> CVarAdaptiveSharpeningStrength(
 	TEXT(""),
 	ECVF_Default);
 
+static TAutoConsoleVariable<int32> CVarAdaptiveSharpeningUpscaler(
+	TEXT("r.AdaptiveSharpening.Upscaler"),
+	0,
+	TEXT("Runs adaptive sharpen as a spatial upscaler instead of a separate pass after FXAA, so the screen percentage can be lowered.\n")
+	TEXT(" 0: off (default)\n")
+	TEXT(" 1: primary upscaler, render resolution -> secondary resolution\n")
+	TEXT(" 2: secondary upscaler, secondary resolution -> output resolution\n")
+	TEXT("Needs UE 5.1 or later"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarAdaptiveSharpeningQuality(
+	TEXT("r.AdaptiveSharpening.Quality"),
+	2,
+	TEXT("Adaptive sharpen kernel. The strength maps to the same perceived sharpness on every tier.\n")
+	TEXT(" 0: 5 tap contrast adaptive sharpen, single pass\n")
+	TEXT(" 1: 9 tap contrast adaptive sharpen, single pass\n")
+	TEXT(" 2: full adaptive sharpen, edge detection pass plus 25 tap sharpen pass (default)"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarAdaptiveSharpeningEdgeUpdateInterval(
+	TEXT("r.AdaptiveSharpening.EdgeUpdateInterval"),
+	1,
+	TEXT("Spreads the edge map update over this many frames. Every frame, one band of rows out of every N is recomputed\n")
+	TEXT("and the rest is reprojected from the previous frames with the camera motion and velocity. Camera cuts update everything.\n")
+	TEXT(" 1: recompute the whole edge map every frame (default)\n")
+	TEXT(" 2: half rate"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarAdaptiveSharpeningFastMath(
+	TEXT("r.AdaptiveSharpening.FastMath"),
+	0,
+	TEXT("Full quality adaptive sharpen with half precision math where the platform has it, a rational tanh for the anti-ringing\n")
+	TEXT("and polynomial fits instead of pow for the laplace kernel's power mean. Cheaper on GPUs with double rate FP16.\n")
+	TEXT("Check the error on real frames with r.AdaptiveSharpening.FastMath.Validate"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarAdaptiveSharpeningFastMathValidate(
+	TEXT("r.AdaptiveSharpening.FastMath.Validate"),
+	0,
+	TEXT("Also renders the reference pass 2 every frame the fast math one is used and compares the two on the GPU.\n")
+	TEXT("Logs a warning with the largest difference when it's over r.AdaptiveSharpening.FastMath.Tolerance. Debugging only"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarAdaptiveSharpeningFastMathTolerance(
+	TEXT("r.AdaptiveSharpening.FastMath.Tolerance"),
+	2.f / 255.f,
+	TEXT("Largest per channel difference from the reference shader r.AdaptiveSharpening.FastMath.Validate accepts"),
+	ECVF_RenderThreadSafe);
+
+static FMultipassPPEffectRegistration AdaptiveSharpenRegistration(
+	FAdaptiveSharpenSceneExtension::GetEffectName(),
+	[]() -> TSharedPtr<FMultipassPPSceneExtension> { return FSceneViewExtensions::NewExtension<FAdaptiveSharpenSceneExtension>(); },
+	{ TEXT("r.AdaptiveSharpening.Enabled"), TEXT("r.AdaptiveSharpening.Strength") });
+
 IMPLEMENT_GLOBAL_SHADER(FAdaptiveSharpenPixelShaderPass1, "/MultipassPP/Private/AdaptiveSharpening.usf", "Pass1PS", SF_Pixel);
 IMPLEMENT_GLOBAL_SHADER(FAdaptiveSharpenPixelShaderPass2, "/MultipassPP/Private/AdaptiveSharpeningPass2.usf", "Pass2PS", SF_Pixel);
 
+bool FAdaptiveSharpenPixelShaderPass1::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FAdaptiveSharpenSceneExtension::GetEffectName());
+}
+
+bool FAdaptiveSharpenPixelShaderPass2::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	// The contrast adaptive tiers are already cheap, only the full quality one has a fast math variant
+	const FPermutationDomain PermutationVector(Parameters.PermutationId);
+	if (PermutationVector.Get<FFastMathDim>() && PermutationVector.Get<FQualityDim>() < FAdaptiveSharpenSceneExtension::FullQuality)
+	{
+		return false;
+	}
+
+	return FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FAdaptiveSharpenSceneExtension::GetEffectName());
+}
+
+void FAdaptiveSharpenPixelShaderPass2::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+
+	// Lets half compile to min16float on the platforms that support it, it stays float everywhere else
+	const FPermutationDomain PermutationVector(Parameters.PermutationId);
+	if (PermutationVector.Get<FFastMathDim>())
+	{
+		OutEnvironment.CompilerFlags.Add(CFLAG_AllowRealTypes);
+	}
+}
+
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1
+class FAdaptiveSharpenSpatialUpscaler final : public UE::Renderer::Private::ISpatialUpscaler
+{
+public:
+	FAdaptiveSharpenSpatialUpscaler(TSharedRef<FAdaptiveSharpenSceneExtension, ESPMode::ThreadSafe> InExtension)
+		: Extension(InExtension)
+	{
+
+	}
+
+	static constexpr const TCHAR* DebugName = TEXT("FAdaptiveSharpenSpatialUpscaler");
+
+	virtual const TCHAR* GetDebugName() const override { return DebugName; }
+
+	virtual ISpatialUpscaler* Fork_GameThread(const FSceneViewFamily& ViewFamily) const override
+	{
+		return new FAdaptiveSharpenSpatialUpscaler(Extension);
+	}
+
+	virtual FScreenPassTexture AddPasses(FRDGBuilder& GraphBuilder, const FViewInfo& View, const FInputs& PassInputs) const override
+	{
+		const FIntRect OutputRect = PassInputs.Stage == EUpscaleStage::PrimaryToSecondary
+			? FIntRect(FIntPoint::ZeroValue, View.GetSecondaryViewRectSize())
+			: View.UnscaledViewRect;
+
+		return Extension->AddUpscalePasses_RenderThread(GraphBuilder, View, PassInputs.SceneColor, PassInputs.OverrideOutput, OutputRect);
+	}
+
+private:
+	TSharedRef<FAdaptiveSharpenSceneExtension, ESPMode::ThreadSafe> Extension;
+};
+
+static bool IsAdaptiveSharpenUpscaler(const UE::Renderer::Private::ISpatialUpscaler* Upscaler)
+{
+	return Upscaler != nullptr && FCString::Strcmp(Upscaler->GetDebugName(), FAdaptiveSharpenSpatialUpscaler::DebugName) == 0;
+}
+#endif
+
 FAdaptiveSharpenSceneExtension::FAdaptiveSharpenSceneExtension(const FAutoRegister& AutoReg)
-	: FMultipassPPSceneExtension(AutoReg)
+	: BaseT(AutoReg)
 {
 	PostProcessingPassName = "Adaptive Sharpen";
 	PostProcessingPasses = { EPostProcessingPass::FXAA };
 }
 
-void FAdaptiveSharpenSceneExtension::SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView)
+void FAdaptiveSharpenSceneExtension::SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& InViewData)
 {
-	FMultipassPPSceneExtension::SetupView(InViewFamily, InView);
+	FAdaptiveSharpenViewData& ViewData = static_cast<FAdaptiveSharpenViewData&>(InViewData);
 
-	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(InView));
-	if (ViewData != nullptr)
-	{
-		ViewData->Strength = 0.f;
-		ViewData->BlendableWeight = 0.f;
+	const int32 EnabledCVar = CVarAdaptiveSharpeningEnabled.GetValueOnAnyThread();
+	const float StrengthCVar = CVarAdaptiveSharpeningStrength.GetValueOnAnyThread();
 
-		if (CVarAdaptiveSharpeningEnabled.GetValueOnAnyThread() >= 0)
-		{
-			ViewData->BlendableWeight = FMath::Clamp(CVarAdaptiveSharpeningEnabled.GetValueOnAnyThread(), 0, 1);
-		}
-		else
+	// One pass over the blendables for both, and none if the cvars override them
+	float BlendableWeight = 0.f;
+	float BlendableStrength = 0.f;
+	int32 NumEntries = 0;
+	if (EnabledCVar < 0 || StrengthCVar < 0.f)
+	{
+		NumEntries = ForEachBlendable<FAdaptiveSharpenNode>(View, [&](const FAdaptiveSharpenNode& Node, float Weight)
 		{
-			const FFinalPostProcessSettings& Dest = InView.FinalPostProcessSettings;
-			FBlendableEntry* BlendableIt = nullptr;
-			int32 NumEntries = 0;
-			while (FAdaptiveSharpenNode* DataPtr = Dest.BlendableManager.IterateBlendables<FAdaptiveSharpenNode>(BlendableIt))
-			{
-				if (DataPtr)
-				{
-					ViewData->BlendableWeight += BlendableIt->Weight;
-					NumEntries++;
-				}
-			}
+			BlendableWeight += Weight;
+			BlendableStrength += Node.Strength;
+		});
+	}
 
-			if (NumEntries > 0)
-			{
-				ViewData->BlendableWeight /= NumEntries;
-			}
-		}
+	ViewData.BlendableWeight = EnabledCVar >= 0 ? FMath::Clamp(EnabledCVar, 0, 1) : (NumEntries > 0 ? BlendableWeight / NumEntries : 0.f);
+	ViewData.Strength = StrengthCVar >= 0.f ? FMath::Max(StrengthCVar, 0) : (NumEntries > 0 ? BlendableStrength / NumEntries : 0.f);
+	ViewData.bNeedsEdgeMap = GetQuality() >= FullQuality;
+
+	// BeginRenderViewFamily only installs the upscaler, the family's forked copy tells whether it made it to this frame
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1
+	ViewData.bPrimaryUpscalerInstalled = View.Family != nullptr && IsAdaptiveSharpenUpscaler(View.Family->GetPrimarySpatialUpscalerInterface());
+	ViewData.bSecondaryUpscalerInstalled = View.Family != nullptr && IsAdaptiveSharpenUpscaler(View.Family->GetSecondarySpatialUpscalerInterface());
+#endif
+}
+
+void FAdaptiveSharpenSceneExtension::BeginRenderViewFamily(FSceneViewFamily& InViewFamily)
+{
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1
+	const int32 UpscalerMode = CVarAdaptiveSharpeningUpscaler.GetValueOnGameThread();
+	const bool bPrimary = UpscalerMode == 1;
+	const bool bSecondary = UpscalerMode == 2;
 
-		if (CVarAdaptiveSharpeningStrength.GetValueOnAnyThread() >= 0.f)
+	if (InViewFamily.GetFeatureLevel() >= ERHIFeatureLevel::SM5)
+	{
+		// Don't replace an upscaler another plugin installed
+		TSharedRef<FAdaptiveSharpenSceneExtension, ESPMode::ThreadSafe> This = StaticCastSharedRef<FAdaptiveSharpenSceneExtension>(AsShared());
+		if (bPrimary && InViewFamily.GetPrimarySpatialUpscalerInterface() == nullptr)
 		{
-			ViewData->Strength = FMath::Max(CVarAdaptiveSharpeningStrength.GetValueOnAnyThread(), 0);
+			InViewFamily.SetPrimarySpatialUpscalerInterface(new FAdaptiveSharpenSpatialUpscaler(This));
 		}
-		else
+		else if (bSecondary && InViewFamily.GetSecondarySpatialUpscalerInterface() == nullptr)
 		{
-			const FFinalPostProcessSettings& Dest = InView.FinalPostProcessSettings;
-			FBlendableEntry* BlendableIt = nullptr;
-			int32 NumEntries = 0;
-			while (FAdaptiveSharpenNode* DataPtr = Dest.BlendableManager.IterateBlendables<FAdaptiveSharpenNode>(BlendableIt))
-			{
-				if (DataPtr)
-				{
-					ViewData->Strength += DataPtr->Strength;
-					NumEntries++;
-				}
-			}
-
-			if (NumEntries > 0)
-			{
-				ViewData->Strength /= NumEntries;
-			}
+			InViewFamily.SetSecondarySpatialUpscalerInterface(new FAdaptiveSharpenSpatialUpscaler(This));
 		}
 	}
+#endif
 }
 
 bool FAdaptiveSharpenSceneExtension::IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const
@@ -109,104 +231,302 @@ bool FAdaptiveSharpenSceneExtension::IsActiveThisFrame_Internal(const FSceneView
 		bStrengthActive = CVarAdaptiveSharpeningStrength.GetValueOnGameThread() > 0.f;
 	}
 
-	return FMultipassPPSceneExtension::IsActiveThisFrame_Internal(Context) && bIsActive && bStrengthActive;
+	return BaseT::IsActiveThisFrame_Internal(Context) && bIsActive && bStrengthActive;
 }
 
 FScreenPassTexture FAdaptiveSharpenSceneExtension::PostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& InOutInputs, EPostProcessingPass Pass)
 {
-	const FScreenPassTexture& SceneColor = InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor);
-	check(SceneColor.IsValid());
 	checkSlow(View.bIsViewInfo);
 	const FViewInfo& ViewInfo = static_cast<const FViewInfo&>(View);
-	InOutInputs.Validate();
 
-	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(View));
-	if (ViewData != nullptr && ViewData->Strength > 0 && ViewData->BlendableWeight > 0)
+	const bool bValidateFastMath = CVarAdaptiveSharpeningFastMathValidate.GetValueOnRenderThread() > 0 && GetPass2PermutationVector().Get<FAdaptiveSharpenPixelShaderPass2::FFastMathDim>();
+	if (!bValidateFastMath && FastMathCompare.IsValid())
 	{
-		// Pass 1: Scene color -> RT
-		FRDGTextureRef RTTexture = GraphBuilder.RegisterExternalTexture(ViewData->GetRT());
-		FScreenPassRenderTarget RT = FScreenPassRenderTarget(RTTexture, ViewInfo.ViewRect, ERenderTargetLoadAction::ELoad);
+		// Validation was turned off. Deliver the comparisons still in flight, then let the readbacks go
+		FastMathCompare->PollReadbacks();
+		if (!FastMathCompare->HasReadbacksInFlight())
+		{
+			FastMathCompare.Reset();
+		}
+	}
 
-		DrawPass(1, GraphBuilder, View, ViewInfo, SceneColor, RT);
+	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(View));
+	if (ViewData != nullptr && ViewData->Strength > 0 && ViewData->BlendableWeight > 0 && !WillSpatialUpscalerRun(ViewInfo, *ViewData))
+	{
+		FScreenPassTexture Output = BaseT::PostProcessPass_RenderThread(GraphBuilder, View, InOutInputs, Pass);
 
-		if (InOutInputs.OverrideOutput.IsValid())
+		if (bValidateFastMath)
 		{
-			// Pass 2: RT -> Output
-			DrawPass(2, GraphBuilder, View, ViewInfo, RT, InOutInputs.OverrideOutput);
-
-			return InOutInputs.OverrideOutput;
+			AddFastMathValidationPasses_RenderThread(GraphBuilder, ViewInfo, Output);
 		}
-		else
-		{
-			// Pass 2: RT -> RT
-			DrawPass(2, GraphBuilder, View, ViewInfo, RT, RT);
 
-			return MoveTemp(RT);
-		}
+		return Output;
 	}
 
 	return ReturnUntouchedSceneColorForPostProcessing(GraphBuilder, View, ViewInfo, InOutInputs);
 }
 
-void FAdaptiveSharpenSceneExtension::SetupPass1Parameters(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output, FAdaptiveSharpenPixelShaderPass1::FParameters* Parameters)
+uint32 FAdaptiveSharpenSceneExtension::GetOutputReuseParameterHash(const FSceneView& View)
 {
-	Parameters->InputTexture = Input.Texture;
-	Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
-	Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
-	Parameters->PixelUVSize.X = 1.f / Input.Texture->Desc.Extent.X;
-	Parameters->PixelUVSize.Y = 1.f / Input.Texture->Desc.Extent.Y;
+	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(View));
+	return ViewData != nullptr ? HashCombine(::GetTypeHash(ViewData->Strength), ::GetTypeHash(ViewData->BlendableWeight)) : 0;
 }
 
-void FAdaptiveSharpenSceneExtension::SetupPass2Parameters(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output, FAdaptiveSharpenPixelShaderPass2::FParameters* Parameters)
+bool FAdaptiveSharpenSceneExtension::WillSpatialUpscalerRun(const FViewInfo& ViewInfo, const FAdaptiveSharpenViewData& ViewData) const
 {
-	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(View));
+	// The upscaler has no scene textures to build a region mask from, so with a mask it only upscales and the pass after FXAA sharpens
+	if (RegionMask_RenderThread.IsEnabled())
+	{
+		return false;
+	}
 
-	Parameters->InputTexture = Input.Texture;
-	Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
-	Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
-	Parameters->PixelUVSize.X = 1.f / Input.Texture->Desc.Extent.X;
-	Parameters->PixelUVSize.Y = 1.f / Input.Texture->Desc.Extent.Y;
-	Parameters->CurveHeight = FMath::Clamp(ViewData->BlendableWeight, 0.f, 1.f) * ViewData->Strength;
+	// The secondary upscaler always runs once it's installed, whoever owns the primary one
+	if (ViewData.bSecondaryUpscalerInstalled)
+	{
+		return true;
+	}
+
+	if (!ViewData.bPrimaryUpscalerInstalled)
+	{
+		return false;
+	}
+
+	// The primary upscaler only runs when the view is actually rendered at a lower resolution, and not when TSR or TAAU already upscaled it
+	return ViewInfo.PrimaryScreenPercentageMethod == EPrimaryScreenPercentageMethod::SpatialUpscale
+		&& ViewInfo.ViewRect.Size() != ViewInfo.GetSecondaryViewRectSize();
 }
 
-void FAdaptiveSharpenSceneExtension::DrawPass(int32 PassNum, FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output)
+FScreenPassTexture FAdaptiveSharpenSceneExtension::AddUpscalePasses_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassTexture& SceneColor, const FScreenPassRenderTarget& OverrideOutput, const FIntRect& OutputRect)
 {
-	check(PassNum == 1 || PassNum == 2);
-
 	check(IsInRenderingThread());
 
-	const FScreenPassTextureViewport InputViewport(Input);
-	const FScreenPassTextureViewport OutputViewport(Output);
+	RDG_EVENT_SCOPE(GraphBuilder, "%s Upscale %dx%d -> %dx%d", *PostProcessingPassName, SceneColor.ViewRect.Width(), SceneColor.ViewRect.Height(), OutputRect.Width(), OutputRect.Height());
 
-	FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(View.FeatureLevel);
-	check(GlobalShaderMap);
+	FScreenPassRenderTarget Output = OverrideOutput;
+	if (!Output.IsValid())
+	{
+		const FRDGTextureDesc OutputDesc = FRDGTextureDesc::Create2D(OutputRect.Max, SceneColor.Texture->Desc.Format, FClearValueBinding::Black, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+		Output = FScreenPassRenderTarget(GraphBuilder.CreateTexture(OutputDesc, TEXT("AdaptiveSharpen.Upscale")), OutputRect, ERenderTargetLoadAction::ENoAction);
+	}
 
 	TShaderMapRef<FScreenPassVS> VertexShader(ViewInfo.ShaderMap);
+	FRHIBlendState* BlendState = FScreenPassPipelineState::FDefaultBlendState::GetRHI();
+	FRHIDepthStencilState* DepthStencilState = FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI();
 
-	FRDGEventName PassName = FRDGEventName(TEXT("%s Pass %d"), *PostProcessingPassName, PassNum);
+	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(ViewInfo));
+	if (ViewData == nullptr || ViewData->Strength <= 0 || ViewData->BlendableWeight <= 0 || RegionMask_RenderThread.IsEnabled())
+	{
+		// Nothing to sharpen, or the pass after FXAA already sharpened the masked region, just do a bilinear upscale
+		FCopyRectPS::FParameters* Parameters = GraphBuilder.AllocParameters<FCopyRectPS::FParameters>();
+		Parameters->InputTexture = SceneColor.Texture;
+		Parameters->InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
+		Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+
+		TShaderMapRef<FCopyRectPS> CopyPixelShader(ViewInfo.ShaderMap);
+		AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("Bilinear"), ViewInfo, FScreenPassTextureViewport(Output), FScreenPassTextureViewport(SceneColor), VertexShader, CopyPixelShader, BlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
 
-	if (PassNum == 1)
+		return MoveTemp(Output);
+	}
+
+	// Pass 1: Scene color -> edges, at the input resolution so the edge detection keeps its texel spacing.
+	// The lower quality tiers sharpen the scene color directly
+	const int32 Quality = GetQuality();
+	FScreenPassTexture Edges = SceneColor;
+	if (Quality >= FullQuality)
 	{
+		const FRDGTextureDesc EdgesDesc = FRDGTextureDesc::Create2D(SceneColor.Texture->Desc.Extent, PF_FloatRGBA, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+		const FScreenPassRenderTarget EdgesTarget(GraphBuilder.CreateTexture(EdgesDesc, TEXT("AdaptiveSharpen.UpscaleEdges")), SceneColor.ViewRect, ERenderTargetLoadAction::ENoAction);
+
 		TShaderMapRef<FAdaptiveSharpenPixelShaderPass1> PixelShader(ViewInfo.ShaderMap);
-		check(PixelShader.IsValid());
 
 		FAdaptiveSharpenPixelShaderPass1::FParameters* Parameters = GraphBuilder.AllocParameters<FAdaptiveSharpenPixelShaderPass1::FParameters>();
-		SetupPass1Parameters(GraphBuilder, View, ViewInfo, Input, Output, Parameters);
+		SetupPass1Parameters(GraphBuilder, ViewInfo, ViewInfo, SceneColor, EdgesTarget, Parameters);
+
+		AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("Pass 1"), ViewInfo, FScreenPassTextureViewport(EdgesTarget), FScreenPassTextureViewport(SceneColor), VertexShader, PixelShader, BlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
 
-		AddDrawScreenPass(GraphBuilder, Forward<FRDGEventName&&>(PassName), ViewInfo, OutputViewport, InputViewport, VertexShader, PixelShader, BlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
+		Edges = EdgesTarget;
 	}
-	else if (PassNum == 2)
+
+	// Pass 2: Edges -> Output, at the output resolution. The taps are still one input texel apart, the bilinear fetch fills in between them
 	{
-		TShaderMapRef<FAdaptiveSharpenPixelShaderPass2> PixelShader(ViewInfo.ShaderMap);
-		check(PixelShader.IsValid());
+		TShaderMapRef<FAdaptiveSharpenPixelShaderPass2> PixelShader(ViewInfo.ShaderMap, GetPass2PermutationVector());
 
 		FAdaptiveSharpenPixelShaderPass2::FParameters* Parameters = GraphBuilder.AllocParameters<FAdaptiveSharpenPixelShaderPass2::FParameters>();
-		SetupPass2Parameters(GraphBuilder, View, ViewInfo, Input, Output, Parameters);
+		SetupPass2Parameters(GraphBuilder, ViewInfo, ViewInfo, Edges, Output, Parameters);
+		Parameters->InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
 
-		AddDrawScreenPass(GraphBuilder, Forward<FRDGEventName&&>(PassName), ViewInfo, OutputViewport, InputViewport, VertexShader, PixelShader, BlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
+		AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("Pass 2"), ViewInfo, FScreenPassTextureViewport(Output), FScreenPassTextureViewport(Edges), VertexShader, PixelShader, BlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
 	}
+
+	return MoveTemp(Output);
+}
+
+void FAdaptiveSharpenPass1::SetupParameters(FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters)
+{
+	Extension.SetupPass1Parameters(Context.GraphBuilder, Context.View, Context.ViewInfo, Context.Input, Context.Output, Parameters);
+	Extension.SetupEdgeHistoryParameters(Context.GraphBuilder, Context.ViewInfo, Context.InOutInputs, Context.Output, Parameters);
+}
+
+bool FAdaptiveSharpenPass1::IsEnabled(const FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context)
+{
+	return Extension.GetQuality() >= FAdaptiveSharpenSceneExtension::FullQuality;
+}
+
+FAdaptiveSharpenPass1::ShaderType::FPermutationDomain FAdaptiveSharpenPass1::GetPermutationVector(const FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context)
+{
+	// SetupEdgeHistoryParameters only binds the second target when the edge history is in use
+	ShaderType::FPermutationDomain PermutationVector;
+	PermutationVector.Set<ShaderType::FEdgeHistoryDim>(CVarAdaptiveSharpeningEdgeUpdateInterval.GetValueOnRenderThread() > 1 && Context.InOutInputs.SceneTextures.SceneTextures != nullptr);
+	return PermutationVector;
+}
+
+void FAdaptiveSharpenPass2::SetupParameters(FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters)
+{
+	Extension.SetupPass2Parameters(Context.GraphBuilder, Context.View, Context.ViewInfo, Context.Input, Context.Output, Parameters);
+}
+
+FAdaptiveSharpenPass2::ShaderType::FPermutationDomain FAdaptiveSharpenPass2::GetPermutationVector(const FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context)
+{
+	return Extension.GetPass2PermutationVector();
+}
+
+int32 FAdaptiveSharpenSceneExtension::GetQuality() const
+{
+	const int32 Quality = ScalabilitySettings_RenderThread.Quality >= 0 ? ScalabilitySettings_RenderThread.Quality : CVarAdaptiveSharpeningQuality.GetValueOnRenderThread();
+	return FMath::Clamp(Quality, 0, FullQuality);
+}
+
+FAdaptiveSharpenPixelShaderPass2::FPermutationDomain FAdaptiveSharpenSceneExtension::GetPass2PermutationVector() const
+{
+	const int32 Quality = GetQuality();
+
+	FAdaptiveSharpenPixelShaderPass2::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FAdaptiveSharpenPixelShaderPass2::FQualityDim>(Quality);
+	PermutationVector.Set<FAdaptiveSharpenPixelShaderPass2::FFastMathDim>(Quality >= FullQuality && CVarAdaptiveSharpeningFastMath.GetValueOnRenderThread() > 0);
+	return PermutationVector;
 }
 
+void FAdaptiveSharpenSceneExtension::AddFastMathValidationPasses_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassTexture& Output)
+{
+	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(ViewInfo));
+
+	// Masked pixels hold the scene color, and the output can't always be read back from
+	if (ViewData == nullptr || !ViewData->GetRT().IsValid() || RegionMask_RenderThread.IsEnabled()
+		|| !EnumHasAnyFlags(Output.Texture->Desc.Flags, TexCreate_ShaderResource) || ViewInfo.GetFeatureLevel() < ERHIFeatureLevel::SM5)
+	{
+		return;
+	}
+
+	RDG_EVENT_SCOPE(GraphBuilder, "%s FastMath Validation", *PostProcessingPassName);
+
+	// Pass 1 wrote the edges into the view data RT
+	const FScreenPassTexture Edges(GraphBuilder.RegisterExternalTexture(ViewData->GetRT()), ViewInfo.ViewRect);
+
+	const FRDGTextureDesc ReferenceDesc = FRDGTextureDesc::Create2D(Output.Texture->Desc.Extent, Output.Texture->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+	const FScreenPassRenderTarget Reference(GraphBuilder.CreateTexture(ReferenceDesc, TEXT("AdaptiveSharpen.FastMathReference")), Output.ViewRect, ERenderTargetLoadAction::ENoAction);
+
+	FAdaptiveSharpenPixelShaderPass2::FPermutationDomain PermutationVector = GetPass2PermutationVector();
+	PermutationVector.Set<FAdaptiveSharpenPixelShaderPass2::FFastMathDim>(false);
+
+	TShaderMapRef<FScreenPassVS> VertexShader(ViewInfo.ShaderMap);
+	TShaderMapRef<FAdaptiveSharpenPixelShaderPass2> PixelShader(ViewInfo.ShaderMap, PermutationVector);
+
+	FAdaptiveSharpenPixelShaderPass2::FParameters* Parameters = GraphBuilder.AllocParameters<FAdaptiveSharpenPixelShaderPass2::FParameters>();
+	SetupPass2Parameters(GraphBuilder, ViewInfo, ViewInfo, Edges, Reference, Parameters);
+
+	AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("Reference Pass 2"), ViewInfo, FScreenPassTextureViewport(Reference), FScreenPassTextureViewport(Edges), VertexShader, PixelShader,
+		FAdaptiveSharpenPass2::GetBlendState(), FAdaptiveSharpenPass2::GetDepthStencilState(), Parameters, EScreenPassDrawFlags::None);
+
+	if (!FastMathCompare.IsValid())
+	{
+		FastMathCompare = MakeUnique<FMultipassPPImageCompare>();
+		FastMathCompare->SetCallback(FOnMultipassPPImageCompared::CreateLambda([this](const FMultipassPPImageCompareResult& Result)
+		{
+			// Only log when the error gets worse, every frame would flood the log
+			if (Result.MaxDifference <= FastMathMaxDifference)
+			{
+				return;
+			}
+			FastMathMaxDifference = Result.MaxDifference;
+
+			UE_LOG(LogMultipassPP, Log, TEXT("AdaptiveSharpening fast math: largest difference from the reference so far %.5f (%.2f/255) on frame %llu"),
+				Result.MaxDifference, Result.MaxDifference * 255.f, Result.FrameNumber);
+			UE_CLOG(Result.NumPixelsOverTolerance > 0, LogMultipassPP, Warning, TEXT("AdaptiveSharpening fast math: %u of %u pixels are over the %.5f tolerance"),
+				Result.NumPixelsOverTolerance, Result.NumPixels, Result.Tolerance);
+		}));
+	}
+
+	FastMathCompare->AddComparePass(GraphBuilder, ViewInfo.ShaderMap, Output, Reference, CVarAdaptiveSharpeningFastMathTolerance.GetValueOnRenderThread());
+}
+
+void FAdaptiveSharpenSceneExtension::SetupPass1Parameters(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output, FAdaptiveSharpenPixelShaderPass1::FParameters* Parameters)
+{
+	Parameters->InputTexture = Input.Texture;
+	Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
+	Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+	Parameters->PixelUVSize.X = 1.f / Input.Texture->Desc.Extent.X;
+	Parameters->PixelUVSize.Y = 1.f / Input.Texture->Desc.Extent.Y;
+}
+
+bool FAdaptiveSharpenSceneExtension::SetupEdgeHistoryParameters(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FPostProcessMaterialInputs& InOutInputs, const FScreenPassRenderTarget& Output, FAdaptiveSharpenPixelShaderPass1::FParameters* Parameters)
+{
+	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(ViewInfo));
+
+	const int32 NumBands = CVarAdaptiveSharpeningEdgeUpdateInterval.GetValueOnRenderThread();
+	if (NumBands <= 1 || InOutInputs.SceneTextures.SceneTextures == nullptr)
+	{
+		ViewData->EdgeHistory.SafeRelease();
+		return false;
+	}
+
+	const FIntPoint Extent = Output.Texture->Desc.Extent;
+	const bool bEdgeHistoryValid = ViewData->EdgeHistory.IsValid()
+		&& ViewData->EdgeHistory->GetDesc().Extent == Extent
+		&& !ViewInfo.bCameraCut
+		&& !ViewInfo.bPrevTransformsReset;
+
+	FRDGTextureRef EdgeHistory = bEdgeHistoryValid ? GraphBuilder.RegisterExternalTexture(ViewData->EdgeHistory) : GSystemTextures.GetBlackDummy(GraphBuilder);
+
+	const FRDGTextureDesc EdgesDesc = FRDGTextureDesc::Create2D(Extent, PF_R16F, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+	FRDGTextureRef Edges = GraphBuilder.CreateTexture(EdgesDesc, TEXT("AdaptiveSharpen.EdgeHistory"));
+	GraphBuilder.QueueTextureExtraction(Edges, &ViewData->EdgeHistory);
+
+	Parameters->View = ViewInfo.ViewUniformBuffer;
+	Parameters->SceneTexturesStruct = InOutInputs.SceneTextures.SceneTextures;
+	Parameters->EdgeHistoryTexture = EdgeHistory;
+	Parameters->EdgeHistorySampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
+	Parameters->OutputViewMin = FVector2f(Output.ViewRect.Min);
+	Parameters->OutputViewSize = FVector2f(Output.ViewRect.Size());
+	Parameters->EdgeHistoryInvExtent = FVector2f(1.f / Extent.X, 1.f / Extent.Y);
+	Parameters->bEdgeHistoryValid = bEdgeHistoryValid ? 1 : 0;
+	Parameters->NumEdgeUpdateBands = NumBands;
+	Parameters->EdgeUpdateBand = ViewData->EdgeUpdateFrame++ % NumBands;
+	Parameters->RenderTargets[1] = FRenderTargetBinding(Edges, ERenderTargetLoadAction::ENoAction);
+
+	return true;
+}
+
+void FAdaptiveSharpenSceneExtension::SetupPass2Parameters(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output, FAdaptiveSharpenPixelShaderPass2::FParameters* Parameters)
+{
+	TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(GetViewData(View));
+
+	Parameters->InputTexture = Input.Texture;
+	Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
+	Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+	Parameters->PixelUVSize.X = 1.f / Input.Texture->Desc.Extent.X;
+	Parameters->PixelUVSize.Y = 1.f / Input.Texture->Desc.Extent.Y;
+	Parameters->CurveHeight = FMath::Clamp(ViewData->BlendableWeight, 0.f, 1.f) * ViewData->Strength;
+}
+
+void FAdaptiveSharpenSceneExtension::GetViewDataPixelFormats(TArray<EPixelFormat>& OutFormats) const
+{
+	const FAdaptiveSharpenViewData Defaults;
+	OutFormats.Add(GetPixelFormatFromRenderTargetFormat(Defaults.RTPixelFormat));
+	if (Defaults.RTCompactPixelFormat.IsSet())
+	{
+		OutFormats.Add(GetPixelFormatFromRenderTargetFormat(Defaults.RTCompactPixelFormat.GetValue()));
+	}
+}
 
 size_t FAdaptiveSharpenSceneExtension::GetTypeHash() const
 {
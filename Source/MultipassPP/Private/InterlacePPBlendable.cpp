@@ -3,6 +3,9 @@
 
 #include "InterlacePPBlendable.h"
 
+#include "MultipassPPEffectRegistry.h"
+#include "InterlacePPSceneExtension.h"
+
 #include "Runtime/Launch/Resources/Version.h"
 #if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 3
 #include "SceneRendering.h"
@@ -18,6 +21,9 @@ void UInterlacePPBlendable::OverrideBlendableSettings(FSceneView& View, float We
 		return;
 	}
 
+	// The extension is created on first use, so it starts rendering the frame after the blendable is first applied
+	FMultipassPPEffectRegistry::Get().RequestEffect(FInterlacePPSceneExtension::GetEffectName());
+
 	FFinalPostProcessSettings& Dest = View.FinalPostProcessSettings;
 
 	FInterlacePPNode Node;
@@ -10,6 +10,9 @@
 #include "ScenePrivate.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "InterlacePPBlendable.h"
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPPAutoTune.h"
+#include "RenderGraphUtils.h"
 
 static TAutoConsoleVariable<int32> CVarInterlacingEnabled(
 	TEXT("r.InterlacingPP.Enabled"),
@@ -17,45 +20,70 @@ static TAutoConsoleVariable<int32> CVarInterlacingEnabled(
 	TEXT(""),
 	ECVF_Default);
 
-IMPLEMENT_GLOBAL_SHADER(FInterlacePPPixelShader, "/MultipassPP/Private/InterlacePP.usf", "InterlacePS", SF_Pixel);
+static FMultipassPPEffectRegistration InterlacePPRegistration(
+	FInterlacePPSceneExtension::GetEffectName(),
+	[]() -> TSharedPtr<FMultipassPPSceneExtension> { return FSceneViewExtensions::NewExtension<FInterlacePPSceneExtension>(); },
+	{ TEXT("r.InterlacingPP.Enabled") });
+
+IMPLEMENT_GLOBAL_SHADER(FInterlacePPComputeShader, "/MultipassPP/Private/InterlacePP.usf", "InterlaceCS", SF_Compute);
+
+bool FInterlacePPComputeShader::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5)
+		&& FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FInterlacePPSceneExtension::GetEffectName());
+}
+
+FIntPoint FInterlacePPComputeShader::GetGroupShape(int32 GroupShape)
+{
+	static const FIntPoint Shapes[NumGroupShapes] = { FIntPoint(8, 8), FIntPoint(16, 8), FIntPoint(32, 4) };
+	return Shapes[FMath::Clamp(GroupShape, 0, NumGroupShapes - 1)];
+}
+
+void FInterlacePPComputeShader::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	TMultipassPPComputeShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+
+	// Replaces the template's group size
+	const FPermutationDomain PermutationVector(Parameters.PermutationId);
+	const FIntPoint GroupShape = GetGroupShape(PermutationVector.Get<FGroupShapeDim>());
+	OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZEX"), GroupShape.X);
+	OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZEY"), GroupShape.Y);
+}
+
+IMPLEMENT_GLOBAL_SHADER(FInterlacePPPixelShader, "/MultipassPP/Private/InterlacePPFallback.usf", "InterlacePS", SF_Pixel);
+
+bool FInterlacePPPixelShader::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	// SM5 platforms use the compute shader
+	return !IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5)
+		&& FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FInterlacePPSceneExtension::GetEffectName());
+}
+
+static FMultipassPPTunableRegistration GInterlacePPGroupShapeTunable(FInterlacePPSceneExtension::GroupShapeTunable, { TEXT("8x8"), TEXT("16x8"), TEXT("32x4") });
 
 FInterlacePPSceneExtension::FInterlacePPSceneExtension(const FAutoRegister& AutoReg)
-	: BaseT(AutoReg)
+	: FMultipassPPSceneExtension(AutoReg)
 {
 	PostProcessingPassName = "InterlacePP";
 }
 
-void FInterlacePPSceneExtension::SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView)
+void FInterlacePPSceneExtension::SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& InViewData)
 {
-	BaseT::SetupView(InViewFamily, InView);
+	FInterlacePPViewData& ViewData = static_cast<FInterlacePPViewData&>(InViewData);
 
-	TSharedPtr<FInterlacePPViewData> ViewData = StaticCastSharedPtr<FInterlacePPViewData>(GetViewData(InView));
-	if (ViewData != nullptr)
+	const int32 EnabledCVar = CVarInterlacingEnabled.GetValueOnAnyThread();
+	if (EnabledCVar >= 0)
 	{
-		ViewData->BlendableWeight = 0.f;
-		if (CVarInterlacingEnabled.GetValueOnAnyThread() >= 0)
-		{
-			ViewData->BlendableWeight = FMath::Clamp(CVarInterlacingEnabled.GetValueOnAnyThread(), 0, 1);
-		}
-		else
+		ViewData.BlendableWeight = FMath::Clamp(EnabledCVar, 0, 1);
+	}
+	else
+	{
+		float BlendableWeight = 0.f;
+		const int32 NumEntries = ForEachBlendable<FInterlacePPNode>(View, [&BlendableWeight](const FInterlacePPNode& Node, float Weight)
 		{
-			const FFinalPostProcessSettings& Dest = InView.FinalPostProcessSettings;
-			FBlendableEntry* BlendableIt = nullptr;
-			int32 NumEntries = 0;
-			while (FInterlacePPNode* DataPtr = Dest.BlendableManager.IterateBlendables<FInterlacePPNode>(BlendableIt))
-			{
-				if (DataPtr)
-				{
-					ViewData->BlendableWeight += BlendableIt->Weight;
-					NumEntries++;
-				}
-			}
-
-			if (NumEntries > 0)
-			{
-				ViewData->BlendableWeight /= NumEntries;
-			}
-		}
+			BlendableWeight += Weight;
+		});
+		ViewData.BlendableWeight = NumEntries > 0 ? BlendableWeight / NumEntries : 0.f;
 	}
 }
 
@@ -76,7 +104,7 @@ bool FInterlacePPSceneExtension::IsActiveThisFrame_Internal(const FSceneViewExte
 		bIsActive = CVarInterlacingEnabled.GetValueOnGameThread() > 0;
 	}
 
-	return BaseT::IsActiveThisFrame_Internal(Context) && bIsActive;
+	return FMultipassPPSceneExtension::IsActiveThisFrame_Internal(Context) && bIsActive;
 }
 
 FScreenPassTexture FInterlacePPSceneExtension::PostProcessPass_RenderThread(
@@ -94,12 +122,72 @@ FScreenPassTexture FInterlacePPSceneExtension::PostProcessPass_RenderThread(
 		return ReturnUntouchedSceneColorForPostProcessing(GraphBuilder, View, ViewInfo, InOutInputs);
 	}
 
-	if (ViewData->BlendableWeight <= 0.f)
+	if (ViewData->BlendableWeight <= 0.f || !ViewData->GetRT().IsValid())
 	{
 		return ReturnUntouchedSceneColorForPostProcessing(GraphBuilder, View, ViewInfo, InOutInputs);
 	}
 
-	return BaseT::PostProcessPass_RenderThread(GraphBuilder, View, InOutInputs, Pass);
+	const FScreenPassTexture& SceneColor = InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor);
+	check(SceneColor.IsValid());
+	InOutInputs.Validate();
+
+	RDG_EVENT_SCOPE(GraphBuilder, "%s", *PostProcessingPassName);
+
+	if (ViewInfo.GetFeatureLevel() < ERHIFeatureLevel::SM5)
+	{
+		return AddPixelShaderPasses_RenderThread(GraphBuilder, ViewInfo, InOutInputs, SceneColor, GraphBuilder.RegisterExternalTexture(ViewData->GetRT()));
+	}
+
+	// Both fields are written, so the output can be the override output directly when it takes UAV writes
+	FScreenPassRenderTarget Output = InOutInputs.OverrideOutput;
+	if (!Output.IsValid() || !EnumHasAnyFlags(Output.Texture->Desc.Flags, TexCreate_UAV))
+	{
+		const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(SceneColor.Texture->Desc.Extent, SceneColor.Texture->Desc.Format, FClearValueBinding::None,
+			TexCreate_ShaderResource | TexCreate_RenderTargetable | TexCreate_UAV);
+		Output = FScreenPassRenderTarget(GraphBuilder.CreateTexture(Desc, TEXT("InterlacePP.Output")), SceneColor.ViewRect, ERenderTargetLoadAction::ENoAction);
+	}
+
+	FRDGTextureRef FieldHistory = GraphBuilder.RegisterExternalTexture(ViewData->GetRT());
+	const FIntPoint OutputSize = Output.ViewRect.Size();
+	const FIntPoint FieldSize(OutputSize.X, (OutputSize.Y + 1) / 2);
+
+	FInterlacePPComputeShader::FParameters* Parameters = GraphBuilder.AllocParameters<FInterlacePPComputeShader::FParameters>();
+	SetupParameters(GraphBuilder, View, ViewInfo, SceneColor, Output, FieldHistory, Parameters);
+
+	// The dispatch can't be stencil tested, so it skips the groups the mask excludes entirely, and the excluded pixels are filled
+	// with the scene color afterwards
+	FRDGTextureRef RegionMask = AddRegionMaskPass_RenderThread(GraphBuilder, ViewInfo, Output);
+
+	{
+		FMultipassPPAutoTuneScope AutoTune(GraphBuilder, GroupShapeTunable, OutputSize);
+		const FIntPoint GroupShape = FInterlacePPComputeShader::GetGroupShape(AutoTune.GetCandidate());
+
+		// A group covers twice its height in rows of the view
+		FMultipassPPRegionMaskTiles RegionTiles;
+		if (RegionMask != nullptr)
+		{
+			RegionTiles = AddMultipassPPRegionMaskClassifyPass(GraphBuilder, ViewInfo, Output, RegionMask, FIntPoint(GroupShape.X, GroupShape.Y * 2));
+		}
+		MultipassPPCompute::SetupRegionMaskTiles(GraphBuilder, RegionMask != nullptr ? &RegionTiles : nullptr, Parameters->Common);
+
+		FInterlacePPComputeShader::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FInterlacePPComputeShader::FGroupShapeDim>(AutoTune.GetCandidate());
+		TShaderMapRef<FInterlacePPComputeShader> ComputeShader(ViewInfo.ShaderMap, PermutationVector);
+
+		MultipassPPCompute::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("%s (CS) %dx%d field", *PostProcessingPassName, FieldSize.X, FieldSize.Y),
+			ComputeShader,
+			Parameters,
+			FComputeShaderUtils::GetGroupCount(FieldSize, GroupShape));
+	}
+
+	if (RegionMask != nullptr)
+	{
+		AddMultipassPPRegionMaskFillPass(GraphBuilder, ViewInfo, SceneColor, Output, RegionMask);
+	}
+
+	return CopyToOverrideOutput(GraphBuilder, ViewInfo, InOutInputs, Output);
 }
 
 void FInterlacePPSceneExtension::SetupParameters(
@@ -108,19 +196,163 @@ void FInterlacePPSceneExtension::SetupParameters(
 	const FViewInfo& ViewInfo,
 	const FScreenPassTexture& Input,
 	const FScreenPassRenderTarget& Output,
-	FInterlacePPPixelShader::FParameters* Parameters
+	FRDGTextureRef FieldHistory,
+	FInterlacePPComputeShader::FParameters* Parameters
 )
 {
 	TSharedPtr<FInterlacePPViewData> ViewData = StaticCastSharedPtr<FInterlacePPViewData>(GetViewData(View)); 
+	const FIntPoint InputExtent = Input.Texture->Desc.Extent;
+
+	Parameters->Common.InputViewMin = Input.ViewRect.Min;
+	Parameters->Common.InputViewSize = Input.ViewRect.Size();
+	Parameters->Common.OutputViewMin = Output.ViewRect.Min;
+	Parameters->Common.OutputViewSize = Output.ViewRect.Size();
+	Parameters->Common.OutputTexture = GraphBuilder.CreateUAV(Output.Texture);
 	Parameters->InputTexture = Input.Texture;
 	Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
+	Parameters->InputUVScaleBias = FVector4f(
+		float(Input.ViewRect.Width()) / InputExtent.X,
+		float(Input.ViewRect.Height()) / InputExtent.Y,
+		float(Input.ViewRect.Min.X) / InputExtent.X,
+		float(Input.ViewRect.Min.Y) / InputExtent.Y);
+	Parameters->FieldHistory = GraphBuilder.CreateUAV(FieldHistory);
 	ViewData->LastFrameTime = ViewInfo.ViewState->LastRenderTime;
-	Parameters->Time = ViewData->LastFrameTime;
-	Parameters->Weight = ViewData->BlendableWeight;
 	Parameters->FrameNumber = ViewData->LastFrameNumber++;
-	Parameters->ResX = ViewInfo.ViewRect.Width();
-	Parameters->ResY = ViewInfo.ViewRect.Height();
-	Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+}
+
+FScreenPassTexture FInterlacePPSceneExtension::AddPixelShaderPasses_RenderThread(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& ViewInfo,
+	const FPostProcessMaterialInputs& InOutInputs,
+	const FScreenPassTexture& SceneColor,
+	FRDGTextureRef FieldHistory
+)
+{
+	TSharedPtr<FInterlacePPViewData> ViewData = StaticCastSharedPtr<FInterlacePPViewData>(GetViewData(ViewInfo));
+
+	FScreenPassRenderTarget Output = InOutInputs.OverrideOutput;
+	if (!Output.IsValid())
+	{
+		Output = FScreenPassRenderTarget::CreateFromInput(GraphBuilder, SceneColor, ERenderTargetLoadAction::ENoAction, TEXT("InterlacePP.Output"));
+	}
+
+	const FIntPoint InputExtent = SceneColor.Texture->Desc.Extent;
+	const FIntPoint OutputSize = Output.ViewRect.Size();
+	const FIntPoint FieldSize(OutputSize.X, (OutputSize.Y + 1) / 2);
+
+	ViewData->LastFrameTime = ViewInfo.ViewState->LastRenderTime;
+	const uint32 FrameNumber = ViewData->LastFrameNumber++;
+
+	auto AllocParameters = [&]()
+	{
+		FInterlacePPPixelShader::FParameters* Parameters = GraphBuilder.AllocParameters<FInterlacePPPixelShader::FParameters>();
+		Parameters->InputTexture = SceneColor.Texture;
+		Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
+		Parameters->InputUVScaleBias = FVector4f(
+			float(SceneColor.ViewRect.Width()) / InputExtent.X,
+			float(SceneColor.ViewRect.Height()) / InputExtent.Y,
+			float(SceneColor.ViewRect.Min.X) / InputExtent.X,
+			float(SceneColor.ViewRect.Min.Y) / InputExtent.Y);
+		Parameters->OutputViewMin = Output.ViewRect.Min;
+		Parameters->OutputViewSize = OutputSize;
+		Parameters->FrameNumber = FrameNumber;
+		return Parameters;
+	};
+
+	const FGlobalShaderMap* ShaderMap = ViewInfo.ShaderMap;
+	TShaderMapRef<FScreenPassVS> VertexShader(ShaderMap);
+	FRHIBlendState* BlendState = FScreenPassPipelineState::FDefaultBlendState::GetRHI();
+	FRDGTextureRef RegionMask = AddRegionMaskPass_RenderThread(GraphBuilder, ViewInfo, Output);
+
+	// The view, reading last frame's field before the second draw replaces it
+	{
+		FInterlacePPPixelShader::FParameters* Parameters = AllocParameters();
+		Parameters->FieldHistory = FieldHistory;
+		Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+
+		FRHIDepthStencilState* DepthStencilState = FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI();
+		if (RegionMask != nullptr)
+		{
+			Parameters->RenderTargets.DepthStencil = MultipassPPRegionMask::GetBinding(RegionMask);
+			DepthStencilState = MultipassPPRegionMask::GetIncludedDepthStencilState();
+		}
+
+		FInterlacePPPixelShader::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FInterlacePPPixelShader::FWriteHistoryDim>(false);
+		TShaderMapRef<FInterlacePPPixelShader> PixelShader(ShaderMap, PermutationVector);
+
+		const FScreenPassTextureViewport Viewport(Output);
+		AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("%s (PS) %dx%d", *PostProcessingPassName, OutputSize.X, OutputSize.Y), ViewInfo, Viewport, Viewport,
+			VertexShader, PixelShader, BlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
+	}
+
+	// The history keeps every pixel of the field, the mask only applies to the view
+	{
+		FInterlacePPPixelShader::FParameters* Parameters = AllocParameters();
+		Parameters->RenderTargets[0] = FRenderTargetBinding(FieldHistory, ERenderTargetLoadAction::ENoAction);
+
+		FInterlacePPPixelShader::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FInterlacePPPixelShader::FWriteHistoryDim>(true);
+		TShaderMapRef<FInterlacePPPixelShader> PixelShader(ShaderMap, PermutationVector);
+
+		const FScreenPassTextureViewport Viewport(FieldHistory, FIntRect(FIntPoint::ZeroValue, FieldSize));
+		AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("%s History (PS) %dx%d field", *PostProcessingPassName, FieldSize.X, FieldSize.Y), ViewInfo, Viewport, Viewport,
+			VertexShader, PixelShader, BlendState, FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI(), Parameters, EScreenPassDrawFlags::None);
+	}
+
+	if (RegionMask != nullptr)
+	{
+		AddMultipassPPRegionMaskFillPass(GraphBuilder, ViewInfo, SceneColor, Output, RegionMask);
+	}
+
+	return CopyToOverrideOutput(GraphBuilder, ViewInfo, InOutInputs, Output);
+}
+
+void FInterlacePPSceneExtension::PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap)
+{
+	FMultipassPPSceneExtension::PrecachePSOs_RenderThread(RHICmdList, ShaderMap);
+	for (int32 GroupShape = 0; GroupShape < FInterlacePPComputeShader::NumGroupShapes; ++GroupShape)
+	{
+		FInterlacePPComputeShader::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FInterlacePPComputeShader::FGroupShapeDim>(GroupShape);
+		MultipassPPPSOPrecache::PrecacheCompute(RHICmdList, TShaderMapRef<FInterlacePPComputeShader>(ShaderMap, PermutationVector));
+	}
+	if (RegionMask_RenderThread.IsEnabled())
+	{
+		MultipassPPPSOPrecache::PrecacheCompute(RHICmdList, TShaderMapRef<FMultipassPPRegionMaskClassifyCS>(ShaderMap));
+	}
+
+	// The fallback's view and history draws
+	if (GMaxRHIFeatureLevel < ERHIFeatureLevel::SM5)
+	{
+		TShaderMapRef<FScreenPassVS> VertexShader(ShaderMap);
+		FRHIBlendState* BlendState = FScreenPassPipelineState::FDefaultBlendState::GetRHI();
+		FRHIDepthStencilState* DepthStencilState = FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI();
+
+		FInterlacePPPixelShader::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FInterlacePPPixelShader::FWriteHistoryDim>(false);
+		TShaderMapRef<FInterlacePPPixelShader> ViewPixelShader(ShaderMap, PermutationVector);
+		const TConstArrayView<EPixelFormat> SceneColorFormats = MultipassPPPSOPrecache::GetSceneColorFormats();
+		MultipassPPPSOPrecache::PrecacheScreenPassForFormats(RHICmdList, VertexShader, ViewPixelShader, BlendState, DepthStencilState, SceneColorFormats);
+		if (RegionMask_RenderThread.IsEnabled())
+		{
+			for (EPixelFormat Format : SceneColorFormats)
+			{
+				MultipassPPPSOPrecache::PrecacheScreenPass(RHICmdList, VertexShader, ViewPixelShader, BlendState, MultipassPPRegionMask::GetIncludedDepthStencilState(), MakeArrayView(&Format, 1), PF_DepthStencil);
+			}
+		}
+
+		TArray<EPixelFormat> HistoryFormats;
+		GetViewDataPixelFormats(HistoryFormats);
+		PermutationVector.Set<FInterlacePPPixelShader::FWriteHistoryDim>(true);
+		MultipassPPPSOPrecache::PrecacheScreenPassForFormats(RHICmdList, VertexShader, TShaderMapRef<FInterlacePPPixelShader>(ShaderMap, PermutationVector), BlendState, DepthStencilState, HistoryFormats);
+	}
+}
+
+uint32 FInterlacePPSceneExtension::GetOutputReuseParameterHash(const FSceneView& View)
+{
+	TSharedPtr<FInterlacePPViewData> ViewData = StaticCastSharedPtr<FInterlacePPViewData>(GetViewData(View));
+	return ViewData != nullptr ? ::GetTypeHash(ViewData->BlendableWeight) : 0;
 }
 
 TSharedPtr<IMultipassPPViewData> FInterlacePPSceneExtension::ConstructViewData(const FSceneView& InView)
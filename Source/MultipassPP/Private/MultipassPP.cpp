@@ -2,47 +2,55 @@
 
 #include "MultipassPP.h"
 
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPPMemoryBudget.h"
+#include "MultipassPPAutoTune.h"
 #include "InterlacePPSceneExtension.h"
 #include "AccumulationMotionBlurSceneExtension.h"
+#include "AdaptiveSharpenSceneExtension.h"
 #include "Interfaces/IPluginManager.h"
 #include "Misc/Paths.h"
 #include "ShaderCore.h"
 
 #define LOCTEXT_NAMESPACE "FMultipassPPModule"
 
+DEFINE_LOG_CATEGORY(LogMultipassPP);
+
 void FMultipassPPModule::StartupModule()
 {
 	FString PluginShaderDir = FPaths::Combine(IPluginManager::Get().FindPlugin(TEXT("MultipassPP"))->GetBaseDir(), TEXT("Shaders"));
 	AddShaderSourceDirectoryMapping(TEXT("/MultipassPP"), PluginShaderDir);
 
-	FCoreDelegates::OnPostEngineInit.AddLambda([this]()
+	// Effects register themselves with the registry on static init. Their extensions are only created once they're used
+	PostEngineInitHandle = FCoreDelegates::OnPostEngineInit.AddLambda([]()
 	{	
-		InterlaceSceneExtension = FSceneViewExtensions::NewExtension<FInterlacePPSceneExtension>();
-		MotionBlurSceneExtension = FSceneViewExtensions::NewExtension<FAccumulationMotionBlurSceneExtension>();
-		SharpenSceneExtension = FSceneViewExtensions::NewExtension<FAdaptiveSharpenSceneExtension>();
+		FMultipassPPEffectRegistry::Get().Initialize();
+		FMultipassPPMemoryBudget::Get().Initialize();
+		FMultipassPPAutoTuner::Get().Initialize();
 	});
 }
 
 void FMultipassPPModule::ShutdownModule()
 {
-	MotionBlurSceneExtension.Reset();
-	InterlaceSceneExtension.Reset();
-	SharpenSceneExtension.Reset();
+	FCoreDelegates::OnPostEngineInit.Remove(PostEngineInitHandle);
+	FMultipassPPAutoTuner::Get().Shutdown();
+	FMultipassPPMemoryBudget::Get().Shutdown();
+	FMultipassPPEffectRegistry::Get().Shutdown();
 }
 
 TSharedPtr<FInterlacePPSceneExtension> FMultipassPPModule::GetInterlaceSceneExtension()
 {
-	return InterlaceSceneExtension;
+	return FMultipassPPEffectRegistry::Get().FindEffect<FInterlacePPSceneExtension>();
 }
 
 TSharedPtr<FAccumulationMotionBlurSceneExtension> FMultipassPPModule::GetAccumulationMotionBlurSceneExtension()
 {
-	return MotionBlurSceneExtension;
+	return FMultipassPPEffectRegistry::Get().FindEffect<FAccumulationMotionBlurSceneExtension>();
 }
 
 TSharedPtr<class FAdaptiveSharpenSceneExtension> FMultipassPPModule::GetSharpenSceneExtension()
 {
-	return SharpenSceneExtension;
+	return FMultipassPPEffectRegistry::Get().FindEffect<FAdaptiveSharpenSceneExtension>();
 }
 
 #undef LOCTEXT_NAMESPACE
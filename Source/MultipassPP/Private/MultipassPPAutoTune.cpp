@@ -0,0 +1,386 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPAutoTune.h"
+
+#include "MultipassPP.h"
+#include "RenderGraphBuilder.h"
+#include "RenderingThread.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/Paths.h"
+#include "Async/Async.h"
+
+static TAutoConsoleVariable<int32> CVarMultipassPPAutoTuneOnFirstUse(
+	TEXT("r.MultipassPP.AutoTune.OnFirstUse"),
+	0,
+	TEXT("Tunes every tunable the first time it runs at a resolution bucket there's no saved result for on this GPU.\n")
+	TEXT("The frames cycle through the candidates while it's tuning, which can cost a little for a second or so"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarMultipassPPAutoTuneFramesPerCandidate(
+	TEXT("r.MultipassPP.AutoTune.FramesPerCandidate"),
+	16,
+	TEXT("Timed frames per candidate when tuning. The median of them is compared"),
+	ECVF_RenderThreadSafe);
+
+static FAutoConsoleCommand GMultipassPPAutoTuneCmd(
+	TEXT("r.MultipassPP.AutoTune"),
+	TEXT("Benchmarks the candidates of the named tunables, or of all of them, on the next frames and saves the fastest per GPU and resolution bucket.\n")
+	TEXT("Usage: r.MultipassPP.AutoTune [TunableName...]\n")
+	TEXT("       r.MultipassPP.AutoTune reset"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() == 1 && Args[0] == TEXT("reset"))
+		{
+			FMultipassPPAutoTuner::Get().ResetResults();
+			return;
+		}
+
+		TArray<FName> Names;
+		for (const FString& Arg : Args)
+		{
+			Names.Add(*Arg);
+		}
+		FMultipassPPAutoTuner::Get().StartTuning(Names, CVarMultipassPPAutoTuneFramesPerCandidate.GetValueOnGameThread());
+	}));
+
+FMultipassPPAutoTuner& FMultipassPPAutoTuner::Get()
+{
+	static FMultipassPPAutoTuner Tuner;
+	return Tuner;
+}
+
+void FMultipassPPAutoTuner::RegisterTunable(FMultipassPPTunableDesc&& Desc)
+{
+	check(!Tunables.Contains(Desc.Name) && Desc.Candidates.IsValidIndex(Desc.DefaultCandidate));
+
+	FTunableState& State = Tunables.Add(Desc.Name);
+	State.Desc = MoveTemp(Desc);
+}
+
+FString FMultipassPPAutoTuner::GetConfigFilename() const
+{
+	return FPaths::ProjectSavedDir() / TEXT("Config") / TEXT("MultipassPPAutoTune.ini");
+}
+
+FString FMultipassPPAutoTuner::GetAdapterSection() const
+{
+	// The driver changes what's fastest as much as the GPU does
+	return FString::Printf(TEXT("%s %s"), *GRHIAdapterName, *GRHIAdapterUserDriverVersion);
+}
+
+FString FMultipassPPAutoTuner::GetResolutionBucket(FIntPoint ViewSize)
+{
+	static const TPair<int32, const TCHAR*> Buckets[] =
+	{
+		{ 1280 * 720, TEXT("720p") },
+		{ 1920 * 1080, TEXT("1080p") },
+		{ 2560 * 1440, TEXT("1440p") },
+		{ 3840 * 2160, TEXT("2160p") },
+	};
+
+	const int32 NumPixels = ViewSize.X * ViewSize.Y;
+	for (const TPair<int32, const TCHAR*>& Bucket : Buckets)
+	{
+		if (NumPixels <= Bucket.Key)
+		{
+			return Bucket.Value;
+		}
+	}
+	return TEXT("4320p");
+}
+
+void FMultipassPPAutoTuner::Initialize()
+{
+	check(IsInGameThread());
+
+	FConfigFile Config;
+	Config.Read(GetConfigFilename());
+
+	const FString Section = GetAdapterSection();
+	TMap<FName, TMap<FString, int32>> Loaded;
+	for (TPair<FName, FTunableState>& It : Tunables)
+	{
+		const FMultipassPPTunableDesc& Desc = It.Value.Desc;
+		for (const TCHAR* Bucket : { TEXT("720p"), TEXT("1080p"), TEXT("1440p"), TEXT("2160p"), TEXT("4320p") })
+		{
+			FString Candidate;
+			if (Config.GetString(*Section, *FString::Printf(TEXT("%s.%s"), *Desc.Name.ToString(), Bucket), Candidate))
+			{
+				// Results for candidates that no longer exist are ignored
+				const int32 Index = Desc.Candidates.IndexOfByKey(Candidate);
+				if (Index != INDEX_NONE)
+				{
+					Loaded.FindOrAdd(It.Key).Add(Bucket, Index);
+				}
+			}
+		}
+	}
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPLoadAutoTuneResults)(
+		[this, Loaded = MoveTemp(Loaded)](FRHICommandListImmediate& RHICmdList)
+		{
+			for (const TPair<FName, TMap<FString, int32>>& It : Loaded)
+			{
+				if (FTunableState* State = Tunables.Find(It.Key))
+				{
+					State->Winners = It.Value;
+				}
+			}
+		});
+}
+
+void FMultipassPPAutoTuner::Shutdown()
+{
+	ENQUEUE_RENDER_COMMAND(MultipassPPShutdownAutoTune)(
+		[this](FRHICommandListImmediate& RHICmdList)
+		{
+			for (TPair<FName, FTunableState>& It : Tunables)
+			{
+				It.Value.Pending.Reset();
+				It.Value.bTuning = false;
+			}
+			QueryPool.SafeRelease();
+		});
+}
+
+void FMultipassPPAutoTuner::StartTuning(const TArray<FName>& Names, int32 FramesPerCandidate)
+{
+	check(IsInGameThread());
+
+	for (const FName& Name : Names)
+	{
+		UE_CLOG(!Tunables.Contains(Name), LogMultipassPP, Warning, TEXT("MultipassPP auto tune: there's no tunable named %s"), *Name.ToString());
+	}
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPStartAutoTune)(
+		[this, Names, FramesPerCandidate](FRHICommandListImmediate& RHICmdList)
+		{
+			for (TPair<FName, FTunableState>& It : Tunables)
+			{
+				if (Names.Num() == 0 || Names.Contains(It.Key))
+				{
+					It.Value.bTuneRequested = true;
+					It.Value.FramesPerCandidate = FMath::Max(FramesPerCandidate, 1);
+				}
+			}
+		});
+}
+
+void FMultipassPPAutoTuner::ResetResults()
+{
+	check(IsInGameThread());
+
+	const FString Filename = GetConfigFilename();
+	FConfigFile Config;
+	Config.Read(Filename);
+	Config.Remove(GetAdapterSection());
+	Config.Dirty = true;
+	Config.Write(Filename);
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPResetAutoTuneResults)(
+		[this](FRHICommandListImmediate& RHICmdList)
+		{
+			for (TPair<FName, FTunableState>& It : Tunables)
+			{
+				It.Value.Winners.Reset();
+			}
+		});
+}
+
+int32 FMultipassPPAutoTuner::BeginUse_RenderThread(FTunableState& State, FIntPoint ViewSize, bool& bOutTimed)
+{
+	bOutTimed = false;
+
+	PollTimings_RenderThread(State);
+
+	const FString Bucket = GetResolutionBucket(ViewSize);
+	const int32 NumCandidates = State.Desc.Candidates.Num();
+
+	if (!State.bTuning)
+	{
+		const int32* Winner = State.Winners.Find(Bucket);
+		const bool bTuneOnFirstUse = Winner == nullptr && CVarMultipassPPAutoTuneOnFirstUse.GetValueOnRenderThread() > 0;
+		if (!State.bTuneRequested && !bTuneOnFirstUse)
+		{
+			return Winner != nullptr ? *Winner : State.Desc.DefaultCandidate;
+		}
+
+		State.bTuneRequested = false;
+		State.bTuning = true;
+		State.TuningBucket = Bucket;
+		State.NumTunedFrames = 0;
+		State.LastTunedFrame = 0;
+		State.Samples.Reset();
+		State.Samples.SetNum(NumCandidates);
+		if (bTuneOnFirstUse)
+		{
+			State.FramesPerCandidate = FMath::Max(CVarMultipassPPAutoTuneFramesPerCandidate.GetValueOnRenderThread(), 1);
+		}
+
+		UE_LOG(LogMultipassPP, Log, TEXT("MultipassPP auto tune: tuning %s at %s, %d candidates"), *State.Desc.Name.ToString(), *Bucket, NumCandidates);
+	}
+
+	// Views of another bucket use what they would have used anyway
+	if (State.TuningBucket != Bucket)
+	{
+		const int32* Winner = State.Winners.Find(Bucket);
+		return Winner != nullptr ? *Winner : State.Desc.DefaultCandidate;
+	}
+
+	// One candidate per frame, round robin, so slow changes in the scene affect every candidate the same
+	if (State.LastTunedFrame != GFrameCounterRenderThread)
+	{
+		State.LastTunedFrame = GFrameCounterRenderThread;
+		State.FrameCandidate = State.NumTunedFrames % NumCandidates;
+		++State.NumTunedFrames;
+	}
+
+	// The first round isn't timed, it's where the candidates' pipelines get created
+	const int32 NumRequestedFrames = NumCandidates * (State.FramesPerCandidate + 1);
+	bOutTimed = State.NumTunedFrames > NumCandidates && State.NumTunedFrames <= NumRequestedFrames;
+	return State.FrameCandidate;
+}
+
+void FMultipassPPAutoTuner::PollTimings_RenderThread(FTunableState& State)
+{
+	// Timings complete in order, so stop at the first one that isn't ready
+	int32 NumDone = 0;
+	for (FPendingTiming& Timing : State.Pending)
+	{
+		uint64 Begin = 0;
+		uint64 End = 0;
+		if (!RHIGetRenderQueryResult(Timing.Begin.GetQuery(), Begin, false) || !RHIGetRenderQueryResult(Timing.End.GetQuery(), End, false))
+		{
+			break;
+		}
+
+		// Microseconds
+		if (State.Samples.IsValidIndex(Timing.Candidate) && End >= Begin)
+		{
+			State.Samples[Timing.Candidate].Add(double(End - Begin) / 1000.0);
+		}
+		++NumDone;
+	}
+	State.Pending.RemoveAt(0, NumDone);
+
+	if (State.bTuning)
+	{
+		bool bEnoughSamples = true;
+		for (const TArray<double>& Samples : State.Samples)
+		{
+			bEnoughSamples &= Samples.Num() >= State.FramesPerCandidate;
+		}
+
+		if (bEnoughSamples)
+		{
+			FinishTuning_RenderThread(State);
+		}
+	}
+}
+
+void FMultipassPPAutoTuner::FinishTuning_RenderThread(FTunableState& State)
+{
+	int32 Winner = State.Desc.DefaultCandidate;
+	double WinnerTime = MAX_dbl;
+
+	for (int32 Candidate = 0; Candidate < State.Samples.Num(); ++Candidate)
+	{
+		TArray<double>& Samples = State.Samples[Candidate];
+		Samples.Sort();
+		const double Median = Samples[Samples.Num() / 2];
+
+		UE_LOG(LogMultipassPP, Log, TEXT("MultipassPP auto tune: %s %s at %s: %.3f ms"), *State.Desc.Name.ToString(), *State.Desc.Candidates[Candidate], *State.TuningBucket, Median);
+
+		if (Median < WinnerTime)
+		{
+			Winner = Candidate;
+			WinnerTime = Median;
+		}
+	}
+
+	UE_LOG(LogMultipassPP, Display, TEXT("MultipassPP auto tune: %s uses %s at %s on this GPU"), *State.Desc.Name.ToString(), *State.Desc.Candidates[Winner], *State.TuningBucket);
+
+	State.Winners.Add(State.TuningBucket, Winner);
+	State.bTuning = false;
+	State.Samples.Reset();
+
+	AsyncTask(ENamedThreads::GameThread, [this, Name = State.Desc.Name, Bucket = State.TuningBucket, Candidate = State.Desc.Candidates[Winner]]()
+	{
+		SaveResult(Name, Bucket, Candidate);
+	});
+}
+
+void FMultipassPPAutoTuner::SaveResult(FName Tunable, const FString& Bucket, const FString& Candidate) const
+{
+	check(IsInGameThread());
+
+	const FString Filename = GetConfigFilename();
+	FConfigFile Config;
+	Config.Read(Filename);
+	Config.SetString(*GetAdapterSection(), *FString::Printf(TEXT("%s.%s"), *Tunable.ToString(), *Bucket), *Candidate);
+	Config.Dirty = true;
+	Config.Write(Filename);
+}
+
+FMultipassPPAutoTuneScope::FMultipassPPAutoTuneScope(FRDGBuilder& InGraphBuilder, FName Tunable, FIntPoint ViewSize)
+	: GraphBuilder(InGraphBuilder)
+{
+	check(IsInRenderingThread());
+
+	FMultipassPPAutoTuner& Tuner = FMultipassPPAutoTuner::Get();
+	State = Tuner.Tunables.Find(Tunable);
+	if (State == nullptr)
+	{
+		return;
+	}
+
+	bool bTimed = false;
+	Candidate = Tuner.BeginUse_RenderThread(*State, ViewSize, bTimed);
+	if (!bTimed)
+	{
+		return;
+	}
+
+	if (!Tuner.QueryPool.IsValid())
+	{
+		Tuner.QueryPool = RHICreateRenderQueryPool(RQT_AbsoluteTime);
+	}
+
+	TimingIndex = State->Pending.Num();
+	FMultipassPPAutoTuner::FPendingTiming& Timing = State->Pending.AddDefaulted_GetRef();
+	Timing.Candidate = Candidate;
+	Timing.Begin = Tuner.QueryPool->AllocateQuery();
+	Timing.End = Tuner.QueryPool->AllocateQuery();
+
+	GraphBuilder.AddPass(RDG_EVENT_NAME("AutoTune Begin"), ERDGPassFlags::None | ERDGPassFlags::NeverCull, [Query = Timing.Begin.GetQuery()](FRHICommandListImmediate& RHICmdList)
+	{
+		RHICmdList.EndRenderQuery(Query);
+	});
+}
+
+FMultipassPPAutoTuneScope::~FMultipassPPAutoTuneScope()
+{
+	if (TimingIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	GraphBuilder.AddPass(RDG_EVENT_NAME("AutoTune End"), ERDGPassFlags::None | ERDGPassFlags::NeverCull, [Query = State->Pending[TimingIndex].End.GetQuery()](FRHICommandListImmediate& RHICmdList)
+	{
+		RHICmdList.EndRenderQuery(Query);
+	});
+}
+
+FMultipassPPTunableRegistration::FMultipassPPTunableRegistration(FName Name, std::initializer_list<const TCHAR*> Candidates, int32 DefaultCandidate)
+{
+	FMultipassPPTunableDesc Desc;
+	Desc.Name = Name;
+	Desc.DefaultCandidate = DefaultCandidate;
+	for (const TCHAR* Candidate : Candidates)
+	{
+		Desc.Candidates.Add(Candidate);
+	}
+
+	FMultipassPPAutoTuner::Get().RegisterTunable(MoveTemp(Desc));
+}
@@ -0,0 +1,300 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPCapture.h"
+
+#include "MultipassPP.h"
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPPSceneExtension.h"
+#include "MultipassPPStats.h"
+#include "RHIGPUReadback.h"
+#include "RenderGraphUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Captured Frames"), STAT_MultipassPP_CapturedFrames, STATGROUP_MultipassPP);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Dropped Capture Frames"), STAT_MultipassPP_DroppedCaptureFrames, STATGROUP_MultipassPP);
+
+static FAutoConsoleCommand GMultipassPPCaptureCmd(
+	TEXT("r.MultipassPP.Capture"),
+	TEXT("Captures an effect's output into a named shared memory ring for an external encoder.\n")
+	TEXT("Usage: r.MultipassPP.Capture <EffectName> <SharedMemoryName> [MaxWidth=3840] [MaxHeight=2160] [NumSlots=4]\n")
+	TEXT("       r.MultipassPP.Capture <EffectName> off"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() < 2)
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("Usage: r.MultipassPP.Capture <EffectName> <SharedMemoryName|off> [MaxWidth] [MaxHeight] [NumSlots]"));
+			return;
+		}
+
+		TSharedPtr<FMultipassPPSceneExtension> Extension = FMultipassPPEffectRegistry::Get().RequestEffect(*Args[0]);
+		if (Extension == nullptr)
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("r.MultipassPP.Capture: %s is not an enabled effect"), *Args[0]);
+			return;
+		}
+
+		if (Args[1] == TEXT("off"))
+		{
+			Extension->SetCaptureTap(nullptr);
+			return;
+		}
+
+		const int32 MaxWidth = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 3840;
+		const int32 MaxHeight = Args.Num() > 3 ? FCString::Atoi(*Args[3]) : 2160;
+		const int32 NumSlots = Args.Num() > 4 ? FCString::Atoi(*Args[4]) : 4;
+
+		// Room for 8 bytes per pixel, which covers every scene color format
+		TSharedPtr<FMultipassPPCaptureTap, ESPMode::ThreadSafe> Tap = MakeShared<FMultipassPPCaptureTap, ESPMode::ThreadSafe>();
+		if (Tap->OpenSharedMemory(Args[1], NumSlots, SIZE_T(FMath::Max(MaxWidth, 1)) * FMath::Max(MaxHeight, 1) * 8))
+		{
+			Extension->SetCaptureTap(Tap);
+		}
+	}));
+
+// Taps that captured at least once. They're polled at the end of every frame, so the frames still in flight are delivered once
+// the effect stops running or the tap is taken off it. Render thread only
+static TArray<TWeakPtr<FMultipassPPCaptureTap, ESPMode::ThreadSafe>> GCaptureTapsToPoll;
+static FDelegateHandle GCaptureTapsEndFrameHandle;
+
+static void PollCaptureTaps()
+{
+	for (int32 Index = GCaptureTapsToPoll.Num() - 1; Index >= 0; --Index)
+	{
+		if (TSharedPtr<FMultipassPPCaptureTap, ESPMode::ThreadSafe> Tap = GCaptureTapsToPoll[Index].Pin())
+		{
+			Tap->PollReadbacks();
+		}
+		else
+		{
+			GCaptureTapsToPoll.RemoveAtSwap(Index);
+		}
+	}
+}
+
+FMultipassPPCaptureTap::FMultipassPPCaptureTap(int32 InNumReadbacks)
+{
+	Readbacks.SetNum(FMath::Max(InNumReadbacks, 2));
+	for (int32 Index = 0; Index < Readbacks.Num(); ++Index)
+	{
+		Readbacks[Index].Readback = MakeUnique<FRHIGPUTextureReadback>(*FString::Printf(TEXT("MultipassPP.Capture%d"), Index));
+	}
+}
+
+FMultipassPPCaptureTap::FMultipassPPCaptureTap(FMultipassPPCaptureTap&& Other)
+	: Readbacks(MoveTemp(Other.Readbacks))
+	, NextWrite(Other.NextWrite)
+	, NextRead(Other.NextRead)
+	, Callback(MoveTemp(Other.Callback))
+	, SharedMemory(Other.SharedMemory)
+	, SharedHeader(Other.SharedHeader)
+	, NumCapturedFrames(Other.NumCapturedFrames)
+	, NumDroppedFrames(Other.NumDroppedFrames)
+{
+	Other.SharedMemory = nullptr;
+	Other.SharedHeader = nullptr;
+}
+
+FMultipassPPCaptureTap::~FMultipassPPCaptureTap()
+{
+	if (IsInRenderingThread())
+	{
+		DrainReadbacks();
+	}
+	else if (Readbacks.ContainsByPredicate([](const FReadback& Slot) { return Slot.bInFlight; }))
+	{
+		// The readbacks belong to the render thread, it delivers them and closes the shared memory after
+		FMultipassPPCaptureTap* Remainder = new FMultipassPPCaptureTap(MoveTemp(*this));
+		ENQUEUE_RENDER_COMMAND(MultipassPPDrainCaptureTap)(
+		[Remainder](FRHICommandListImmediate& RHICmdList)
+		{
+			delete Remainder;
+		});
+	}
+
+	CloseSharedMemory();
+}
+
+void FMultipassPPCaptureTap::DrainReadbacks()
+{
+	check(IsInRenderingThread());
+
+	if (!Readbacks.ContainsByPredicate([](const FReadback& Slot) { return Slot.bInFlight; }))
+	{
+		return;
+	}
+
+	// Only once, when the tap goes away, so waiting for the GPU is fine
+	FRHICommandListImmediate& RHICmdList = FRHICommandListExecutor::GetImmediateCommandList();
+	RHICmdList.SubmitCommandsAndFlushGPU();
+	RHICmdList.BlockUntilGPUIdle();
+
+	PollReadbacks();
+}
+
+bool FMultipassPPCaptureTap::OpenSharedMemory(const FString& Name, int32 NumSlots, SIZE_T MaxFrameBytes)
+{
+	CloseSharedMemory();
+
+	NumSlots = FMath::Max(NumSlots, 1);
+	const SIZE_T SlotSize = Align(sizeof(FMultipassPPCaptureSlotHeader) + MaxFrameBytes, 64);
+	const SIZE_T TotalSize = Align(sizeof(FMultipassPPCaptureSharedHeader), 64) + SlotSize * NumSlots;
+
+	if (SlotSize > MAX_uint32)
+	{
+		UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP capture: %llu bytes per frame is too large for a shared memory slot"), (uint64)MaxFrameBytes);
+		return false;
+	}
+
+	SharedMemory = FPlatformMemory::MapNamedSharedMemoryRegion(Name, true, FPlatformMemory::ESharedMemoryAccess::Read | FPlatformMemory::ESharedMemoryAccess::Write, TotalSize);
+	if (SharedMemory == nullptr)
+	{
+		UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP capture: could not map shared memory region %s (%llu bytes)"), *Name, (uint64)TotalSize);
+		return false;
+	}
+
+	SharedHeader = static_cast<FMultipassPPCaptureSharedHeader*>(SharedMemory->GetAddress());
+	FMemory::Memzero(SharedHeader, sizeof(FMultipassPPCaptureSharedHeader));
+	SharedHeader->Magic = FMultipassPPCaptureSharedHeader::ExpectedMagic;
+	SharedHeader->Version = FMultipassPPCaptureSharedHeader::ExpectedVersion;
+	SharedHeader->NumSlots = NumSlots;
+	SharedHeader->SlotSize = uint32(SlotSize);
+
+	UE_LOG(LogMultipassPP, Log, TEXT("MultipassPP capture: writing frames to shared memory region %s, %d slots of %u bytes"), *Name, NumSlots, SharedHeader->SlotSize);
+	return true;
+}
+
+void FMultipassPPCaptureTap::CloseSharedMemory()
+{
+	if (SharedMemory != nullptr)
+	{
+		FPlatformMemory::UnmapNamedSharedMemoryRegion(SharedMemory);
+		SharedMemory = nullptr;
+		SharedHeader = nullptr;
+	}
+}
+
+void FMultipassPPCaptureTap::AddCapturePass(FRDGBuilder& GraphBuilder, const FScreenPassTexture& Texture, uint32 ViewKey)
+{
+	check(IsInRenderingThread());
+
+	if (!bPolledAtEndOfFrame)
+	{
+		bPolledAtEndOfFrame = true;
+		if (!GCaptureTapsEndFrameHandle.IsValid())
+		{
+			GCaptureTapsEndFrameHandle = FCoreDelegates::OnEndFrameRT.AddStatic(&PollCaptureTaps);
+		}
+		GCaptureTapsToPoll.Add(AsShared());
+	}
+
+	PollReadbacks();
+
+	if (!Texture.IsValid())
+	{
+		return;
+	}
+
+	FReadback& Slot = Readbacks[NextWrite];
+	if (Slot.bInFlight)
+	{
+		// The GPU hasn't caught up with the ring yet
+		++NumDroppedFrames;
+		INC_DWORD_STAT(STAT_MultipassPP_DroppedCaptureFrames);
+		return;
+	}
+
+	Slot.FrameNumber = GFrameCounterRenderThread;
+	Slot.ViewKey = ViewKey;
+	Slot.Size = Texture.ViewRect.Size();
+	Slot.Format = Texture.Texture->Desc.Format;
+	Slot.bInFlight = true;
+
+	AddEnqueueCopyPass(GraphBuilder, Slot.Readback.Get(), Texture.Texture, FResolveRect(Texture.ViewRect));
+
+	NextWrite = (NextWrite + 1) % Readbacks.Num();
+}
+
+void FMultipassPPCaptureTap::PollReadbacks()
+{
+	check(IsInRenderingThread());
+
+	// Readbacks complete in order, so stop at the first one that isn't ready
+	while (Readbacks[NextRead].bInFlight && Readbacks[NextRead].Readback->IsReady())
+	{
+		FReadback& Slot = Readbacks[NextRead];
+
+		int32 RowPitchInPixels = 0;
+		const uint8* Data = static_cast<const uint8*>(Slot.Readback->Lock(RowPitchInPixels));
+		if (Data != nullptr)
+		{
+			FMultipassPPCapturedFrame Frame;
+			Frame.FrameNumber = Slot.FrameNumber;
+			Frame.ViewKey = Slot.ViewKey;
+			Frame.Size = Slot.Size;
+			Frame.Format = Slot.Format;
+			Frame.RowPitchInBytes = RowPitchInPixels * GPixelFormats[Slot.Format].BlockBytes;
+			Frame.Data = Data;
+
+			Deliver(Frame);
+		}
+		Slot.Readback->Unlock();
+
+		Slot.bInFlight = false;
+		NextRead = (NextRead + 1) % Readbacks.Num();
+	}
+}
+
+void FMultipassPPCaptureTap::Deliver(const FMultipassPPCapturedFrame& Frame)
+{
+	++NumCapturedFrames;
+	INC_DWORD_STAT(STAT_MultipassPP_CapturedFrames);
+
+	Callback.ExecuteIfBound(Frame);
+
+	if (SharedHeader != nullptr)
+	{
+		WriteToSharedMemory(Frame);
+	}
+}
+
+void FMultipassPPCaptureTap::WriteToSharedMemory(const FMultipassPPCapturedFrame& Frame)
+{
+	const uint32 RowBytes = Frame.Size.X * GPixelFormats[Frame.Format].BlockBytes;
+	const SIZE_T FrameBytes = SIZE_T(RowBytes) * Frame.Size.Y;
+
+	const uint64 WriteCount = SharedHeader->WriteCount;
+	const bool bConsumerBehind = WriteCount - SharedHeader->ReadCount >= SharedHeader->NumSlots;
+	const bool bTooLarge = sizeof(FMultipassPPCaptureSlotHeader) + FrameBytes > SharedHeader->SlotSize;
+
+	if (bConsumerBehind || bTooLarge)
+	{
+		UE_CLOG(bTooLarge && SharedHeader->DroppedFrames == 0, LogMultipassPP, Warning, TEXT("MultipassPP capture: %dx%d frames don't fit in the shared memory slots"), Frame.Size.X, Frame.Size.Y);
+
+		SharedHeader->DroppedFrames = SharedHeader->DroppedFrames + 1;
+		++NumDroppedFrames;
+		INC_DWORD_STAT(STAT_MultipassPP_DroppedCaptureFrames);
+		return;
+	}
+
+	uint8* SlotBase = static_cast<uint8*>(SharedMemory->GetAddress()) + Align(sizeof(FMultipassPPCaptureSharedHeader), 64) + SIZE_T(WriteCount % SharedHeader->NumSlots) * SharedHeader->SlotSize;
+
+	FMultipassPPCaptureSlotHeader* SlotHeader = reinterpret_cast<FMultipassPPCaptureSlotHeader*>(SlotBase);
+	SlotHeader->FrameNumber = Frame.FrameNumber;
+	SlotHeader->Width = Frame.Size.X;
+	SlotHeader->Height = Frame.Size.Y;
+	SlotHeader->RowPitchInBytes = RowBytes;
+	SlotHeader->PixelFormat = Frame.Format;
+	SlotHeader->ViewKey = Frame.ViewKey;
+
+	// Tightly packed rows, the staging texture's pitch is usually padded
+	uint8* Pixels = SlotBase + sizeof(FMultipassPPCaptureSlotHeader);
+	for (int32 Row = 0; Row < Frame.Size.Y; ++Row)
+	{
+		FMemory::Memcpy(Pixels + SIZE_T(Row) * RowBytes, Frame.Data + SIZE_T(Row) * Frame.RowPitchInBytes, RowBytes);
+	}
+
+	// The consumer may only see the new WriteCount after the slot is written
+	FPlatformMisc::MemoryBarrier();
+	SharedHeader->WriteCount = WriteCount + 1;
+}
@@ -0,0 +1,86 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPDownsample.h"
+
+#include "RenderGraphUtils.h"
+#include "ScenePrivate.h"
+
+IMPLEMENT_GLOBAL_SHADER(FMultipassPPDownsampleCS, "/MultipassPP/Private/MultipassPPDownsample.usf", "MainCS", SF_Compute);
+
+bool FMultipassPPDownsampleCS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+}
+
+void FMultipassPPDownsampleCS::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), 256);
+	OutEnvironment.SetDefine(TEXT("TILE_SIZE"), TileSize);
+	OutEnvironment.SetDefine(TEXT("MAX_MIPS"), MaxMips);
+}
+
+FRDGTextureRef AddMultipassPPDownsamplePass(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	const FScreenPassTexture& Input,
+	EMultipassPPDownsampleReduction Reduction,
+	int32 NumMips,
+	EPixelFormat OutputFormat)
+{
+	check(Input.IsValid());
+
+	const FIntPoint InputSize = Input.ViewRect.Size();
+	check(InputSize.X > 0 && InputSize.Y > 0);
+
+	const int32 FullChainMips = FMath::FloorLog2(FMath::Max(InputSize.X, InputSize.Y)) + 1;
+	NumMips = NumMips > 0 ? FMath::Min(NumMips, FullChainMips) : FullChainMips;
+	NumMips = FMath::Min(NumMips, FMultipassPPDownsampleCS::MaxMips);
+
+	// The last work group only reduces one tile of mip 6, so mip 6 has to fit in a tile to go any further
+	const int32 Mip6Size = FMath::Max(InputSize.X, InputSize.Y) >> 6;
+	if (Mip6Size > FMultipassPPDownsampleCS::TileSize)
+	{
+		NumMips = FMath::Min(NumMips, 7);
+	}
+
+	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(
+		InputSize,
+		OutputFormat,
+		FClearValueBinding::None,
+		TexCreate_ShaderResource | TexCreate_UAV,
+		NumMips);
+	FRDGTextureRef Output = GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.DownsamplePyramid"));
+
+	FRDGBufferRef Counter = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), 1), TEXT("MultipassPP.DownsampleCounter"));
+	FRDGBufferUAVRef CounterUAV = GraphBuilder.CreateUAV(Counter, PF_R32_UINT);
+	AddClearUAVPass(GraphBuilder, CounterUAV, 0u);
+
+	const FIntPoint GroupCount = FIntPoint::DivideAndRoundUp(InputSize, FMultipassPPDownsampleCS::TileSize);
+
+	FMultipassPPDownsampleCS::FParameters* Parameters = GraphBuilder.AllocParameters<FMultipassPPDownsampleCS::FParameters>();
+	Parameters->InputTexture = Input.Texture;
+	Parameters->InputViewMin = Input.ViewRect.Min;
+	Parameters->InputViewSize = InputSize;
+	Parameters->NumMips = NumMips;
+	Parameters->NumWorkGroups = GroupCount.X * GroupCount.Y;
+	Parameters->AtomicCounter = CounterUAV;
+	for (int32 MipIndex = 0; MipIndex < FMultipassPPDownsampleCS::MaxMips; ++MipIndex)
+	{
+		// Every slot has to be bound. Slots past the end of the chain are never written to
+		Parameters->OutputMips[MipIndex] = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Output, FMath::Min(MipIndex, NumMips - 1)));
+	}
+
+	FMultipassPPDownsampleCS::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FMultipassPPDownsampleCS::FReductionDim>((int32)Reduction);
+	TShaderMapRef<FMultipassPPDownsampleCS> ComputeShader(View.ShaderMap, PermutationVector);
+
+	FComputeShaderUtils::AddPass(
+		GraphBuilder,
+		RDG_EVENT_NAME("MultipassPP Downsample %dx%d (%d mips)", InputSize.X, InputSize.Y, NumMips),
+		ComputeShader,
+		Parameters,
+		FIntVector(GroupCount.X, GroupCount.Y, 1));
+
+	return Output;
+}
@@ -0,0 +1,281 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPEffectRegistry.h"
+
+#include "MultipassPPSceneExtension.h"
+#include "HAL/IConsoleManager.h"
+#include "GlobalShader.h"
+#include "RenderingThread.h"
+
+static TAutoConsoleVariable<int32> CVarMultipassPPPrecachePSOsOnCreate(
+	TEXT("r.MultipassPP.PrecachePSOsOnCreate"),
+	1,
+	TEXT("Precaches an effect's pipeline states as soon as its scene extension is created, instead of on its first draw"),
+	ECVF_Default);
+
+static void PrecacheEffectPSOs(TSharedPtr<FMultipassPPSceneExtension> Extension)
+{
+	ENQUEUE_RENDER_COMMAND(MultipassPPPrecachePSOs)(
+		[Extension = MoveTemp(Extension)](FRHICommandListImmediate& RHICmdList)
+		{
+			Extension->PrecachePSOs_RenderThread(RHICmdList, GetGlobalShaderMap(GMaxRHIFeatureLevel));
+		});
+}
+
+FMultipassPPEffectRegistry& FMultipassPPEffectRegistry::Get()
+{
+	static FMultipassPPEffectRegistry Registry;
+	return Registry;
+}
+
+void FMultipassPPEffectRegistry::RegisterEffect(FMultipassPPEffectDesc&& Desc)
+{
+	check(!Effects.Contains(Desc.Name));
+
+	FEffectEntry& Entry = Effects.Add(Desc.Name);
+
+	const FString ModeCVarName = FString::Printf(TEXT("r.MultipassPP.%s.Mode"), *Desc.Name.ToString());
+	Entry.ModeCVar = IConsoleManager::Get().RegisterConsoleVariable(
+		*ModeCVarName,
+		(int32)EMultipassPPEffectMode::OnDemand,
+		TEXT("0: the effect's shaders are not compiled and the effect is never created\n")
+		TEXT("1: the effect is created the first time one of its cvars or blendables is used (default)\n")
+		TEXT("2: the effect is created on engine init"),
+		ECVF_ReadOnly);
+
+	const FString BudgetPriorityCVarName = FString::Printf(TEXT("r.MultipassPP.%s.BudgetPriority"), *Desc.Name.ToString());
+	Entry.BudgetPriorityCVar = IConsoleManager::Get().RegisterConsoleVariable(
+		*BudgetPriorityCVarName,
+		0,
+		TEXT("When the plugin is over r.MultipassPP.MemoryBudgetMB, effects with the lowest priority are disabled first"),
+		ECVF_Default);
+
+	const FString EffectName = Desc.Name.ToString();
+	Entry.EnabledCVar = IConsoleManager::Get().RegisterConsoleVariable(
+		*FString::Printf(TEXT("r.MultipassPP.%s.Enabled"), *EffectName),
+		1,
+		TEXT("0 turns the effect off on this scalability level or device profile"),
+		ECVF_Scalability);
+
+	Entry.ScreenPercentageCVar = IConsoleManager::Get().RegisterConsoleVariable(
+		*FString::Printf(TEXT("r.MultipassPP.%s.ScreenPercentage"), *EffectName),
+		100.f,
+		TEXT("Percentage of the view resolution the effect runs at, for effects that support it. The result is upsampled"),
+		ECVF_Scalability);
+
+	Entry.QualityCVar = IConsoleManager::Get().RegisterConsoleVariable(
+		*FString::Printf(TEXT("r.MultipassPP.%s.Quality"), *EffectName),
+		-1,
+		TEXT("Effect specific quality tier, 0 being the cheapest. -1 uses the effect's own settings (default)"),
+		ECVF_Scalability);
+
+	Entry.PrecisionCVar = IConsoleManager::Get().RegisterConsoleVariable(
+		*FString::Printf(TEXT("r.MultipassPP.%s.Precision"), *EffectName),
+		-1,
+		TEXT("-1: the effect's default target formats (default)\n")
+		TEXT(" 0: full precision targets, even when the plugin is over r.MultipassPP.MemoryBudgetMB\n")
+		TEXT(" 1: compact targets, same as when the plugin is over r.MultipassPP.MemoryBudgetMB"),
+		ECVF_Scalability);
+
+	Entry.AutoSkipThresholdCVar = IConsoleManager::Get().RegisterConsoleVariable(
+		*FString::Printf(TEXT("r.MultipassPP.%s.AutoSkipThreshold"), *EffectName),
+		0.f,
+		TEXT("Measured impact under which r.MultipassPP.AutoSkip skips or downgrades the effect, in the unit of the statistic the effect measures.\n")
+		TEXT("0 never does (default)"),
+		ECVF_Scalability);
+
+	Entry.Desc = MoveTemp(Desc);
+}
+
+void FMultipassPPEffectRegistry::Initialize()
+{
+	check(IsInGameThread());
+
+	if (bInitialized)
+	{
+		return;
+	}
+	bInitialized = true;
+
+	// The sink runs once after any batch of cvar changes, which covers scalability groups, device profiles and the console
+	ScalabilitySinkHandle = IConsoleManager::Get().RegisterConsoleVariableSink_Handle(FConsoleCommandDelegate::CreateRaw(this, &FMultipassPPEffectRegistry::ApplyScalabilitySettings));
+
+	for (TPair<FName, FEffectEntry>& It : Effects)
+	{
+		FEffectEntry& Entry = It.Value;
+		const EMultipassPPEffectMode Mode = GetEffectMode(It.Key);
+		if (Mode == EMultipassPPEffectMode::Disabled)
+		{
+			continue;
+		}
+
+		bool bActivatedByConfig = false;
+		for (const FString& CVarName : Entry.Desc.ActivationCVars)
+		{
+			IConsoleVariable* CVar = IConsoleManager::Get().FindConsoleVariable(*CVarName);
+			if (CVar == nullptr)
+			{
+				continue;
+			}
+
+			bActivatedByConfig |= CVar->GetFloat() > 0.f;
+
+			FDelegateHandle Handle = CVar->OnChangedDelegate().AddRaw(this, &FMultipassPPEffectRegistry::OnActivationCVarChanged, It.Key);
+			Entry.ActivationHandles.Emplace(CVar, Handle);
+		}
+
+		if (Mode == EMultipassPPEffectMode::AlwaysCreated || bActivatedByConfig)
+		{
+			RequestEffect(It.Key);
+		}
+	}
+}
+
+void FMultipassPPEffectRegistry::Shutdown()
+{
+	if (ScalabilitySinkHandle.IsValid())
+	{
+		IConsoleManager::Get().UnregisterConsoleVariableSink_Handle(ScalabilitySinkHandle);
+		ScalabilitySinkHandle = FConsoleVariableSinkHandle();
+	}
+
+	for (TPair<FName, FEffectEntry>& It : Effects)
+	{
+		for (TPair<IConsoleVariable*, FDelegateHandle>& Handle : It.Value.ActivationHandles)
+		{
+			Handle.Key->OnChangedDelegate().Remove(Handle.Value);
+		}
+		It.Value.ActivationHandles.Reset();
+		It.Value.Extension.Reset();
+	}
+
+	bInitialized = false;
+}
+
+TSharedPtr<FMultipassPPSceneExtension> FMultipassPPEffectRegistry::RequestEffect(FName EffectName)
+{
+	check(IsInGameThread());
+
+	FEffectEntry* Entry = Effects.Find(EffectName);
+	if (Entry == nullptr || !bInitialized)
+	{
+		return nullptr;
+	}
+
+	if (!Entry->Extension.IsValid() && GetEffectMode(EffectName) != EMultipassPPEffectMode::Disabled)
+	{
+		Entry->Extension = Entry->Desc.CreateExtension();
+		if (Entry->Extension.IsValid())
+		{
+			Entry->Extension->RegisteredName = EffectName;
+			ApplyScalabilitySettingsToEntry(*Entry);
+
+			if (CVarMultipassPPPrecachePSOsOnCreate.GetValueOnGameThread() > 0)
+			{
+				PrecacheEffectPSOs(Entry->Extension);
+			}
+		}
+	}
+
+	return Entry->Extension;
+}
+
+TSharedPtr<FMultipassPPSceneExtension> FMultipassPPEffectRegistry::FindEffect(FName EffectName) const
+{
+	const FEffectEntry* Entry = Effects.Find(EffectName);
+	return Entry ? Entry->Extension : nullptr;
+}
+
+EMultipassPPEffectMode FMultipassPPEffectRegistry::GetEffectMode(FName EffectName) const
+{
+	const FEffectEntry* Entry = Effects.Find(EffectName);
+	if (Entry == nullptr || Entry->ModeCVar == nullptr)
+	{
+		return EMultipassPPEffectMode::OnDemand;
+	}
+
+	return (EMultipassPPEffectMode)FMath::Clamp(Entry->ModeCVar->GetInt(), 0, 2);
+}
+
+int32 FMultipassPPEffectRegistry::GetBudgetPriority(FName EffectName) const
+{
+	const FEffectEntry* Entry = Effects.Find(EffectName);
+	return Entry && Entry->BudgetPriorityCVar ? Entry->BudgetPriorityCVar->GetInt() : 0;
+}
+
+void FMultipassPPEffectRegistry::ForEachCreatedEffect(TFunctionRef<void(FMultipassPPSceneExtension& Extension)> Func) const
+{
+	for (const TPair<FName, FEffectEntry>& It : Effects)
+	{
+		if (It.Value.Extension.IsValid())
+		{
+			Func(*It.Value.Extension);
+		}
+	}
+}
+
+void FMultipassPPEffectRegistry::PrecachePSOs()
+{
+	check(IsInGameThread());
+
+	for (TPair<FName, FEffectEntry>& It : Effects)
+	{
+		if (It.Value.Extension.IsValid())
+		{
+			PrecacheEffectPSOs(It.Value.Extension);
+		}
+	}
+}
+
+void FMultipassPPEffectRegistry::ApplyScalabilitySettings()
+{
+	check(IsInGameThread());
+
+	for (TPair<FName, FEffectEntry>& It : Effects)
+	{
+		ApplyScalabilitySettingsToEntry(It.Value);
+	}
+}
+
+void FMultipassPPEffectRegistry::ApplyScalabilitySettingsToEntry(FEffectEntry& Entry)
+{
+	if (!Entry.Extension.IsValid())
+	{
+		return;
+	}
+
+	FMultipassPPScalabilitySettings Settings;
+	Settings.bEnabled = Entry.EnabledCVar == nullptr || Entry.EnabledCVar->GetInt() > 0;
+	Settings.ResolutionFraction = Entry.ScreenPercentageCVar ? FMath::Clamp(Entry.ScreenPercentageCVar->GetFloat() / 100.f, 0.25f, 1.f) : 1.f;
+	Settings.Quality = Entry.QualityCVar ? FMath::Max(Entry.QualityCVar->GetInt(), -1) : -1;
+	Settings.Precision = Entry.PrecisionCVar ? FMath::Clamp(Entry.PrecisionCVar->GetInt(), -1, 1) : -1;
+	Settings.AutoSkipThreshold = Entry.AutoSkipThresholdCVar ? FMath::Max(Entry.AutoSkipThresholdCVar->GetFloat(), 0.f) : 0.f;
+
+	Entry.Extension->SetScalabilitySettings(Settings);
+}
+
+bool FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FName EffectName)
+{
+	return Get().GetEffectMode(EffectName) != EMultipassPPEffectMode::Disabled;
+}
+
+void FMultipassPPEffectRegistry::OnActivationCVarChanged(IConsoleVariable* CVar, FName EffectName)
+{
+	if (CVar->GetFloat() > 0.f && IsInGameThread())
+	{
+		RequestEffect(EffectName);
+	}
+}
+
+FMultipassPPEffectRegistration::FMultipassPPEffectRegistration(FName EffectName, TFunction<TSharedPtr<FMultipassPPSceneExtension>()>&& CreateExtension, std::initializer_list<const TCHAR*> ActivationCVars)
+{
+	FMultipassPPEffectDesc Desc;
+	Desc.Name = EffectName;
+	Desc.CreateExtension = MoveTemp(CreateExtension);
+	for (const TCHAR* CVarName : ActivationCVars)
+	{
+		Desc.ActivationCVars.Add(CVarName);
+	}
+
+	FMultipassPPEffectRegistry::Get().RegisterEffect(MoveTemp(Desc));
+}
@@ -0,0 +1,110 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPImageCompare.h"
+
+#include "RHIGPUReadback.h"
+#include "RenderGraphUtils.h"
+
+IMPLEMENT_GLOBAL_SHADER(FMultipassPPImageCompareCS, "/MultipassPP/Private/MultipassPPImageCompare.usf", "CompareCS", SF_Compute);
+
+bool FMultipassPPImageCompareCS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+}
+
+void FMultipassPPImageCompareCS::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), GroupSize);
+}
+
+FMultipassPPImageCompare::FMultipassPPImageCompare(int32 InNumReadbacks)
+{
+	Readbacks.SetNum(FMath::Max(InNumReadbacks, 2));
+	for (int32 Index = 0; Index < Readbacks.Num(); ++Index)
+	{
+		Readbacks[Index].Readback = MakeUnique<FRHIGPUBufferReadback>(*FString::Printf(TEXT("MultipassPP.ImageCompare%d"), Index));
+	}
+}
+
+FMultipassPPImageCompare::~FMultipassPPImageCompare() = default;
+
+void FMultipassPPImageCompare::AddComparePass(FRDGBuilder& GraphBuilder, const FGlobalShaderMap* ShaderMap, const FScreenPassTexture& A, const FScreenPassTexture& B, float Tolerance)
+{
+	check(IsInRenderingThread());
+
+	PollReadbacks();
+
+	FReadback& Slot = Readbacks[NextWrite];
+	if (!A.IsValid() || !B.IsValid() || Slot.bInFlight)
+	{
+		return;
+	}
+
+	const FIntPoint ViewSize = FIntPoint(
+		FMath::Min(A.ViewRect.Width(), B.ViewRect.Width()),
+		FMath::Min(A.ViewRect.Height(), B.ViewRect.Height()));
+	if (ViewSize.X <= 0 || ViewSize.Y <= 0)
+	{
+		return;
+	}
+
+	// [0] is the largest difference as float bits, [1] the number of pixels over the tolerance
+	FRDGBufferRef Result = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), 2), TEXT("MultipassPP.ImageCompare"));
+	FRDGBufferUAVRef ResultUAV = GraphBuilder.CreateUAV(Result, PF_R32_UINT);
+	AddClearUAVPass(GraphBuilder, ResultUAV, 0);
+
+	FMultipassPPImageCompareCS::FParameters* Parameters = GraphBuilder.AllocParameters<FMultipassPPImageCompareCS::FParameters>();
+	Parameters->TextureA = A.Texture;
+	Parameters->TextureB = B.Texture;
+	Parameters->ViewMinA = A.ViewRect.Min;
+	Parameters->ViewMinB = B.ViewRect.Min;
+	Parameters->ViewSize = ViewSize;
+	Parameters->Tolerance = Tolerance;
+	Parameters->ResultUAV = ResultUAV;
+
+	TShaderMapRef<FMultipassPPImageCompareCS> ComputeShader(ShaderMap);
+	FComputeShaderUtils::AddPass(
+		GraphBuilder,
+		RDG_EVENT_NAME("MultipassPP ImageCompare %dx%d", ViewSize.X, ViewSize.Y),
+		ComputeShader,
+		Parameters,
+		FComputeShaderUtils::GetGroupCount(ViewSize, FMultipassPPImageCompareCS::GroupSize));
+
+	Slot.FrameNumber = GFrameCounterRenderThread;
+	Slot.NumPixels = uint32(ViewSize.X) * uint32(ViewSize.Y);
+	Slot.Tolerance = Tolerance;
+	Slot.bInFlight = true;
+
+	AddEnqueueCopyPass(GraphBuilder, Slot.Readback.Get(), Result, 2 * sizeof(uint32));
+
+	NextWrite = (NextWrite + 1) % Readbacks.Num();
+}
+
+void FMultipassPPImageCompare::PollReadbacks()
+{
+	check(IsInRenderingThread());
+
+	// Readbacks complete in order, so stop at the first one that isn't ready
+	while (Readbacks[NextRead].bInFlight && Readbacks[NextRead].Readback->IsReady())
+	{
+		FReadback& Slot = Readbacks[NextRead];
+
+		const uint32* Data = static_cast<const uint32*>(Slot.Readback->Lock(2 * sizeof(uint32)));
+		if (Data != nullptr)
+		{
+			FMultipassPPImageCompareResult Result;
+			Result.FrameNumber = Slot.FrameNumber;
+			Result.MaxDifference = *reinterpret_cast<const float*>(&Data[0]);
+			Result.Tolerance = Slot.Tolerance;
+			Result.NumPixels = Slot.NumPixels;
+			Result.NumPixelsOverTolerance = Data[1];
+
+			Callback.ExecuteIfBound(Result);
+		}
+		Slot.Readback->Unlock();
+
+		Slot.bInFlight = false;
+		NextRead = (NextRead + 1) % Readbacks.Num();
+	}
+}
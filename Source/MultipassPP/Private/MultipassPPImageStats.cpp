@@ -0,0 +1,138 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPImageStats.h"
+
+#include "RHIGPUReadback.h"
+#include "RenderGraphUtils.h"
+
+IMPLEMENT_GLOBAL_SHADER(FMultipassPPImageStatsCS, "/MultipassPP/Private/MultipassPPImageStats.usf", "StatsCS", SF_Compute);
+
+// The sums are accumulated in fixed point, in 64 bits split over two words
+static constexpr int32 ImageStatsFixedPointScale = 256;
+static constexpr int32 ImageStatsResultSize = 8;
+
+bool FMultipassPPImageStatsCS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+}
+
+void FMultipassPPImageStatsCS::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), GroupSize);
+	OutEnvironment.SetDefine(TEXT("HISTORY_SPACING"), HistorySpacing);
+	OutEnvironment.SetDefine(TEXT("FIXED_POINT_SCALE"), ImageStatsFixedPointScale);
+}
+
+FMultipassPPImageStats::FMultipassPPImageStats(int32 InNumReadbacks)
+{
+	Readbacks.SetNum(FMath::Max(InNumReadbacks, 2));
+	for (int32 Index = 0; Index < Readbacks.Num(); ++Index)
+	{
+		Readbacks[Index].Readback = MakeUnique<FRHIGPUBufferReadback>(*FString::Printf(TEXT("MultipassPP.ImageStats%d"), Index));
+	}
+}
+
+FMultipassPPImageStats::~FMultipassPPImageStats() = default;
+
+void FMultipassPPImageStats::AddStatsPass(FRDGBuilder& GraphBuilder, const FGlobalShaderMap* ShaderMap, const FScreenPassTexture& Input, float ActiveThreshold)
+{
+	check(IsInRenderingThread());
+
+	PollReadbacks();
+
+	FReadback& Slot = Readbacks[NextWrite];
+	const FIntPoint ViewSize = Input.ViewRect.Size();
+	if (!Input.IsValid() || Slot.bInFlight || ViewSize.X <= 0 || ViewSize.Y <= 0)
+	{
+		return;
+	}
+
+	// The history only holds every HistorySpacing-th pixel, and starts over when the view is resized
+	const bool bLumaHistoryValid = LumaHistory.IsValid() && LumaHistoryViewSize == ViewSize;
+	FRDGTextureRef LumaHistoryTexture;
+	if (bLumaHistoryValid)
+	{
+		LumaHistoryTexture = GraphBuilder.RegisterExternalTexture(LumaHistory);
+	}
+	else
+	{
+		const FIntPoint HistorySize = FIntPoint::DivideAndRoundUp(ViewSize, FMultipassPPImageStatsCS::HistorySpacing);
+		const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(HistorySize, PF_R32_FLOAT, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+		LumaHistoryTexture = GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.ImageStatsLumaHistory"));
+		LumaHistoryViewSize = ViewSize;
+	}
+
+	// Fixed point sums of the luma, the edge strength and the luma delta as low and high words, then the number of active pixels
+	// and the number of delta samples
+	FRDGBufferRef Result = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), ImageStatsResultSize), TEXT("MultipassPP.ImageStats"));
+	FRDGBufferUAVRef ResultUAV = GraphBuilder.CreateUAV(Result, PF_R32_UINT);
+	AddClearUAVPass(GraphBuilder, ResultUAV, 0);
+
+	FMultipassPPImageStatsCS::FParameters* Parameters = GraphBuilder.AllocParameters<FMultipassPPImageStatsCS::FParameters>();
+	Parameters->InputTexture = Input.Texture;
+	Parameters->ViewMin = Input.ViewRect.Min;
+	Parameters->ViewSize = ViewSize;
+	Parameters->ActiveThreshold = ActiveThreshold;
+	Parameters->bLumaHistoryValid = bLumaHistoryValid;
+	Parameters->LumaHistory = GraphBuilder.CreateUAV(LumaHistoryTexture);
+	Parameters->ResultUAV = ResultUAV;
+
+	TShaderMapRef<FMultipassPPImageStatsCS> ComputeShader(ShaderMap);
+	FComputeShaderUtils::AddPass(
+		GraphBuilder,
+		RDG_EVENT_NAME("MultipassPP ImageStats %dx%d", ViewSize.X, ViewSize.Y),
+		ComputeShader,
+		Parameters,
+		FComputeShaderUtils::GetGroupCount(ViewSize, FMultipassPPImageStatsCS::GroupSize));
+
+	GraphBuilder.QueueTextureExtraction(LumaHistoryTexture, &LumaHistory);
+
+	Slot.FrameNumber = GFrameCounterRenderThread;
+	Slot.NumPixels = uint32(ViewSize.X) * uint32(ViewSize.Y);
+	Slot.bInFlight = true;
+
+	AddEnqueueCopyPass(GraphBuilder, Slot.Readback.Get(), Result, ImageStatsResultSize * sizeof(uint32));
+
+	NextWrite = (NextWrite + 1) % Readbacks.Num();
+}
+
+void FMultipassPPImageStats::PollReadbacks()
+{
+	check(IsInRenderingThread());
+
+	// Readbacks complete in order, so stop at the first one that isn't ready
+	while (Readbacks[NextRead].bInFlight && Readbacks[NextRead].Readback->IsReady())
+	{
+		FReadback& Slot = Readbacks[NextRead];
+
+		const uint32* Data = static_cast<const uint32*>(Slot.Readback->Lock(ImageStatsResultSize * sizeof(uint32)));
+		if (Data != nullptr && Slot.NumPixels > 0)
+		{
+			auto GetMean = [Data](int32 Index, uint32 Count)
+			{
+				const uint64 Sum = uint64(Data[Index]) | (uint64(Data[Index + 1]) << 32);
+				return Count > 0 ? float(double(Sum) / ImageStatsFixedPointScale / Count) : -1.f;
+			};
+
+			FMultipassPPImageStatsResult Result;
+			Result.FrameNumber = Slot.FrameNumber;
+			Result.NumPixels = Slot.NumPixels;
+			Result.MeanLuma = GetMean(0, Slot.NumPixels);
+			Result.MeanEdgeStrength = GetMean(2, Slot.NumPixels);
+			Result.MeanLumaDelta = GetMean(4, Data[7]);
+			Result.ActiveFraction = float(Data[6]) / Slot.NumPixels;
+
+			Callback.ExecuteIfBound(Result);
+		}
+		Slot.Readback->Unlock();
+
+		Slot.bInFlight = false;
+		NextRead = (NextRead + 1) % Readbacks.Num();
+	}
+}
+
+SIZE_T FMultipassPPImageStats::GetGPUMemorySize() const
+{
+	return LumaHistory.IsValid() ? LumaHistory->ComputeMemorySize() : 0;
+}
@@ -0,0 +1,262 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPMemoryBudget.h"
+
+#include "MultipassPP.h"
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPPSceneExtension.h"
+#include "MultipassPPStats.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+
+LLM_DEFINE_TAG(MultipassPP);
+
+DECLARE_MEMORY_STAT_POOL(TEXT("Render Target Memory"), STAT_MultipassPP_RTMemory, STATGROUP_MultipassPP, FPlatformMemory::MCR_GPU);
+DECLARE_MEMORY_STAT_POOL(TEXT("Memory Budget"), STAT_MultipassPP_MemoryBudget, STATGROUP_MultipassPP, FPlatformMemory::MCR_GPU);
+DECLARE_DWORD_COUNTER_STAT(TEXT("View Data"), STAT_MultipassPP_NumViewData, STATGROUP_MultipassPP);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Effects Disabled By Budget"), STAT_MultipassPP_NumDisabledEffects, STATGROUP_MultipassPP);
+
+static TAutoConsoleVariable<int32> CVarMultipassPPMemoryBudgetMB(
+	TEXT("r.MultipassPP.MemoryBudgetMB"),
+	0,
+	TEXT("GPU memory budget in MB for all of the MultipassPP effects' view data. 0 means there is no budget"),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithOutputDevice GMultipassPPDumpMemoryCmd(
+	TEXT("r.MultipassPP.DumpMemory"),
+	TEXT("Prints the GPU memory held by every MultipassPP effect and view"),
+	FConsoleCommandWithOutputDeviceDelegate::CreateLambda([](FOutputDevice& Ar)
+	{
+		FMultipassPPMemoryBudget::Get().DumpMemory(Ar);
+	}));
+
+FMultipassPPMemoryBudget& FMultipassPPMemoryBudget::Get()
+{
+	static FMultipassPPMemoryBudget Budget;
+	return Budget;
+}
+
+void FMultipassPPMemoryBudget::Initialize()
+{
+	EndFrameHandle = FCoreDelegates::OnEndFrame.AddRaw(this, &FMultipassPPMemoryBudget::Update);
+}
+
+void FMultipassPPMemoryBudget::Shutdown()
+{
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	EndFrameHandle.Reset();
+}
+
+SIZE_T FMultipassPPMemoryBudget::GetTotalGPUMemorySize() const
+{
+	SIZE_T TotalSize = 0;
+	FMultipassPPEffectRegistry::Get().ForEachCreatedEffect([&TotalSize](FMultipassPPSceneExtension& Extension)
+	{
+		TotalSize += Extension.GetGPUMemorySize();
+	});
+	return TotalSize;
+}
+
+void FMultipassPPMemoryBudget::Update()
+{
+	check(IsInGameThread());
+
+	SIZE_T TotalSize = GetTotalGPUMemorySize();
+	UpdateStats(TotalSize);
+
+	const int32 BudgetMB = CVarMultipassPPMemoryBudgetMB.GetValueOnGameThread();
+	if (BudgetMB != LastBudgetMB)
+	{
+		LastBudgetMB = BudgetMB;
+		ResetBudgetResponse();
+	}
+
+	if (BudgetMB <= 0)
+	{
+		return;
+	}
+
+	const SIZE_T Budget = SIZE_T(BudgetMB) * 1024 * 1024;
+	if (TotalSize <= Budget)
+	{
+		return;
+	}
+
+	// 1. Evict view data that isn't being rendered anymore
+	while (TotalSize > Budget && EvictLeastRecentlyUsedViewData(TotalSize))
+	{
+	}
+
+	if (TotalSize <= Budget)
+	{
+		return;
+	}
+
+	// 2. Drop to compact formats. The targets are only recreated when their views next render, so give them a frame before moving on
+	if (Stage == EStage::WithinBudget)
+	{
+		UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP is using %.2f MB, over its %d MB budget. Switching to compact render target formats"), TotalSize / (1024.f * 1024.f), BudgetMB);
+
+		FMultipassPPEffectRegistry::Get().ForEachCreatedEffect([](FMultipassPPSceneExtension& Extension)
+		{
+			Extension.SetUseCompactFormats(true);
+		});
+
+		Stage = EStage::CompactFormats;
+		StageStartFrame = GFrameCounter;
+		return;
+	}
+
+	if (GFrameCounter <= StageStartFrame + 1)
+	{
+		return;
+	}
+
+	// 3. Disable effects, one per frame, lowest priority first
+	Stage = EStage::DisablingEffects;
+	DisableLowestPriorityEffect(TotalSize);
+	StageStartFrame = GFrameCounter;
+}
+
+bool FMultipassPPMemoryBudget::EvictLeastRecentlyUsedViewData(SIZE_T& InOutTotalSize)
+{
+	FMultipassPPSceneExtension* OldestExtension = nullptr;
+	uint32 OldestViewKey = 0;
+	uint64 OldestFrame = GFrameCounter;
+
+	FMultipassPPEffectRegistry::Get().ForEachCreatedEffect([&](FMultipassPPSceneExtension& Extension)
+	{
+		for (const TPair<uint32, TSharedPtr<IMultipassPPViewData>>& It : Extension.GetAllViewData())
+		{
+			if (It.Value.IsValid() && It.Value->LastUsedFrame < OldestFrame && It.Value->GetGPUMemorySize() > 0)
+			{
+				OldestExtension = &Extension;
+				OldestViewKey = It.Key;
+				OldestFrame = It.Value->LastUsedFrame;
+			}
+		}
+	});
+
+	if (OldestExtension == nullptr)
+	{
+		return false;
+	}
+
+	const SIZE_T FreedSize = OldestExtension->EvictViewData(OldestViewKey);
+	InOutTotalSize -= FMath::Min(FreedSize, InOutTotalSize);
+	return true;
+}
+
+bool FMultipassPPMemoryBudget::DisableLowestPriorityEffect(SIZE_T& InOutTotalSize)
+{
+	const FMultipassPPEffectRegistry& Registry = FMultipassPPEffectRegistry::Get();
+
+	FMultipassPPSceneExtension* LowestExtension = nullptr;
+	int32 LowestPriority = MAX_int32;
+	SIZE_T LowestSize = 0;
+
+	Registry.ForEachCreatedEffect([&](FMultipassPPSceneExtension& Extension)
+	{
+		if (Extension.IsDisabledByBudget())
+		{
+			return;
+		}
+
+		const int32 Priority = Registry.GetBudgetPriority(Extension.GetRegisteredName());
+		const SIZE_T Size = Extension.GetGPUMemorySize();
+
+		// On a tie, disable the effect that frees the most memory
+		if (Priority < LowestPriority || (Priority == LowestPriority && Size > LowestSize))
+		{
+			LowestExtension = &Extension;
+			LowestPriority = Priority;
+			LowestSize = Size;
+		}
+	});
+
+	if (LowestExtension == nullptr)
+	{
+		return false;
+	}
+
+	UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP is over its %d MB memory budget. Disabling %s"), LastBudgetMB, *LowestExtension->GetRegisteredName().ToString());
+
+	LowestExtension->SetDisabledByBudget(true);
+
+	TArray<uint32> ViewKeys;
+	LowestExtension->GetAllViewData().GetKeys(ViewKeys);
+	for (uint32 ViewKey : ViewKeys)
+	{
+		const SIZE_T FreedSize = LowestExtension->EvictViewData(ViewKey);
+		InOutTotalSize -= FMath::Min(FreedSize, InOutTotalSize);
+	}
+
+	return true;
+}
+
+void FMultipassPPMemoryBudget::ResetBudgetResponse()
+{
+	FMultipassPPEffectRegistry::Get().ForEachCreatedEffect([](FMultipassPPSceneExtension& Extension)
+	{
+		Extension.SetUseCompactFormats(false);
+		Extension.SetDisabledByBudget(false);
+	});
+
+	Stage = EStage::WithinBudget;
+	StageStartFrame = GFrameCounter;
+}
+
+void FMultipassPPMemoryBudget::UpdateStats(SIZE_T TotalSize)
+{
+#if STATS
+	int32 NumViewData = 0;
+	int32 NumDisabledEffects = 0;
+
+	FMultipassPPEffectRegistry::Get().ForEachCreatedEffect([this, &NumViewData, &NumDisabledEffects](FMultipassPPSceneExtension& Extension)
+	{
+		NumViewData += Extension.GetAllViewData().Num();
+		NumDisabledEffects += Extension.IsDisabledByBudget() ? 1 : 0;
+
+		const FName EffectName = Extension.GetRegisteredName();
+		TStatId* StatId = EffectMemoryStats.Find(EffectName);
+		if (StatId == nullptr)
+		{
+			const FName StatName = *FString::Printf(TEXT("%s Render Target Memory"), *EffectName.ToString());
+			StatId = &EffectMemoryStats.Add(EffectName, FDynamicStats::CreateMemoryStatId<FStatGroup_STATGROUP_MultipassPP>(StatName, FPlatformMemory::MCR_GPU));
+		}
+
+		SET_MEMORY_STAT_FName(StatId->GetName(), Extension.GetGPUMemorySize());
+	});
+
+	SET_MEMORY_STAT(STAT_MultipassPP_RTMemory, TotalSize);
+	SET_MEMORY_STAT(STAT_MultipassPP_MemoryBudget, SIZE_T(FMath::Max(LastBudgetMB, 0)) * 1024 * 1024);
+	SET_DWORD_STAT(STAT_MultipassPP_NumViewData, NumViewData);
+	SET_DWORD_STAT(STAT_MultipassPP_NumDisabledEffects, NumDisabledEffects);
+#endif
+}
+
+void FMultipassPPMemoryBudget::DumpMemory(FOutputDevice& Ar) const
+{
+	const SIZE_T TotalSize = GetTotalGPUMemorySize();
+	Ar.Logf(TEXT("MultipassPP render target memory: %.2f MB (budget: %d MB)"), TotalSize / (1024.f * 1024.f), CVarMultipassPPMemoryBudgetMB.GetValueOnGameThread());
+
+	FMultipassPPEffectRegistry::Get().ForEachCreatedEffect([&Ar](FMultipassPPSceneExtension& Extension)
+	{
+		Ar.Logf(TEXT("  %s: %.2f MB%s%s"),
+			*Extension.GetRegisteredName().ToString(),
+			Extension.GetGPUMemorySize() / (1024.f * 1024.f),
+			Extension.IsUsingCompactFormats() ? TEXT(", compact formats") : TEXT(""),
+			Extension.IsDisabledByBudget() ? TEXT(", disabled by budget") : TEXT(""));
+
+		for (const TPair<uint32, TSharedPtr<IMultipassPPViewData>>& It : Extension.GetAllViewData())
+		{
+			if (It.Value.IsValid())
+			{
+				Ar.Logf(TEXT("    View %u: %.2f MB, last used %llu frames ago"),
+					It.Key,
+					It.Value->GetGPUMemorySize() / (1024.f * 1024.f),
+					GFrameCounter - It.Value->LastUsedFrame);
+			}
+		}
+	});
+}
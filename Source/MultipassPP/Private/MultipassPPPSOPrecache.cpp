@@ -0,0 +1,124 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPPSOPrecache.h"
+
+#include "MultipassPP.h"
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPPSceneExtension.h"
+#include "CommonRenderResources.h"
+#include "PipelineStateCache.h"
+#include "HAL/IConsoleManager.h"
+
+#include "Runtime/Launch/Resources/Version.h"
+
+static FAutoConsoleCommand GMultipassPPPrecachePSOsCmd(
+	TEXT("r.MultipassPP.PrecachePSOs"),
+	TEXT("Creates the pipeline states of every created effect, e.g. behind a loading screen. Optionally also creates the effects first.\n")
+	TEXT("Usage: r.MultipassPP.PrecachePSOs [EffectName...]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		for (const FString& EffectName : Args)
+		{
+			FMultipassPPEffectRegistry::Get().RequestEffect(*EffectName);
+		}
+		FMultipassPPEffectRegistry::Get().PrecachePSOs();
+	}));
+
+namespace MultipassPPPSOPrecache
+{
+
+TConstArrayView<EPixelFormat> GetSceneColorFormats()
+{
+	static const EPixelFormat Formats[] = { PF_FloatRGBA, PF_FloatR11G11B10, PF_B8G8R8A8, PF_A2B10G10R10 };
+	return Formats;
+}
+
+static void PrecacheGraphics(FRHICommandList& RHICmdList, const FGraphicsPipelineStateInitializer& Initializer)
+{
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 2
+	// Compiles on the PSO precaching threads, the first draw waits on it if it hasn't finished yet
+	PipelineStateCache::PrecacheGraphicsPipelineState(Initializer);
+#else
+	PipelineStateCache::GetAndOrCreateGraphicsPipelineState(RHICmdList, Initializer, EApplyRendertargetOption::DoNothing);
+#endif
+}
+
+void PrecacheScreenPass(
+	FRHICommandList& RHICmdList,
+	const TShaderRef<FShader>& VertexShader,
+	const TShaderRef<FShader>& PixelShader,
+	FRHIBlendState* BlendState,
+	FRHIDepthStencilState* DepthStencilState,
+	TConstArrayView<EPixelFormat> RenderTargetFormats,
+	EPixelFormat DepthStencilFormat,
+	FExclusiveDepthStencil::Type DepthStencilAccess)
+{
+	check(IsInRenderingThread());
+
+	if (!VertexShader.IsValid() || !PixelShader.IsValid() || RenderTargetFormats.Num() > MaxSimultaneousRenderTargets)
+	{
+		return;
+	}
+
+	// Has to match what AddDrawScreenPass sets up
+	FGraphicsPipelineStateInitializer Initializer;
+	Initializer.BoundShaderState.VertexDeclarationRHI = GFilterVertexDeclaration.VertexDeclarationRHI;
+	Initializer.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+	Initializer.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+	Initializer.BlendState = BlendState;
+	Initializer.RasterizerState = TStaticRasterizerState<>::GetRHI();
+	Initializer.DepthStencilState = DepthStencilState;
+	Initializer.PrimitiveType = PT_TriangleList;
+
+	Initializer.RenderTargetsEnabled = RenderTargetFormats.Num();
+	for (int32 Index = 0; Index < RenderTargetFormats.Num(); ++Index)
+	{
+		Initializer.RenderTargetFormats[Index] = RenderTargetFormats[Index];
+		Initializer.RenderTargetFlags[Index] = TexCreate_RenderTargetable | TexCreate_ShaderResource;
+	}
+
+	if (DepthStencilFormat != PF_Unknown)
+	{
+		Initializer.DepthStencilTargetFormat = DepthStencilFormat;
+		Initializer.DepthStencilTargetFlag = TexCreate_DepthStencilTargetable;
+		Initializer.DepthTargetLoadAction = ERenderTargetLoadAction::ENoAction;
+		Initializer.StencilTargetLoadAction = ERenderTargetLoadAction::ELoad;
+		Initializer.DepthStencilAccess = DepthStencilAccess;
+	}
+
+	Initializer.NumSamples = 1;
+
+	PrecacheGraphics(RHICmdList, Initializer);
+}
+
+void PrecacheScreenPassForFormats(
+	FRHICommandList& RHICmdList,
+	const TShaderRef<FShader>& VertexShader,
+	const TShaderRef<FShader>& PixelShader,
+	FRHIBlendState* BlendState,
+	FRHIDepthStencilState* DepthStencilState,
+	TConstArrayView<EPixelFormat> Formats)
+{
+	for (EPixelFormat Format : Formats)
+	{
+		PrecacheScreenPass(RHICmdList, VertexShader, PixelShader, BlendState, DepthStencilState, MakeArrayView(&Format, 1));
+	}
+}
+
+void PrecacheCompute(FRHICommandList& RHICmdList, const TShaderRef<FShader>& ComputeShader)
+{
+	check(IsInRenderingThread());
+
+	if (!ComputeShader.IsValid())
+	{
+		return;
+	}
+
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 2
+	PipelineStateCache::PrecacheComputePipelineState(ComputeShader.GetComputeShader());
+#else
+	PipelineStateCache::GetAndOrCreateComputePipelineState(RHICmdList, ComputeShader.GetComputeShader(), false);
+#endif
+}
+
+}
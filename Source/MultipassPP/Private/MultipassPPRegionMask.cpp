@@ -0,0 +1,201 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPRegionMask.h"
+
+#include "MultipassPP.h"
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPPSceneExtension.h"
+#include "CommonRenderResources.h"
+#include "RenderGraphUtils.h"
+#include "ScenePrivate.h"
+#include "HAL/IConsoleManager.h"
+
+static FAutoConsoleCommand GMultipassPPRegionMaskCmd(
+	TEXT("r.MultipassPP.RegionMask"),
+	TEXT("Restricts an effect to part of the view.\n")
+	TEXT("Usage: r.MultipassPP.RegionMask <EffectName> stencil <Value> [invert]\n")
+	TEXT("       r.MultipassPP.RegionMask <EffectName> depth <MinDepth> <MaxDepth> [invert]\n")
+	TEXT("       r.MultipassPP.RegionMask <EffectName> rect <MinU> <MinV> <MaxU> <MaxV> [invert]\n")
+	TEXT("       r.MultipassPP.RegionMask <EffectName> off"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() < 2)
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("Usage: r.MultipassPP.RegionMask <EffectName> <stencil|depth|rect|off> [Args] [invert]"));
+			return;
+		}
+
+		TSharedPtr<FMultipassPPSceneExtension> Extension = FMultipassPPEffectRegistry::Get().RequestEffect(*Args[0]);
+		if (Extension == nullptr)
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("r.MultipassPP.RegionMask: %s is not an enabled effect"), *Args[0]);
+			return;
+		}
+
+		FMultipassPPRegionMask Mask;
+		Mask.bInvert = Args.Last() == TEXT("invert");
+		const int32 NumValues = Args.Num() - 2 - (Mask.bInvert ? 1 : 0);
+
+		if (Args[1] == TEXT("stencil") && NumValues >= 1)
+		{
+			Mask.Mode = EMultipassPPRegionMaskMode::CustomStencil;
+			Mask.StencilValue = (uint8)FMath::Clamp(FCString::Atoi(*Args[2]), 0, 255);
+		}
+		else if (Args[1] == TEXT("depth") && NumValues >= 2)
+		{
+			Mask.Mode = EMultipassPPRegionMaskMode::DepthRange;
+			Mask.MinDepth = FCString::Atof(*Args[2]);
+			Mask.MaxDepth = FCString::Atof(*Args[3]);
+		}
+		else if (Args[1] == TEXT("rect") && NumValues >= 4)
+		{
+			Mask.Mode = EMultipassPPRegionMaskMode::Rects;
+			for (int32 Index = 2; Index + 3 < 2 + NumValues; Index += 4)
+			{
+				Mask.Rects.Emplace(
+					FVector2f(FCString::Atof(*Args[Index + 0]), FCString::Atof(*Args[Index + 1])),
+					FVector2f(FCString::Atof(*Args[Index + 2]), FCString::Atof(*Args[Index + 3])));
+			}
+		}
+		else if (Args[1] != TEXT("off"))
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("r.MultipassPP.RegionMask: unknown mode %s, or missing arguments"), *Args[1]);
+			return;
+		}
+
+		Extension->SetRegionMask(Mask);
+	}));
+
+IMPLEMENT_GLOBAL_SHADER(FMultipassPPRegionMaskPS, "/MultipassPP/Private/MultipassPPRegionMask.usf", "MainPS", SF_Pixel);
+
+bool FMultipassPPRegionMaskPS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+}
+
+void FMultipassPPRegionMaskPS::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("MAX_RECTS"), FMultipassPPRegionMask::MaxRects);
+}
+
+IMPLEMENT_GLOBAL_SHADER(FMultipassPPRegionMaskClassifyCS, "/MultipassPP/Private/MultipassPPRegionMaskTiles.usf", "ClassifyCS", SF_Compute);
+
+bool FMultipassPPRegionMaskClassifyCS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+}
+
+void FMultipassPPRegionMaskClassifyCS::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), GroupSize);
+}
+
+FRDGTextureRef AddMultipassPPRegionMaskPass(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures,
+	const FMultipassPPRegionMask& Mask,
+	const FScreenPassRenderTarget& Output)
+{
+	if (!Mask.IsEnabled())
+	{
+		return nullptr;
+	}
+
+	const bool bNeedsSceneTextures = Mask.Mode == EMultipassPPRegionMaskMode::CustomStencil || Mask.Mode == EMultipassPPRegionMaskMode::DepthRange;
+	if (bNeedsSceneTextures && SceneTextures == nullptr)
+	{
+		return nullptr;
+	}
+
+	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Output.Texture->Desc.Extent, PF_DepthStencil, FClearValueBinding::DepthZero, TexCreate_DepthStencilTargetable | TexCreate_ShaderResource);
+	FRDGTextureRef MaskTexture = GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.RegionMask"));
+
+	FMultipassPPRegionMaskPS::FParameters* Parameters = GraphBuilder.AllocParameters<FMultipassPPRegionMaskPS::FParameters>();
+	Parameters->View = View.ViewUniformBuffer;
+	Parameters->SceneTexturesStruct = SceneTextures;
+	Parameters->OutputViewMin = FVector2f(Output.ViewRect.Min);
+	Parameters->OutputViewSize = FVector2f(Output.ViewRect.Size());
+	Parameters->StencilValue = Mask.StencilValue;
+	Parameters->DepthRange = FVector2f(Mask.MinDepth, Mask.MaxDepth);
+	Parameters->NumRects = FMath::Min(Mask.Rects.Num(), FMultipassPPRegionMask::MaxRects);
+	for (uint32 Index = 0; Index < Parameters->NumRects; ++Index)
+	{
+		Parameters->Rects[Index] = FVector4f(Mask.Rects[Index].Min.X, Mask.Rects[Index].Min.Y, Mask.Rects[Index].Max.X, Mask.Rects[Index].Max.Y);
+	}
+	Parameters->bInvert = Mask.bInvert ? 1 : 0;
+	Parameters->RenderTargets.DepthStencil = FDepthStencilBinding(MaskTexture, ERenderTargetLoadAction::EClear, ERenderTargetLoadAction::EClear, FExclusiveDepthStencil::DepthWrite_StencilWrite);
+
+	FMultipassPPRegionMaskPS::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FMultipassPPRegionMaskPS::FModeDim>((int32)Mask.Mode);
+
+	const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(View.FeatureLevel);
+	TShaderMapRef<FScreenPassVS> VertexShader(GlobalShaderMap);
+	TShaderMapRef<FMultipassPPRegionMaskPS> PixelShader(GlobalShaderMap, PermutationVector);
+
+	// Excluded pixels survive the discard and get their stencil incremented from the cleared 0, so the reference doesn't matter
+	FRHIBlendState* BlendState = TStaticBlendState<CW_NONE>::GetRHI();
+	FRHIDepthStencilState* DepthStencilState = TStaticDepthStencilState<false, CF_Always, true, CF_Always, SO_Keep, SO_Keep, SO_SaturatedIncrement, true, CF_Always, SO_Keep, SO_Keep, SO_SaturatedIncrement>::GetRHI();
+
+	const FScreenPassTextureViewport Viewport(Output);
+	AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("RegionMask"), View, Viewport, Viewport, VertexShader, PixelShader, BlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
+
+	return MaskTexture;
+}
+
+void AddMultipassPPRegionMaskFillPass(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	const FScreenPassTexture& Input,
+	const FScreenPassRenderTarget& Output,
+	FRDGTextureRef MaskTexture)
+{
+	check(MaskTexture);
+
+	FCopyRectPS::FParameters* Parameters = GraphBuilder.AllocParameters<FCopyRectPS::FParameters>();
+	Parameters->InputTexture = Input.Texture;
+	Parameters->InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
+	Parameters->RenderTargets[0] = FRenderTargetBinding(Output.Texture, ERenderTargetLoadAction::ELoad);
+	Parameters->RenderTargets.DepthStencil = MultipassPPRegionMask::GetBinding(MaskTexture);
+
+	const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(View.FeatureLevel);
+	TShaderMapRef<FScreenPassVS> VertexShader(GlobalShaderMap);
+	TShaderMapRef<FCopyRectPS> PixelShader(GlobalShaderMap);
+
+	FRHIBlendState* BlendState = FScreenPassPipelineState::FDefaultBlendState::GetRHI();
+	AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("RegionMaskFill"), View, FScreenPassTextureViewport(Output), FScreenPassTextureViewport(Input), VertexShader, PixelShader, BlendState, MultipassPPRegionMask::GetExcludedDepthStencilState(), Parameters, EScreenPassDrawFlags::None);
+}
+
+FMultipassPPRegionMaskTiles AddMultipassPPRegionMaskClassifyPass(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	const FScreenPassRenderTarget& Output,
+	FRDGTextureRef MaskTexture,
+	const FIntPoint& TileSize)
+{
+	check(MaskTexture);
+
+	const FIntPoint OutputSize = Output.ViewRect.Size();
+	const FIntPoint TileCount = FIntPoint::DivideAndRoundUp(OutputSize, TileSize);
+
+	FMultipassPPRegionMaskTiles Tiles;
+	Tiles.TileList = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), TileCount.X * TileCount.Y), TEXT("MultipassPP.RegionMaskTileList"));
+	Tiles.IndirectArgs = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateIndirectDesc<FRHIDispatchIndirectParameters>(1), TEXT("MultipassPP.RegionMaskIndirectArgs"));
+	FRDGBufferUAVRef IndirectArgsUAV = GraphBuilder.CreateUAV(Tiles.IndirectArgs, PF_R32_UINT);
+	AddClearUAVPass(GraphBuilder, IndirectArgsUAV, 0);
+
+	FMultipassPPRegionMaskClassifyCS::FParameters* Parameters = GraphBuilder.AllocParameters<FMultipassPPRegionMaskClassifyCS::FParameters>();
+	Parameters->MaskTexture = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::CreateWithPixelFormat(MaskTexture, PF_X24_G8));
+	Parameters->OutputViewMin = Output.ViewRect.Min;
+	Parameters->OutputViewSize = OutputSize;
+	Parameters->TileSize = TileSize;
+	Parameters->TileListUAV = GraphBuilder.CreateUAV(Tiles.TileList, PF_R32_UINT);
+	Parameters->IndirectArgsUAV = IndirectArgsUAV;
+
+	TShaderMapRef<FMultipassPPRegionMaskClassifyCS> ComputeShader(GetGlobalShaderMap(View.FeatureLevel));
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("RegionMaskClassify %dx%d tiles", TileCount.X, TileCount.Y), ComputeShader, Parameters, FIntVector(TileCount.X, TileCount.Y, 1));
+
+	return Tiles;
+}
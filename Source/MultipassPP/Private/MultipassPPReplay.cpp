@@ -0,0 +1,350 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPReplay.h"
+
+#include "MultipassPP.h"
+#include "MultipassPPEffectRegistry.h"
+#include "MultipassPPSceneExtension.h"
+#include "RHIGPUReadback.h"
+#include "RenderGraphUtils.h"
+#include "RenderTargetPool.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "Async/Async.h"
+
+static FAutoConsoleCommand GMultipassPPCaptureFrameCmd(
+	TEXT("r.MultipassPP.CaptureFrame"),
+	TEXT("Saves the inputs of the next frame an effect renders (scene color, view data RT and parameters) to a file for r.MultipassPP.Replay.\n")
+	TEXT("Usage: r.MultipassPP.CaptureFrame <EffectName> [Filename]. Defaults to Saved/Profiling/MultipassPP/<EffectName>_<Frame>.mppcapture"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() < 1)
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("Usage: r.MultipassPP.CaptureFrame <EffectName> [Filename]"));
+			return;
+		}
+
+		TSharedPtr<FMultipassPPSceneExtension> Extension = FMultipassPPEffectRegistry::Get().RequestEffect(*Args[0]);
+		if (Extension == nullptr)
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("r.MultipassPP.CaptureFrame: %s is not an enabled effect"), *Args[0]);
+			return;
+		}
+
+		const FString Filename = Args.Num() > 1 ? Args[1] : FPaths::ProfilingDir() / TEXT("MultipassPP") / FString::Printf(TEXT("%s_%llu.mppcapture"), *Args[0], (uint64)GFrameCounter);
+		Extension->CaptureNextFrame(Filename);
+	}));
+
+static FAutoConsoleCommand GMultipassPPReplayCmd(
+	TEXT("r.MultipassPP.Replay"),
+	TEXT("Runs an effect's passes on a file saved with r.MultipassPP.CaptureFrame, NumIterations times in the next frame the effect renders,\n")
+	TEXT("and logs the GPU time of every run. The effect has to be enabled and the view has to be the captured size, see r.SetRes.\n")
+	TEXT("With quit, the engine exits once the timings are logged, e.g. -game -RenderOffscreen -ExecCmds=\"r.MultipassPP.Replay File.mppcapture 200 quit\"\n")
+	TEXT("Usage: r.MultipassPP.Replay <Filename> [NumIterations=100] [quit]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() < 1)
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("Usage: r.MultipassPP.Replay <Filename> [NumIterations=100] [quit]"));
+			return;
+		}
+
+		TSharedRef<FMultipassPPFrameCapture, ESPMode::ThreadSafe> Capture = MakeShared<FMultipassPPFrameCapture, ESPMode::ThreadSafe>();
+		if (!Capture->LoadFromFile(Args[0]))
+		{
+			return;
+		}
+
+		TSharedPtr<FMultipassPPSceneExtension> Extension = FMultipassPPEffectRegistry::Get().RequestEffect(*Capture->EffectName);
+		if (Extension == nullptr)
+		{
+			UE_LOG(LogMultipassPP, Warning, TEXT("r.MultipassPP.Replay: %s is not an enabled effect"), *Capture->EffectName);
+			return;
+		}
+
+		const int32 NumIterations = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 100;
+		const bool bQuitWhenDone = Args.Contains(TEXT("quit"));
+		Extension->StartReplay(Capture, NumIterations, bQuitWhenDone);
+	}));
+
+FArchive& operator<<(FArchive& Ar, FMultipassPPFrameCapture& Capture)
+{
+	uint32 Magic = FMultipassPPFrameCapture::ExpectedMagic;
+	uint32 Version = FMultipassPPFrameCapture::ExpectedVersion;
+	Ar << Magic << Version;
+
+	if (Magic != FMultipassPPFrameCapture::ExpectedMagic || Version != FMultipassPPFrameCapture::ExpectedVersion)
+	{
+		Ar.SetError();
+		return Ar;
+	}
+
+	int32 SceneColorFormat = Capture.SceneColorFormat;
+	int32 HistoryFormat = Capture.HistoryFormat;
+
+	Ar << Capture.EffectName << Capture.FrameNumber;
+	Ar << Capture.SceneColorSize << SceneColorFormat << Capture.SceneColor;
+	Ar << Capture.HistorySize << HistoryFormat << Capture.History;
+	Ar << Capture.Parameters;
+
+	Capture.SceneColorFormat = (EPixelFormat)FMath::Clamp(SceneColorFormat, 0, PF_MAX - 1);
+	Capture.HistoryFormat = (EPixelFormat)FMath::Clamp(HistoryFormat, 0, PF_MAX - 1);
+	return Ar;
+}
+
+bool FMultipassPPFrameCapture::SaveToFile(const FString& Filename) const
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	Writer << const_cast<FMultipassPPFrameCapture&>(*this);
+
+	if (!FFileHelper::SaveArrayToFile(Bytes, *Filename))
+	{
+		UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP capture: could not write %s"), *Filename);
+		return false;
+	}
+
+	UE_LOG(LogMultipassPP, Log, TEXT("MultipassPP capture: saved %s frame %llu (%dx%d) to %s"), *EffectName, FrameNumber, SceneColorSize.X, SceneColorSize.Y, *Filename);
+	return true;
+}
+
+bool FMultipassPPFrameCapture::LoadFromFile(const FString& Filename)
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *Filename))
+	{
+		UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP replay: could not read %s"), *Filename);
+		return false;
+	}
+
+	FMemoryReader Reader(Bytes);
+	Reader << *this;
+
+	const SIZE_T SceneColorBytes = SIZE_T(SceneColorSize.X) * SceneColorSize.Y * GPixelFormats[SceneColorFormat].BlockBytes;
+	const SIZE_T HistoryBytes = SIZE_T(HistorySize.X) * HistorySize.Y * GPixelFormats[HistoryFormat].BlockBytes;
+	if (Reader.IsError() || SceneColorBytes == 0 || SceneColor.Num() != SceneColorBytes || History.Num() != HistoryBytes)
+	{
+		UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP replay: %s is not a capture of this version"), *Filename);
+		return false;
+	}
+
+	return true;
+}
+
+// Copies a readback into tightly packed rows
+static void CopyReadback(FRHIGPUTextureReadback& Readback, FIntPoint Size, EPixelFormat Format, TArray<uint8>& OutData)
+{
+	const uint32 RowBytes = Size.X * GPixelFormats[Format].BlockBytes;
+	OutData.SetNumUninitialized(RowBytes * Size.Y);
+
+	int32 RowPitchInPixels = 0;
+	const uint8* Data = static_cast<const uint8*>(Readback.Lock(RowPitchInPixels));
+	if (Data != nullptr)
+	{
+		const SIZE_T RowPitchInBytes = SIZE_T(RowPitchInPixels) * GPixelFormats[Format].BlockBytes;
+		for (int32 Row = 0; Row < Size.Y; ++Row)
+		{
+			FMemory::Memcpy(OutData.GetData() + SIZE_T(Row) * RowBytes, Data + SIZE_T(Row) * RowPitchInBytes, RowBytes);
+		}
+	}
+	else
+	{
+		OutData.Reset();
+	}
+	Readback.Unlock();
+}
+
+FMultipassPPFrameCaptureRequest::FMultipassPPFrameCaptureRequest(FName InEffectName, const FString& InFilename)
+	: Filename(InFilename)
+{
+	Capture.EffectName = InEffectName.ToString();
+}
+
+FMultipassPPFrameCaptureRequest::~FMultipassPPFrameCaptureRequest() = default;
+
+void FMultipassPPFrameCaptureRequest::AddCapturePasses(FRDGBuilder& GraphBuilder, const FScreenPassTexture& SceneColor, IMultipassPPViewData& ViewData)
+{
+	check(IsInRenderingThread());
+	check(!bCaptured && SceneColor.IsValid());
+
+	bCaptured = true;
+	Capture.FrameNumber = GFrameCounterRenderThread;
+
+	Capture.SceneColorSize = SceneColor.ViewRect.Size();
+	Capture.SceneColorFormat = SceneColor.Texture->Desc.Format;
+	SceneColorReadback = MakeUnique<FRHIGPUTextureReadback>(TEXT("MultipassPP.CaptureFrameSceneColor"));
+	AddEnqueueCopyPass(GraphBuilder, SceneColorReadback.Get(), SceneColor.Texture, FResolveRect(SceneColor.ViewRect));
+
+	// The whole RT, effects may use more of it than the view rect
+	if (TRefCountPtr<IPooledRenderTarget> RT = ViewData.GetRT())
+	{
+		FRDGTextureRef History = GraphBuilder.RegisterExternalTexture(RT);
+		Capture.HistorySize = History->Desc.Extent;
+		Capture.HistoryFormat = History->Desc.Format;
+		HistoryReadback = MakeUnique<FRHIGPUTextureReadback>(TEXT("MultipassPP.CaptureFrameHistory"));
+		AddEnqueueCopyPass(GraphBuilder, HistoryReadback.Get(), History);
+	}
+
+	FMemoryWriter Writer(Capture.Parameters);
+	ViewData.SerializeParameters(Writer);
+}
+
+bool FMultipassPPFrameCaptureRequest::Poll()
+{
+	check(IsInRenderingThread());
+
+	if (!bCaptured || !SceneColorReadback->IsReady() || (HistoryReadback.IsValid() && !HistoryReadback->IsReady()))
+	{
+		return false;
+	}
+
+	CopyReadback(*SceneColorReadback, Capture.SceneColorSize, Capture.SceneColorFormat, Capture.SceneColor);
+	if (HistoryReadback.IsValid())
+	{
+		CopyReadback(*HistoryReadback, Capture.HistorySize, Capture.HistoryFormat, Capture.History);
+	}
+
+	// Multiple megabytes at high resolutions, so the file is written off the render thread
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [Capture = MoveTemp(Capture), Filename = MoveTemp(Filename)]()
+	{
+		Capture.SaveToFile(Filename);
+	});
+
+	return true;
+}
+
+FMultipassPPReplay::FMultipassPPReplay(TSharedRef<const FMultipassPPFrameCapture, ESPMode::ThreadSafe> InCapture, int32 InNumIterations, bool bInQuitWhenDone)
+	: Capture(MoveTemp(InCapture))
+	, NumIterations(FMath::Max(InNumIterations, 1))
+	, bQuitWhenDone(bInQuitWhenDone)
+{
+
+}
+
+FMultipassPPReplay::~FMultipassPPReplay() = default;
+
+TRefCountPtr<IPooledRenderTarget> FMultipassPPReplay::Upload(FRHICommandListImmediate& RHICmdList, FIntPoint Size, EPixelFormat Format, const TArray<uint8>& Data, const TCHAR* DebugName)
+{
+	const FPooledRenderTargetDesc Desc = FPooledRenderTargetDesc::Create2DDesc(Size, Format, FClearValueBinding::None, TexCreate_None, TexCreate_ShaderResource | TexCreate_RenderTargetable | TexCreate_UAV, false);
+
+	TRefCountPtr<IPooledRenderTarget> RT;
+	GRenderTargetPool.FindFreeElement(RHICmdList, Desc, RT, DebugName);
+
+	// Recorded before the graph executes, so the passes reading it see the upload
+	const FUpdateTextureRegion2D Region(0, 0, 0, 0, Size.X, Size.Y);
+	RHICmdList.UpdateTexture2D(RT->GetRHI(), 0, Region, Size.X * GPixelFormats[Format].BlockBytes, Data.GetData());
+
+	return RT;
+}
+
+FScreenPassTexture FMultipassPPReplay::RegisterSceneColor(FRDGBuilder& GraphBuilder)
+{
+	if (!SceneColorRT.IsValid())
+	{
+		SceneColorRT = Upload(GraphBuilder.RHICmdList, Capture->SceneColorSize, Capture->SceneColorFormat, Capture->SceneColor, TEXT("MultipassPP.ReplaySceneColor"));
+	}
+
+	FRDGTextureRef Texture = GraphBuilder.RegisterExternalTexture(SceneColorRT);
+	return FScreenPassTexture(Texture, FIntRect(FIntPoint::ZeroValue, Capture->SceneColorSize));
+}
+
+FRDGTextureRef FMultipassPPReplay::RegisterHistory(FRDGBuilder& GraphBuilder)
+{
+	if (Capture->History.Num() == 0)
+	{
+		return nullptr;
+	}
+
+	if (!HistoryRT.IsValid())
+	{
+		HistoryRT = Upload(GraphBuilder.RHICmdList, Capture->HistorySize, Capture->HistoryFormat, Capture->History, TEXT("MultipassPP.ReplayHistory"));
+	}
+
+	return GraphBuilder.RegisterExternalTexture(HistoryRT);
+}
+
+void FMultipassPPReplay::AddTimestampPass(FRDGBuilder& GraphBuilder)
+{
+	if (!QueryPool.IsValid())
+	{
+		QueryPool = RHICreateRenderQueryPool(RQT_AbsoluteTime, NumIterations * 2);
+	}
+
+	FRHIPooledRenderQuery& Timestamp = Timestamps.Emplace_GetRef(QueryPool->AllocateQuery());
+	FRHIRenderQuery* Query = Timestamp.GetQuery();
+
+	GraphBuilder.AddPass(RDG_EVENT_NAME("Timestamp"), ERDGPassFlags::None | ERDGPassFlags::NeverCull, [Query](FRHICommandListImmediate& RHICmdList)
+	{
+		RHICmdList.EndRenderQuery(Query);
+	});
+}
+
+void FMultipassPPReplay::KeepOutput(FRDGBuilder& GraphBuilder, FRDGTextureRef Output)
+{
+	if (Output != nullptr)
+	{
+		GraphBuilder.QueueTextureExtraction(Output, &Outputs.AddDefaulted_GetRef());
+	}
+}
+
+bool FMultipassPPReplay::Poll()
+{
+	check(IsInRenderingThread());
+
+	if (!bHasRun)
+	{
+		return false;
+	}
+
+	TArray<uint64> Results;
+	for (FRHIPooledRenderQuery& Timestamp : Timestamps)
+	{
+		uint64 Result = 0;
+		if (!RHIGetRenderQueryResult(Timestamp.GetQuery(), Result, false))
+		{
+			return false;
+		}
+		Results.Add(Result);
+	}
+
+	// Timestamps are in microseconds
+	TArray<double> Times;
+	for (int32 Index = 0; Index + 1 < Results.Num(); Index += 2)
+	{
+		Times.Add(double(Results[Index + 1] - Results[Index]) / 1000.0);
+	}
+
+	if (Times.Num() > 0)
+	{
+		Times.Sort();
+
+		double Total = 0.0;
+		for (double Time : Times)
+		{
+			Total += Time;
+		}
+
+		UE_LOG(LogMultipassPP, Display, TEXT("MultipassPP replay: %s at %dx%d, %d runs: min %.3f ms, median %.3f ms, mean %.3f ms, max %.3f ms"),
+			*Capture->EffectName, Capture->SceneColorSize.X, Capture->SceneColorSize.Y, Times.Num(), Times[0], Times[Times.Num() / 2], Total / Times.Num(), Times.Last());
+	}
+	else
+	{
+		UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP replay: no GPU timings for %s"), *Capture->EffectName);
+	}
+
+	Timestamps.Reset();
+	Outputs.Reset();
+
+	if (bQuitWhenDone)
+	{
+		AsyncTask(ENamedThreads::GameThread, []()
+		{
+			FPlatformMisc::RequestExit(false);
+		});
+	}
+
+	return true;
+}
@@ -9,6 +9,115 @@
 #include "PostProcess/PostProcessMaterial.h"
 #include "ScenePrivate.h"
 #include "Engine/TextureRenderTarget2D.h"
+#include "MultipassPP.h"
+#include "MultipassPPStats.h"
+#include "MultipassPPCapture.h"
+#include "MultipassPPReplay.h"
+#include "MultipassPPEffectRegistry.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "Misc/ScopeRWLock.h"
+#include "RenderGraphBlackboard.h"
+
+#include <atomic>
+
+static TAutoConsoleVariable<int32> CVarMultipassPPOutputReuse(
+	TEXT("r.MultipassPP.OutputReuse"),
+	0,
+	TEXT("Reuses the output of effects that support it while the view isn't changing, instead of running them every frame.\n")
+	TEXT(" 0: off (default)\n")
+	TEXT(" 1: while the world is paused and the camera and effect parameters are unchanged\n")
+	TEXT(" 2: same as 1, and also while the game has called FMultipassPPSceneExtension::SetSceneStaticHint(true)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarMultipassPPShareViews(
+	TEXT("r.MultipassPP.ShareViews"),
+	0,
+	TEXT("Runs effects once for views that render the same camera, scene and show flags with the same effect parameters, e.g. a spectator\n")
+	TEXT("window mirroring the main camera, and gives the other views the first view's output, resampled if their size differs.\n")
+	TEXT("Views put in a group with FMultipassPPSceneExtension::SetViewSharingGroup always share.\n")
+	TEXT(" 0: only grouped views share (default)\n")
+	TEXT(" 1: views with the same view projection matrix share too"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarMultipassPPImageStats(
+	TEXT("r.MultipassPP.ImageStats"),
+	0,
+	TEXT("Measures the luma, edge strength, luma change and fraction of active pixels of every effect's input on the GPU, and reads them\n")
+	TEXT("back a few frames later. See r.MultipassPP.PrintImageStats and FMultipassPPSceneExtension::GetLatestImageStats.\n")
+	TEXT("Effects with an auto skip threshold are always measured while r.MultipassPP.AutoSkip is on"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarMultipassPPImageStatsInterval(
+	TEXT("r.MultipassPP.ImageStats.Interval"),
+	4,
+	TEXT("Frames between two measurements of a view's input. The luma change is measured over that many frames"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarMultipassPPImageStatsActiveThreshold(
+	TEXT("r.MultipassPP.ImageStats.ActiveThreshold"),
+	0.05f,
+	TEXT("Edge strength, in luma, over which a pixel counts as active"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarMultipassPPAutoSkip(
+	TEXT("r.MultipassPP.AutoSkip"),
+	0,
+	TEXT("What to do with an effect whose measured impact on a view stays under r.MultipassPP.<EffectName>.AutoSkipThreshold.\n")
+	TEXT("Adaptive sharpen measures the edge strength, SMAA the fraction of active pixels, accumulation motion blur and interlacing the luma change.\n")
+	TEXT(" 0: nothing (default)\n")
+	TEXT(" 1: skip the effect\n")
+	TEXT(" 2: run the effect at quality tier 0. Effects without quality tiers run as usual"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarMultipassPPAutoSkipMeasurements(
+	TEXT("r.MultipassPP.AutoSkip.Measurements"),
+	3,
+	TEXT("Number of measurements in a row that have to be under the threshold before an effect is skipped or downgraded.\n")
+	TEXT("One measurement over it brings the effect back"),
+	ECVF_RenderThreadSafe);
+
+static FAutoConsoleCommand GMultipassPPPrintImageStatsCmd(
+	TEXT("r.MultipassPP.PrintImageStats"),
+	TEXT("Logs the latest image statistics of every created effect, see r.MultipassPP.ImageStats"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FMultipassPPEffectRegistry::Get().ForEachCreatedEffect([](FMultipassPPSceneExtension& Extension)
+		{
+			FMultipassPPEffectImageStats Stats;
+			if (!Extension.GetLatestImageStats(Stats))
+			{
+				UE_LOG(LogMultipassPP, Display, TEXT("%s: no image statistics"), *Extension.GetRegisteredName().ToString());
+				return;
+			}
+
+			static const TCHAR* ActionNames[] = { TEXT("none"), TEXT("skipped"), TEXT("downgraded") };
+			UE_LOG(LogMultipassPP, Display, TEXT("%s: frame %llu, %u pixels, luma %.4f, edge strength %.4f, luma delta %.4f, active %.1f%%, impact %.4f, auto skip %s"),
+				*Extension.GetRegisteredName().ToString(), Stats.Stats.FrameNumber, Stats.Stats.NumPixels, Stats.Stats.MeanLuma, Stats.Stats.MeanEdgeStrength,
+				Stats.Stats.MeanLumaDelta, Stats.Stats.ActiveFraction * 100.f, Stats.Impact, ActionNames[(int32)Stats.AutoSkipAction]);
+		});
+	}));
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Auto Skipped Views"), STAT_MultipassPP_AutoSkippedViews, STATGROUP_MultipassPP);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shared View Outputs"), STAT_MultipassPP_SharedViewOutputs, STATGROUP_MultipassPP);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Reused Outputs"), STAT_MultipassPP_ReusedOutputs, STATGROUP_MultipassPP);
+DECLARE_CYCLE_STAT(TEXT("SetupView"), STAT_MultipassPP_SetupView, STATGROUP_MultipassPP);
+DECLARE_CYCLE_STAT(TEXT("PreRenderView"), STAT_MultipassPP_PreRenderView, STATGROUP_MultipassPP);
+DECLARE_CYCLE_STAT(TEXT("IsActiveThisFrame"), STAT_MultipassPP_IsActiveThisFrame, STATGROUP_MultipassPP);
+DECLARE_DWORD_COUNTER_STAT(TEXT("View Data Lookups"), STAT_MultipassPP_ViewDataLookups, STATGROUP_MultipassPP);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("View Data Created"), STAT_MultipassPP_ViewDataCreated, STATGROUP_MultipassPP);
+
+static std::atomic<bool> GMultipassPPSceneStaticHint(false);
+
+// View key to sharing group, see SetViewSharingGroup. Render thread only
+static TMap<uint32, uint32> GMultipassPPViewSharingGroups;
+
+// Outputs shared within the graph being built, before they can be extracted
+struct FMultipassPPSharedViewOutputs
+{
+	TMap<TTuple<const FMultipassPPSceneExtension*, uint32>, FScreenPassTexture> Outputs;
+};
+RDG_REGISTER_BLACKBOARD_STRUCT(FMultipassPPSharedViewOutputs);
 
 FMultipassPPSceneExtension::FMultipassPPSceneExtension(const FAutoRegister& AutoReg)
 	: FSceneViewExtensionBase(AutoReg)
@@ -18,19 +127,252 @@ FMultipassPPSceneExtension::FMultipassPPSceneExtension(const FAutoRegister& Auto
 
 void FMultipassPPSceneExtension::SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView)
 {
+	SCOPE_CYCLE_COUNTER(STAT_MultipassPP_SetupView);
+
+	// The map is read by the memory budget on the game thread, so the view data is still created here
 	TSharedPtr<IMultipassPPViewData> ViewData = GetOrCreateViewData(InView);
 	if (ViewData != nullptr)
 	{
-		ViewData->SetupRT(InView.UnconstrainedViewRect.Size());
+		ViewData->LastUsedFrame = GFrameCounter;
+	}
+}
+
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1
+void FMultipassPPSceneExtension::PreRenderView_RenderThread(FRDGBuilder& GraphBuilder, FSceneView& InView)
+#else
+void FMultipassPPSceneExtension::PreRenderView_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneView& InView)
+#endif
+{
+	SCOPE_CYCLE_COUNTER(STAT_MultipassPP_PreRenderView);
+
+	TSharedPtr<IMultipassPPViewData> ViewData = GetViewData(InView);
+	if (ViewData == nullptr)
+	{
+		return;
 	}
+
+	// An explicit full precision setting wins over the memory budget
+	const int32 Precision = ScalabilitySettings_RenderThread.Precision;
+	ViewData->SetUseCompactFormat(Precision == 0 ? false : (Precision == 1 || bUseCompactFormats_RenderThread));
+
+	// First, the parameters can lower the resolution
+	SetupViewData_RenderThread(InView, *ViewData);
+
+	// Allocates right away on the render thread, instead of enqueuing a command per view like it would on the game thread
+	FIntPoint Resolution = InView.UnconstrainedViewRect.Size();
+	ViewData->ResolutionFraction = FMath::Clamp(GetResolutionFraction(*ViewData), 0.f, 1.f);
+	if (ViewData->ResolutionFraction < 1.f)
+	{
+		Resolution = FIntPoint(
+			FMath::Max(FMath::CeilToInt(Resolution.X * ViewData->ResolutionFraction), 1),
+			FMath::Max(FMath::CeilToInt(Resolution.Y * ViewData->ResolutionFraction), 1));
+	}
+	ViewData->SetupRT(Resolution);
+	ViewData->UpdateGPUMemorySize_RenderThread();
+}
+
+float FMultipassPPSceneExtension::GetResolutionFraction(const IMultipassPPViewData& ViewData) const
+{
+	return SupportsResolutionFraction() ? ScalabilitySettings_RenderThread.ResolutionFraction : 1.f;
+}
+
+bool FMultipassPPSceneExtension::IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_MultipassPP_IsActiveThisFrame);
+
+	return !bDisabledByBudget && ScalabilitySettings.bEnabled && FSceneViewExtensionBase::IsActiveThisFrame_Internal(Context);
 }
 
 void FMultipassPPSceneExtension::SubscribeToPostProcessingPass(EPostProcessingPass Pass, FAfterPassCallbackDelegateArray& InOutPassCallbacks, bool bIsPassEnabled)
 {
 	if (PostProcessingPasses.Contains(Pass))
 	{
-		InOutPassCallbacks.Add(FAfterPassCallbackDelegate::CreateRaw(this, &FMultipassPPSceneExtension::PostProcessPass_RenderThread, Pass));
+		InOutPassCallbacks.Add(FAfterPassCallbackDelegate::CreateRaw(this, &FMultipassPPSceneExtension::OnPostProcessPass_RenderThread, Pass));
+	}
+}
+
+FScreenPassTexture FMultipassPPSceneExtension::OnPostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& InOutInputs, EPostProcessingPass Pass)
+{
+	checkSlow(View.bIsViewInfo);
+	const FViewInfo& ViewInfo = static_cast<const FViewInfo&>(View);
+
+	// Reuse is only tracked per view, so it isn't supported for extensions that run after more than one pass
+	const int32 SettleFrames = PostProcessingPasses.Num() == 1 ? GetOutputReuseSettleFrames(View) : -1;
+	TSharedPtr<IMultipassPPViewData> ViewData = SettleFrames >= 0 ? GetViewData(View) : nullptr;
+
+	SceneTextures_RenderThread = InOutInputs.SceneTextures.SceneTextures;
+
+	if (Replay_RenderThread.IsValid())
+	{
+		if (!Replay_RenderThread->HasRun())
+		{
+			AddReplayPasses_RenderThread(GraphBuilder, View, InOutInputs, Pass);
+		}
+		else if (Replay_RenderThread->Poll())
+		{
+			Replay_RenderThread.Reset();
+		}
+	}
+
+	// Measured once per frame and view, like the reuse
+	TSharedPtr<IMultipassPPViewData> StatsViewData = PostProcessingPasses.Num() == 1 ? GetViewData(View) : nullptr;
+	const EMultipassPPAutoSkipAction AutoSkipAction = StatsViewData != nullptr
+		? UpdateImageStats_RenderThread(GraphBuilder, ViewInfo, InOutInputs, *StatsViewData)
+		: EMultipassPPAutoSkipAction::None;
+
+	const uint32 SharingKey = GetViewSharingKey_RenderThread(View, Pass, InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor));
+	const FScreenPassTexture SharedOutput = SharingKey != 0 ? FindSharedViewOutput_RenderThread(GraphBuilder, SharingKey) : FScreenPassTexture();
+
+	bool bKeepOutput = false;
+	FScreenPassTexture Output;
+	if (SharedOutput.IsValid())
+	{
+		INC_DWORD_STAT(STAT_MultipassPP_SharedViewOutputs);
+
+		const FScreenPassTexture& SceneColor = InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor);
+		FScreenPassRenderTarget SharedTarget = InOutInputs.OverrideOutput;
+		if (!SharedTarget.IsValid())
+		{
+			const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(SceneColor.Texture->Desc.Extent, SceneColor.Texture->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+			SharedTarget = FScreenPassRenderTarget(GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.SharedViewOutput")), SceneColor.ViewRect, ERenderTargetLoadAction::ENoAction);
+		}
+
+		AddResamplePass(GraphBuilder, ViewInfo, SharedOutput, SharedTarget);
+		Output = SharedTarget;
+	}
+	else if (ViewData != nullptr && UpdateOutputReuse_RenderThread(View, *ViewData, SettleFrames, bKeepOutput))
+	{
+		INC_DWORD_STAT(STAT_MultipassPP_ReusedOutputs);
+
+		FRDGTextureRef ReusedTexture = GraphBuilder.RegisterExternalTexture(ViewData->ReusedOutput);
+		const FScreenPassTexture Reused(ReusedTexture, FIntRect(FIntPoint::ZeroValue, ReusedTexture->Desc.Extent));
+
+		if (InOutInputs.OverrideOutput.IsValid())
+		{
+			Output = CopyToOverrideOutput(GraphBuilder, ViewInfo, InOutInputs, Reused);
+		}
+		else
+		{
+			// The next pass may write to its input, so it gets a copy
+			FRDGTextureRef Copy = GraphBuilder.CreateTexture(ReusedTexture->Desc, TEXT("MultipassPP.ReusedOutputCopy"));
+			AddCopyTexturePass(GraphBuilder, ReusedTexture, Copy);
+			Output = FScreenPassTexture(Copy, Reused.ViewRect);
+		}
+	}
+	else
+	{
+		if (FrameCapture_RenderThread.IsValid())
+		{
+			TSharedPtr<IMultipassPPViewData> CaptureViewData = GetViewData(View);
+			if (!FrameCapture_RenderThread->HasCaptured() && CaptureViewData != nullptr)
+			{
+				FrameCapture_RenderThread->AddCapturePasses(GraphBuilder, InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor), *CaptureViewData);
+			}
+			else if (FrameCapture_RenderThread->Poll())
+			{
+				FrameCapture_RenderThread.Reset();
+			}
+		}
+
+		if (AutoSkipAction == EMultipassPPAutoSkipAction::Skip)
+		{
+			INC_DWORD_STAT(STAT_MultipassPP_AutoSkippedViews);
+			Output = ReturnUntouchedSceneColorForPostProcessing(GraphBuilder, View, ViewInfo, InOutInputs);
+		}
+		else
+		{
+			TGuardValue<int32> QualityGuard(ScalabilitySettings_RenderThread.Quality, AutoSkipAction == EMultipassPPAutoSkipAction::Downgrade ? 0 : ScalabilitySettings_RenderThread.Quality);
+			Output = PostProcessPass_RenderThread(GraphBuilder, View, InOutInputs, Pass);
+		}
+
+		// The output has settled, keep it around. Not while it's skipped or downgraded, it would be reused once the effect is back
+		if (bKeepOutput && Output.IsValid() && AutoSkipAction == EMultipassPPAutoSkipAction::None)
+		{
+			const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Output.ViewRect.Size(), Output.Texture->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+			FRDGTextureRef Kept = GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.ReusedOutput"));
+			AddCopyTexturePass(GraphBuilder, Output.Texture, Kept, Output.ViewRect.Min, FIntPoint::ZeroValue, Output.ViewRect.Size());
+			GraphBuilder.QueueTextureExtraction(Kept, &ViewData->ReusedOutput);
+		}
+	}
+
+	if (SharingKey != 0 && !SharedOutput.IsValid() && Output.IsValid())
+	{
+		PublishSharedViewOutput_RenderThread(GraphBuilder, SharingKey, Output);
+	}
+
+	if (CaptureTap_RenderThread.IsValid())
+	{
+		CaptureTap_RenderThread->AddCapturePass(GraphBuilder, Output, View.State != nullptr ? View.State->GetViewKey() : 0);
+	}
+
+	SceneTextures_RenderThread = nullptr;
+
+	return Output;
+}
+
+EMultipassPPAutoSkipAction FMultipassPPSceneExtension::UpdateImageStats_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FPostProcessMaterialInputs& InOutInputs, IMultipassPPViewData& ViewData)
+{
+	const int32 AutoSkipMode = FMath::Clamp(CVarMultipassPPAutoSkip.GetValueOnRenderThread(), 0, 2);
+	const bool bAutoSkip = AutoSkipMode > 0 && ScalabilitySettings_RenderThread.AutoSkipThreshold > 0.f;
+
+	if ((CVarMultipassPPImageStats.GetValueOnRenderThread() <= 0 && !bAutoSkip) || ViewInfo.GetFeatureLevel() < ERHIFeatureLevel::SM5)
+	{
+		ViewData.ImageStats.Reset();
+		ViewData.NumLowImpactResults = 0;
+		return EMultipassPPAutoSkipAction::None;
+	}
+
+	const EMultipassPPAutoSkipAction Action = AutoSkipMode == 1 ? EMultipassPPAutoSkipAction::Skip : EMultipassPPAutoSkipAction::Downgrade;
+
+	if (!ViewData.ImageStats.IsValid())
+	{
+		ViewData.ImageStats = MakeShared<FMultipassPPImageStats>();
+
+		// The view data owns the stats, and only this extension polls them
+		ViewData.ImageStats->SetCallback(FOnMultipassPPImageStats::CreateLambda([this, ViewDataPtr = &ViewData](const FMultipassPPImageStatsResult& Result)
+		{
+			const float Impact = GetImageStatsImpact(Result);
+			const float Threshold = ScalabilitySettings_RenderThread.AutoSkipThreshold;
+			ViewDataPtr->NumLowImpactResults = Impact >= 0.f && Impact < Threshold ? ViewDataPtr->NumLowImpactResults + 1 : 0;
+
+			const bool bSkipped = CVarMultipassPPAutoSkip.GetValueOnRenderThread() > 0 && Threshold > 0.f
+				&& ViewDataPtr->NumLowImpactResults >= CVarMultipassPPAutoSkipMeasurements.GetValueOnRenderThread();
+
+			FScopeLock Lock(&LatestImageStatsLock);
+			LatestImageStats.Stats = Result;
+			LatestImageStats.Impact = Impact;
+			LatestImageStats.AutoSkipAction = bSkipped
+				? (CVarMultipassPPAutoSkip.GetValueOnRenderThread() == 1 ? EMultipassPPAutoSkipAction::Skip : EMultipassPPAutoSkipAction::Downgrade)
+				: EMultipassPPAutoSkipAction::None;
+			bHasImageStats = true;
+		}));
+	}
+
+	// Always the input, so the effect keeps being measured while it's skipped
+	const FScreenPassTexture& SceneColor = InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor);
+	const int32 Interval = FMath::Max(CVarMultipassPPImageStatsInterval.GetValueOnRenderThread(), 1);
+	if (GFrameCounterRenderThread % Interval == 0)
+	{
+		ViewData.ImageStats->AddStatsPass(GraphBuilder, ViewInfo.ShaderMap, SceneColor, CVarMultipassPPImageStatsActiveThreshold.GetValueOnRenderThread());
 	}
+	else
+	{
+		ViewData.ImageStats->PollReadbacks();
+	}
+
+	if (!bAutoSkip || ViewData.NumLowImpactResults < CVarMultipassPPAutoSkipMeasurements.GetValueOnRenderThread())
+	{
+		return EMultipassPPAutoSkipAction::None;
+	}
+
+	return Action;
+}
+
+bool FMultipassPPSceneExtension::GetLatestImageStats(FMultipassPPEffectImageStats& OutStats) const
+{
+	FScopeLock Lock(&LatestImageStatsLock);
+	OutStats = LatestImageStats;
+	return bHasImageStats;
 }
 
 FScreenPassTexture FMultipassPPSceneExtension::PostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& InOutInputs, EPostProcessingPass Pass)
@@ -45,6 +387,29 @@ FScreenPassTexture FMultipassPPSceneExtension::PostProcessPass_RenderThread(FRDG
 	if (ViewData != nullptr)
 	{
 		FRDGTextureRef OutputTexture = GraphBuilder.RegisterExternalTexture(ViewData->GetRT());
+
+		// Reduced resolution, the effect renders into the top left of its RT and the result is upsampled to the scene color
+		if (ViewData->ResolutionFraction < 1.f)
+		{
+			const FIntPoint ScaledSize(
+				FMath::Clamp(FMath::CeilToInt(ViewInfo.ViewRect.Width() * ViewData->ResolutionFraction), 1, OutputTexture->Desc.Extent.X),
+				FMath::Clamp(FMath::CeilToInt(ViewInfo.ViewRect.Height() * ViewData->ResolutionFraction), 1, OutputTexture->Desc.Extent.Y));
+			const FScreenPassRenderTarget ScaledOutput(OutputTexture, FIntRect(FIntPoint::ZeroValue, ScaledSize), ERenderTargetLoadAction::ELoad);
+
+			AddPass_RenderThread(GraphBuilder, View, ViewInfo, SceneColor, ScaledOutput);
+
+			FScreenPassRenderTarget Output = InOutInputs.OverrideOutput;
+			if (!Output.IsValid())
+			{
+				FRDGTextureDesc Desc = SceneColor.Texture->Desc;
+				Desc.Flags |= TexCreate_RenderTargetable | TexCreate_ShaderResource;
+				Output = FScreenPassRenderTarget(GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.Upsampled")), SceneColor.ViewRect, ERenderTargetLoadAction::ENoAction);
+			}
+
+			AddResamplePass(GraphBuilder, ViewInfo, ScaledOutput, Output);
+			return MoveTemp(Output);
+		}
+
 		FScreenPassRenderTarget Output = FScreenPassRenderTarget(OutputTexture, ViewInfo.ViewRect, ERenderTargetLoadAction::ELoad);
 
 		AddPass_RenderThread(
@@ -66,24 +431,7 @@ FScreenPassTexture FMultipassPPSceneExtension::ReturnUntouchedSceneColorForPostP
 	// If OverrideOutput is valid, we need to write to it, even if we're bypassing pp rendering
 	if (InOutInputs.OverrideOutput.IsValid())
 	{
-		FCopyRectPS::FParameters* Parameters = GraphBuilder.AllocParameters<FCopyRectPS::FParameters>();
-		Parameters->InputTexture = InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor).Texture;
-		Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
-		Parameters->RenderTargets[0] = InOutInputs.OverrideOutput.GetRenderTargetBinding();
-
-		const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(View.FeatureLevel);
-
-		TShaderMapRef<FCopyRectPS> CopyPixelShader(GlobalShaderMap);
-		TShaderMapRef<FScreenPassVS> ScreenPassVS(GlobalShaderMap);
-
-		const FScreenPassTextureViewport InputViewport(InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor));
-		const FScreenPassTextureViewport OutputViewport(InOutInputs.OverrideOutput);
-
-		FRHIBlendState* CopyBlendState = FScreenPassPipelineState::FDefaultBlendState::GetRHI();
-		FRHIDepthStencilState* DepthStencilState = FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI();
-		AddDrawScreenPass(GraphBuilder, FRDGEventName(TEXT("ReturnUntouchedSceneColorForPostProcessing")), ViewInfo, OutputViewport, InputViewport, ScreenPassVS, CopyPixelShader, CopyBlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
-
-		return InOutInputs.OverrideOutput;
+		return CopyToOverrideOutput(GraphBuilder, ViewInfo, InOutInputs, InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor));
 	}
 	else
 	{
@@ -93,6 +441,61 @@ FScreenPassTexture FMultipassPPSceneExtension::ReturnUntouchedSceneColorForPostP
 	}
 }
 
+FScreenPassTexture FMultipassPPSceneExtension::CopyToOverrideOutput(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FPostProcessMaterialInputs& InOutInputs, const FScreenPassTexture& Texture) const
+{
+	if (!InOutInputs.OverrideOutput.IsValid() || InOutInputs.OverrideOutput.Texture == Texture.Texture)
+	{
+		return Texture;
+	}
+
+	FCopyRectPS::FParameters* Parameters = GraphBuilder.AllocParameters<FCopyRectPS::FParameters>();
+	Parameters->InputTexture = Texture.Texture;
+	Parameters->InputSampler = TStaticSamplerState<>::GetRHI();
+	Parameters->RenderTargets[0] = InOutInputs.OverrideOutput.GetRenderTargetBinding();
+
+	const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(ViewInfo.FeatureLevel);
+
+	TShaderMapRef<FCopyRectPS> CopyPixelShader(GlobalShaderMap);
+	TShaderMapRef<FScreenPassVS> ScreenPassVS(GlobalShaderMap);
+
+	const FScreenPassTextureViewport InputViewport(Texture);
+	const FScreenPassTextureViewport OutputViewport(InOutInputs.OverrideOutput);
+
+	FRHIBlendState* CopyBlendState = FScreenPassPipelineState::FDefaultBlendState::GetRHI();
+	FRHIDepthStencilState* DepthStencilState = FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI();
+	AddDrawScreenPass(GraphBuilder, FRDGEventName(TEXT("CopyToOverrideOutput")), ViewInfo, OutputViewport, InputViewport, ScreenPassVS, CopyPixelShader, CopyBlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
+
+	return InOutInputs.OverrideOutput;
+}
+
+void FMultipassPPSceneExtension::AddResamplePass(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output) const
+{
+	FCopyRectPS::FParameters* Parameters = GraphBuilder.AllocParameters<FCopyRectPS::FParameters>();
+	Parameters->InputTexture = Input.Texture;
+	Parameters->InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
+	Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+
+	const FGlobalShaderMap* GlobalShaderMap = GetGlobalShaderMap(ViewInfo.FeatureLevel);
+
+	TShaderMapRef<FCopyRectPS> CopyPixelShader(GlobalShaderMap);
+	TShaderMapRef<FScreenPassVS> ScreenPassVS(GlobalShaderMap);
+
+	FRHIBlendState* CopyBlendState = FScreenPassPipelineState::FDefaultBlendState::GetRHI();
+	FRHIDepthStencilState* DepthStencilState = FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI();
+	AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("%s Upsample %dx%d -> %dx%d", *PostProcessingPassName, Input.ViewRect.Width(), Input.ViewRect.Height(), Output.ViewRect.Width(), Output.ViewRect.Height()),
+		ViewInfo, FScreenPassTextureViewport(Output), FScreenPassTextureViewport(Input), ScreenPassVS, CopyPixelShader, CopyBlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
+}
+
+ETextureRenderTargetFormat FMultipassPPViewData::GetEffectiveRTPixelFormat() const
+{
+	return bUseCompactFormat && RTCompactPixelFormat.IsSet() ? RTCompactPixelFormat.GetValue() : RTPixelFormat;
+}
+
+SIZE_T FMultipassPPViewData::ComputeGPUMemorySize_RenderThread() const
+{
+	return RT.IsValid() ? RT->ComputeMemorySize() : 0;
+}
+
 void FMultipassPPViewData::SetupRT(const FIntPoint& Resolution)
 {
 	if (Resolution.X <= 0 || Resolution.Y <= 0)
@@ -100,6 +503,8 @@ void FMultipassPPViewData::SetupRT(const FIntPoint& Resolution)
 		return;
 	}
 
+	const EPixelFormat PixelFormat = GetPixelFormatFromRenderTargetFormat(GetEffectiveRTPixelFormat());
+
 	bool bCreateRT = false;
 	if (!RT.IsValid())
 	{
@@ -108,7 +513,7 @@ void FMultipassPPViewData::SetupRT(const FIntPoint& Resolution)
 	else
 	{
 		FIntVector TexSize = RT->GetDesc().GetSize();
-		if (TexSize.X != Resolution.X || TexSize.Y != Resolution.Y)
+		if (TexSize.X != Resolution.X || TexSize.Y != Resolution.Y || RT->GetDesc().Format != PixelFormat)
 		{
 			bCreateRT = true;
 		}
@@ -120,9 +525,11 @@ void FMultipassPPViewData::SetupRT(const FIntPoint& Resolution)
 		{
 			if (IsInRenderingThread())
 			{
+				LLM_SCOPE_BYTAG(MultipassPP);
+
 				const FPooledRenderTargetDesc Desc = FPooledRenderTargetDesc::Create2DDesc(
 					Resolution,
-					GetPixelFormatFromRenderTargetFormat(RTPixelFormat),
+					PixelFormat,
 					RTClearValueBinding,
 					TexCreate_None,
 					TexCreate_ShaderResource | TexCreate_RenderTargetable | ETextureCreateFlags::UAV,
@@ -133,11 +540,13 @@ void FMultipassPPViewData::SetupRT(const FIntPoint& Resolution)
 			else
 			{
 				ENQUEUE_RENDER_COMMAND(FlushRHIThreadToUpdateTextureRenderTargetReference)(
-				[SharedThis = SharedThis(this), Resolution](FRHICommandListImmediate& RHICmdList)
+				[SharedThis = SharedThis(this), Resolution, PixelFormat](FRHICommandListImmediate& RHICmdList)
 				{
+					LLM_SCOPE_BYTAG(MultipassPP);
+
 					const FPooledRenderTargetDesc Desc = FPooledRenderTargetDesc::Create2DDesc(
 						Resolution,
-						GetPixelFormatFromRenderTargetFormat(SharedThis->RTPixelFormat),
+						PixelFormat,
 						SharedThis->RTClearValueBinding,
 						TexCreate_None,
 						TexCreate_ShaderResource | TexCreate_RenderTargetable | ETextureCreateFlags::UAV,
@@ -150,15 +559,18 @@ void FMultipassPPViewData::SetupRT(const FIntPoint& Resolution)
 	}
 }
 
-TSharedPtr<IMultipassPPViewData> FMultipassPPSceneExtension::GetViewData(const FSceneView& InView)
+TSharedPtr<IMultipassPPViewData> FMultipassPPSceneExtension::GetViewData(const FSceneView& InView) const
 {
 	if (InView.State == nullptr)
 	{
 		return nullptr;
 	}
 
+	INC_DWORD_STAT(STAT_MultipassPP_ViewDataLookups);
+
 	const uint32 Index = InView.State->GetViewKey();
-	TSharedPtr<IMultipassPPViewData>* FoundData = ViewDataMap.Find(Index);
+	FReadScopeLock Lock(ViewDataMapLock);
+	const TSharedPtr<IMultipassPPViewData>* FoundData = ViewDataMap.Find(Index);
 	return FoundData ? *FoundData : nullptr;
 }
 
@@ -169,12 +581,25 @@ TSharedPtr<IMultipassPPViewData> FMultipassPPSceneExtension::GetOrCreateViewData
 		return nullptr;
 	}
 
+	INC_DWORD_STAT(STAT_MultipassPP_ViewDataLookups);
+
+	check(IsInGameThread());
+
 	const uint32 Index = InView.State->GetViewKey();
-	TSharedPtr<IMultipassPPViewData>& ViewData = ViewDataMap.FindOrAdd(Index);
-	if (!ViewData.IsValid())
+	if (TSharedPtr<IMultipassPPViewData>* FoundData = ViewDataMap.Find(Index))
 	{
-		ViewData = ConstructViewData(InView);
+		if (FoundData->IsValid())
+		{
+			return *FoundData;
+		}
 	}
+
+	INC_DWORD_STAT(STAT_MultipassPP_ViewDataCreated);
+	TSharedPtr<IMultipassPPViewData> ViewData = ConstructViewData(InView);
+
+	// The render thread may be looking up other views while the map grows
+	FWriteScopeLock Lock(ViewDataMapLock);
+	ViewDataMap.Add(Index, ViewData);
 	return ViewData;
 }
 
@@ -183,6 +608,389 @@ TSharedPtr<IMultipassPPViewData> FMultipassPPSceneExtension::ConstructViewData(c
 	return MakeShared<FMultipassPPViewData>();
 }
 
+SIZE_T FMultipassPPSceneExtension::GetGPUMemorySize() const
+{
+	FReadScopeLock Lock(ViewDataMapLock);
+	SIZE_T Size = 0;
+	for (const TPair<uint32, TSharedPtr<IMultipassPPViewData>>& It : ViewDataMap)
+	{
+		if (It.Value.IsValid())
+		{
+			Size += It.Value->GetGPUMemorySize();
+		}
+	}
+	return Size;
+}
+
+SIZE_T FMultipassPPSceneExtension::EvictViewData(uint32 ViewKey)
+{
+	check(IsInGameThread());
+
+	TSharedPtr<IMultipassPPViewData> ViewData;
+	{
+		FWriteScopeLock Lock(ViewDataMapLock);
+		if (!ViewDataMap.RemoveAndCopyValue(ViewKey, ViewData) || !ViewData.IsValid())
+		{
+			return 0;
+		}
+	}
+
+	const SIZE_T Size = ViewData->GetGPUMemorySize();
+
+	// The render thread may still be using the targets for a frame in flight, so let it drop the last reference
+	ENQUEUE_RENDER_COMMAND(MultipassPPEvictViewData)(
+	[ViewData = MoveTemp(ViewData)](FRHICommandListImmediate& RHICmdList) mutable
+	{
+		ViewData.Reset();
+	});
+
+	return Size;
+}
+
+bool FMultipassPPSceneExtension::UpdateOutputReuse_RenderThread(const FSceneView& View, IMultipassPPViewData& ViewData, int32 SettleFrames, bool& bOutKeepOutput)
+{
+	const int32 Mode = CVarMultipassPPOutputReuse.GetValueOnRenderThread();
+	const bool bWorldIsPaused = View.Family != nullptr && View.Family->bWorldIsPaused;
+	const bool bSceneIsStatic = (Mode >= 1 && bWorldIsPaused) || (Mode >= 2 && GMultipassPPSceneStaticHint.load(std::memory_order_relaxed));
+
+	// Without the TAA/TSR jitter, it moves the projection every frame
+	const FMatrix ViewProjectionMatrix = View.ViewMatrices.GetViewMatrix() * View.ViewMatrices.GetProjectionNoAAMatrix();
+	uint32 Hash = GetOutputReuseParameterHash(View);
+	Hash = FCrc::MemCrc32(&View.UnconstrainedViewRect, sizeof(FIntRect), Hash);
+	Hash = FCrc::MemCrc32(&ViewProjectionMatrix, sizeof(FMatrix), Hash);
+
+	bOutKeepOutput = false;
+
+	if (!bSceneIsStatic || Hash != ViewData.OutputReuseHash)
+	{
+		ViewData.OutputReuseHash = Hash;
+		ViewData.NumUnchangedFrames = 0;
+		ViewData.ReusedOutput.SafeRelease();
+		bOutKeepOutput = bSceneIsStatic && SettleFrames == 0;
+		return false;
+	}
+
+	ViewData.NumUnchangedFrames = FMath::Min(ViewData.NumUnchangedFrames + 1, MAX_int32 - 1);
+	if (ViewData.ReusedOutput.IsValid())
+	{
+		return true;
+	}
+
+	bOutKeepOutput = ViewData.NumUnchangedFrames >= SettleFrames;
+	return false;
+}
+
+uint32 FMultipassPPSceneExtension::GetViewSharingKey_RenderThread(const FSceneView& View, EPostProcessingPass Pass, const FScreenPassTexture& SceneColor)
+{
+	// Effects with a history are left out. A view that consumes another's output doesn't update its own history, which would
+	// be stale once the view stops sharing
+	const uint32* Group = View.State != nullptr ? GMultipassPPViewSharingGroups.Find(View.State->GetViewKey()) : nullptr;
+	if ((Group == nullptr && CVarMultipassPPShareViews.GetValueOnRenderThread() == 0) || GetOutputReuseSettleFrames(View) != 0)
+	{
+		return 0;
+	}
+
+	uint32 Hash = HashCombine(GetOutputReuseParameterHash(View), ::GetTypeHash((int32)Pass));
+	if (Group != nullptr)
+	{
+		Hash = HashCombine(Hash, ::GetTypeHash(*Group));
+	}
+	else
+	{
+		// Views of a different size but the same aspect ratio and field of view have the same matrix, and get a resampled output.
+		// Without the TAA/TSR jitter, which differs between views
+		const FMatrix ViewProjectionMatrix = View.ViewMatrices.GetViewMatrix() * View.ViewMatrices.GetProjectionNoAAMatrix();
+		Hash = FCrc::MemCrc32(&ViewProjectionMatrix, sizeof(FMatrix), Hash);
+
+		// The same camera can still see a different world, or render it differently
+		Hash = HashCombine(Hash, ::GetTypeHash(View.Family->Scene));
+		Hash = FCrc::MemCrc32(&View.Family->EngineShowFlags, sizeof(FEngineShowFlags), Hash);
+		if (SceneColor.IsValid())
+		{
+			Hash = HashCombine(Hash, HashCombine(::GetTypeHash((int32)SceneColor.Texture->Desc.Format), ::GetTypeHash(SceneColor.Texture->Desc.Extent)));
+		}
+	}
+	return Hash != 0 ? Hash : 1;
+}
+
+FScreenPassTexture FMultipassPPSceneExtension::FindSharedViewOutput_RenderThread(FRDGBuilder& GraphBuilder, uint32 SharingKey)
+{
+	if (const FMultipassPPSharedViewOutputs* InGraph = GraphBuilder.Blackboard.Get<FMultipassPPSharedViewOutputs>())
+	{
+		if (const FScreenPassTexture* Found = InGraph->Outputs.Find(MakeTuple((const FMultipassPPSceneExtension*)this, SharingKey)))
+		{
+			return *Found;
+		}
+	}
+
+	TSharedPtr<FSharedViewOutput> Shared = SharedViewOutputs_RenderThread.FindRef(SharingKey);
+	if (!Shared.IsValid() || Shared->ProducedFrame != GFrameCounterRenderThread)
+	{
+		return FScreenPassTexture();
+	}
+
+	// Produced by an earlier graph this frame. If it wasn't kept, ask for it so it is from the next frame on
+	Shared->WantedFrame = GFrameCounterRenderThread;
+	if (!Shared->Extracted.IsValid())
+	{
+		return FScreenPassTexture();
+	}
+
+	return FScreenPassTexture(GraphBuilder.RegisterExternalTexture(Shared->Extracted), Shared->ViewRect);
+}
+
+void FMultipassPPSceneExtension::PublishSharedViewOutput_RenderThread(FRDGBuilder& GraphBuilder, uint32 SharingKey, const FScreenPassTexture& Output)
+{
+	const uint64 FrameNumber = GFrameCounterRenderThread;
+
+	// Keys change with the camera, so drop the ones nobody produced recently
+	for (auto It = SharedViewOutputs_RenderThread.CreateIterator(); It; ++It)
+	{
+		if (It.Value()->ProducedFrame + 2 < FrameNumber)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	// The output may be written again by later passes of this view, so the next views get a copy
+	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(Output.ViewRect.Size(), Output.Texture->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+	FRDGTextureRef Copy = GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.SharedViewOutput"));
+	AddCopyTexturePass(GraphBuilder, Output.Texture, Copy, Output.ViewRect.Min, FIntPoint::ZeroValue, Output.ViewRect.Size());
+	const FScreenPassTexture SharedOutput(Copy, FIntRect(FIntPoint::ZeroValue, Output.ViewRect.Size()));
+
+	GraphBuilder.Blackboard.GetOrCreate<FMultipassPPSharedViewOutputs>().Outputs.Add(MakeTuple((const FMultipassPPSceneExtension*)this, SharingKey), SharedOutput);
+
+	TSharedPtr<FSharedViewOutput>& Shared = SharedViewOutputs_RenderThread.FindOrAdd(SharingKey);
+	if (!Shared.IsValid())
+	{
+		Shared = MakeShared<FSharedViewOutput>();
+	}
+	Shared->ProducedFrame = FrameNumber;
+	Shared->ViewRect = SharedOutput.ViewRect;
+
+	// Only kept past the graph when a view in another graph, e.g. another window, wanted it recently
+	if (Shared->WantedFrame + 2 >= FrameNumber && Shared->WantedFrame != 0)
+	{
+		GraphBuilder.QueueTextureExtraction(Copy, &Shared->Extracted);
+	}
+	else
+	{
+		Shared->Extracted.SafeRelease();
+	}
+}
+
+void FMultipassPPSceneExtension::SetViewSharingGroup(uint32 ViewKey, uint32 Group)
+{
+	check(IsInGameThread());
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPSetViewSharingGroup)(
+		[ViewKey, Group](FRHICommandListImmediate& RHICmdList)
+		{
+			if (Group != 0)
+			{
+				GMultipassPPViewSharingGroups.Add(ViewKey, Group);
+			}
+			else
+			{
+				GMultipassPPViewSharingGroups.Remove(ViewKey);
+			}
+		});
+}
+
+void FMultipassPPSceneExtension::SetSceneStaticHint(bool bInSceneIsStatic)
+{
+	GMultipassPPSceneStaticHint.store(bInSceneIsStatic, std::memory_order_relaxed);
+}
+
+void FMultipassPPSceneExtension::SetRegionMask(const FMultipassPPRegionMask& InRegionMask)
+{
+	check(IsInGameThread());
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPSetRegionMask)(
+		[this, InRegionMask](FRHICommandListImmediate& RHICmdList)
+		{
+			RegionMask_RenderThread = InRegionMask;
+		});
+}
+
+FRDGTextureRef FMultipassPPSceneExtension::AddRegionMaskPass_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassRenderTarget& Output) const
+{
+	return AddMultipassPPRegionMaskPass(GraphBuilder, ViewInfo, SceneTextures_RenderThread, RegionMask_RenderThread, Output);
+}
+
+void FMultipassPPSceneExtension::PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap)
+{
+	check(IsInRenderingThread());
+
+	// The bypass, CopyToOverrideOutput, output reuse and upsample copies
+	TShaderMapRef<FScreenPassVS> VertexShader(ShaderMap);
+	TShaderMapRef<FCopyRectPS> CopyPixelShader(ShaderMap);
+	const TConstArrayView<EPixelFormat> SceneColorFormats = MultipassPPPSOPrecache::GetSceneColorFormats();
+	MultipassPPPSOPrecache::PrecacheScreenPassForFormats(RHICmdList, VertexShader, CopyPixelShader, FScreenPassPipelineState::FDefaultBlendState::GetRHI(), FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI(), SceneColorFormats);
+
+	if (RegionMask_RenderThread.IsEnabled())
+	{
+		FMultipassPPRegionMaskPS::FPermutationDomain PermutationVector;
+		PermutationVector.Set<FMultipassPPRegionMaskPS::FModeDim>((int32)RegionMask_RenderThread.Mode);
+		TShaderMapRef<FMultipassPPRegionMaskPS> MaskPixelShader(ShaderMap, PermutationVector);
+
+		FRHIDepthStencilState* MaskDepthStencilState = TStaticDepthStencilState<false, CF_Always, true, CF_Always, SO_Keep, SO_Keep, SO_SaturatedIncrement, true, CF_Always, SO_Keep, SO_Keep, SO_SaturatedIncrement>::GetRHI();
+		MultipassPPPSOPrecache::PrecacheScreenPass(RHICmdList, VertexShader, MaskPixelShader, TStaticBlendState<CW_NONE>::GetRHI(), MaskDepthStencilState, {}, PF_DepthStencil, FExclusiveDepthStencil::DepthWrite_StencilWrite);
+
+		for (EPixelFormat Format : SceneColorFormats)
+		{
+			MultipassPPPSOPrecache::PrecacheScreenPass(RHICmdList, VertexShader, CopyPixelShader, FScreenPassPipelineState::FDefaultBlendState::GetRHI(), MultipassPPRegionMask::GetExcludedDepthStencilState(), MakeArrayView(&Format, 1), PF_DepthStencil);
+		}
+	}
+}
+
+void FMultipassPPSceneExtension::GetViewDataPixelFormats(TArray<EPixelFormat>& OutFormats) const
+{
+	const FMultipassPPViewData Defaults;
+	OutFormats.Add(GetPixelFormatFromRenderTargetFormat(Defaults.RTPixelFormat));
+}
+
+void FMultipassPPSceneExtension::SetCaptureTap(TSharedPtr<FMultipassPPCaptureTap, ESPMode::ThreadSafe> InCaptureTap)
+{
+	check(IsInGameThread());
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPSetCaptureTap)(
+		[this, CaptureTap = MoveTemp(InCaptureTap)](FRHICommandListImmediate& RHICmdList) mutable
+		{
+			CaptureTap_RenderThread = MoveTemp(CaptureTap);
+		});
+}
+
+void FMultipassPPSceneExtension::CaptureNextFrame(const FString& Filename)
+{
+	check(IsInGameThread());
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPCaptureNextFrame)(
+		[this, Request = MakeShared<FMultipassPPFrameCaptureRequest>(RegisteredName, Filename)](FRHICommandListImmediate& RHICmdList) mutable
+		{
+			FrameCapture_RenderThread = MoveTemp(Request);
+		});
+}
+
+void FMultipassPPSceneExtension::StartReplay(TSharedRef<const FMultipassPPFrameCapture, ESPMode::ThreadSafe> Capture, int32 NumIterations, bool bQuitWhenDone)
+{
+	check(IsInGameThread());
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPStartReplay)(
+		[this, Replay = MakeShared<FMultipassPPReplay>(MoveTemp(Capture), NumIterations, bQuitWhenDone)](FRHICommandListImmediate& RHICmdList) mutable
+		{
+			Replay_RenderThread = MoveTemp(Replay);
+		});
+}
+
+void FMultipassPPSceneExtension::AddReplayPasses_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& InOutInputs, EPostProcessingPass Pass)
+{
+	FMultipassPPReplay& Replay = *Replay_RenderThread;
+	const FMultipassPPFrameCapture& Capture = Replay.GetCapture();
+
+	TSharedPtr<IMultipassPPViewData> ViewData = GetViewData(View);
+	if (ViewData == nullptr)
+	{
+		return;
+	}
+
+	// Effects size their targets and dispatches from the view, so the inputs have to match it
+	const FIntPoint SceneColorSize = InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor).ViewRect.Size();
+	if (SceneColorSize != Capture.SceneColorSize)
+	{
+		UE_LOG(LogMultipassPP, Warning, TEXT("MultipassPP replay: the capture is %dx%d but the view is %dx%d, use r.SetRes %dx%d"),
+			Capture.SceneColorSize.X, Capture.SceneColorSize.Y, SceneColorSize.X, SceneColorSize.Y, Capture.SceneColorSize.X, Capture.SceneColorSize.Y);
+		Replay_RenderThread.Reset();
+		return;
+	}
+
+	RDG_EVENT_SCOPE(GraphBuilder, "%s Replay x%d", *PostProcessingPassName, Replay.GetNumIterations());
+
+	// The view's own state, put back once the replay is done
+	TArray<uint8> SavedParameters;
+	FMemoryWriter Writer(SavedParameters);
+	ViewData->SerializeParameters(Writer);
+
+	FRDGTextureRef ViewDataTexture = ViewData->GetRT().IsValid() ? GraphBuilder.RegisterExternalTexture(ViewData->GetRT()) : nullptr;
+	FRDGTextureRef History = Replay.RegisterHistory(GraphBuilder);
+	const bool bRestoreHistory = ViewDataTexture != nullptr && History != nullptr
+		&& ViewDataTexture->Desc.Extent == History->Desc.Extent && ViewDataTexture->Desc.Format == History->Desc.Format;
+	UE_CLOG(History != nullptr && !bRestoreHistory, LogMultipassPP, Warning, TEXT("MultipassPP replay: the captured history doesn't match the view data RT, replaying with the view's history"));
+
+	FRDGTextureRef SavedHistory = nullptr;
+	if (bRestoreHistory)
+	{
+		SavedHistory = GraphBuilder.CreateTexture(ViewDataTexture->Desc, TEXT("MultipassPP.ReplaySavedHistory"));
+		AddCopyTexturePass(GraphBuilder, ViewDataTexture, SavedHistory);
+	}
+
+	FPostProcessMaterialInputs ReplayInputs = InOutInputs;
+	ReplayInputs.SetInput(EPostProcessMaterialInput::SceneColor, Replay.RegisterSceneColor(GraphBuilder));
+	ReplayInputs.OverrideOutput = FScreenPassRenderTarget();
+
+	for (int32 Iteration = 0; Iteration < Replay.GetNumIterations(); ++Iteration)
+	{
+		// Every run starts from the captured state, so they all do the same work
+		if (bRestoreHistory)
+		{
+			AddCopyTexturePass(GraphBuilder, History, ViewDataTexture);
+		}
+		FMemoryReader Reader(Capture.Parameters);
+		ViewData->SerializeParameters(Reader);
+
+		Replay.AddTimestampPass(GraphBuilder);
+		const FScreenPassTexture Output = PostProcessPass_RenderThread(GraphBuilder, View, ReplayInputs, Pass);
+		Replay.AddTimestampPass(GraphBuilder);
+
+		Replay.KeepOutput(GraphBuilder, Output.Texture);
+	}
+
+	if (bRestoreHistory)
+	{
+		AddCopyTexturePass(GraphBuilder, SavedHistory, ViewDataTexture);
+	}
+	FMemoryReader Reader(SavedParameters);
+	ViewData->SerializeParameters(Reader);
+
+	Replay.MarkRun();
+}
+
+void FMultipassPPSceneExtension::SetScalabilitySettings(const FMultipassPPScalabilitySettings& InSettings)
+{
+	check(IsInGameThread());
+
+	if (ScalabilitySettings == InSettings)
+	{
+		return;
+	}
+
+	ScalabilitySettings = InSettings;
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPSetScalabilitySettings)(
+		[this, InSettings](FRHICommandListImmediate& RHICmdList)
+		{
+			ScalabilitySettings_RenderThread = InSettings;
+		});
+}
+
+void FMultipassPPSceneExtension::SetUseCompactFormats(bool bInUseCompactFormats)
+{
+	check(IsInGameThread());
+
+	if (bUseCompactFormats == bInUseCompactFormats)
+	{
+		return;
+	}
+
+	bUseCompactFormats = bInUseCompactFormats;
+
+	ENQUEUE_RENDER_COMMAND(MultipassPPSetUseCompactFormats)(
+		[this, bInUseCompactFormats](FRHICommandListImmediate& RHICmdList)
+		{
+			bUseCompactFormats_RenderThread = bInUseCompactFormats;
+		});
+}
+
 size_t FMultipassPPSceneExtension::GetTypeHash() const
 {
 	static size_t UniquePointer;
@@ -0,0 +1,47 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPSeparableFilter.h"
+
+IMPLEMENT_MULTIPASSPP_SEPARABLE_FILTER(FMultipassPPGaussianKernel);
+
+FString MultipassPPSeparableFilter::GetKernelWeightsDefine(int32 Radius, TFunctionRef<float(int32)> GetWeight)
+{
+	TArray<float, TInlineAllocator<GroupSize + 1>> Weights;
+	float WeightSum = 0.f;
+	for (int32 Offset = 0; Offset <= Radius; ++Offset)
+	{
+		const float Weight = FMath::Max(GetWeight(Offset), 0.f);
+		Weights.Add(Weight);
+		WeightSum += Offset == 0 ? Weight : 2.f * Weight;
+	}
+
+	check(WeightSum > 0.f);
+
+	FString Define;
+	for (int32 Offset = 0; Offset <= Radius; ++Offset)
+	{
+		Define += FString::Printf(TEXT("%s%.9g"), Offset > 0 ? TEXT(", ") : TEXT(""), Weights[Offset] / WeightSum);
+	}
+	return Define;
+}
+
+FMultipassPPSeparableFilterParameters* MultipassPPSeparableFilter::AllocParameters(FRDGBuilder& GraphBuilder, const FScreenPassTexture& Input, FRDGTextureRef Output, const FIntRect& OutputRect)
+{
+	const FIntPoint InputExtent = Input.Texture->Desc.Extent;
+	const FVector2f InvInputExtent(1.f / InputExtent.X, 1.f / InputExtent.Y);
+	const FVector2f InputToOutputScale = FVector2f(Input.ViewRect.Size()) / FVector2f(OutputRect.Size());
+
+	FMultipassPPSeparableFilterParameters* Parameters = GraphBuilder.AllocParameters<FMultipassPPSeparableFilterParameters>();
+	Parameters->InputTexture = Input.Texture;
+	Parameters->InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
+
+	// Clamped half a texel in so the bilinear prefilter never reads outside of the view
+	Parameters->InputUVMin = (FVector2f(Input.ViewRect.Min) + 0.5f) * InvInputExtent;
+	Parameters->InputUVMax = (FVector2f(Input.ViewRect.Max) - 0.5f) * InvInputExtent;
+	Parameters->InputViewOrigin = FVector2f(Input.ViewRect.Min) * InvInputExtent;
+	Parameters->OutputPixelToInputUV = InputToOutputScale * InvInputExtent;
+	Parameters->OutputViewMin = OutputRect.Min;
+	Parameters->OutputViewSize = OutputRect.Size();
+	Parameters->OutputTexture = GraphBuilder.CreateUAV(Output);
+	return Parameters;
+}
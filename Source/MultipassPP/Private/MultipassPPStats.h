@@ -0,0 +1,8 @@
+#pragma once
+
+#include "Stats/Stats.h"
+#include "HAL/LowLevelMemTracker.h"
+
+DECLARE_STATS_GROUP(TEXT("MultipassPP"), STATGROUP_MultipassPP, STATCAT_Advanced);
+
+LLM_DECLARE_TAG(MultipassPP);
@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SMAABlendable.h"
+
+#include "MultipassPPEffectRegistry.h"
+#include "SMAASceneExtension.h"
+
+#include "Runtime/Launch/Resources/Version.h"
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 3
+#include "SceneRendering.h"
+#endif
+
+
+void USMAABlendable::OverrideBlendableSettings(FSceneView& View, float Weight) const
+{
+	check(Weight > 0.0f && Weight <= 1.0f);
+
+	if (!View.State)
+	{
+		return;
+	}
+
+	// The extension is created on first use, so it starts rendering the frame after the blendable is first applied
+	FMultipassPPEffectRegistry::Get().RequestEffect(FSMAASceneExtension::GetEffectName());
+
+	FFinalPostProcessSettings& Dest = View.FinalPostProcessSettings;
+
+	FSMAANode Node;
+	Node.Threshold = Threshold;
+	FSMAANode* PushedNode = Dest.BlendableManager.PushBlendableData(Weight, Node);
+}
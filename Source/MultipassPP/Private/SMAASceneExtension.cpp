@@ -0,0 +1,185 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SMAASceneExtension.h"
+
+#include "SMAABlendable.h"
+#include "PostProcess/PostProcessing.h"
+#include "PostProcess/PostProcessMaterial.h"
+#include "RenderGraphUtils.h"
+#include "MultipassPPEffectRegistry.h"
+
+static TAutoConsoleVariable<int32> CVarSMAAEnabled(
+	TEXT("r.SMAA.Enabled"),
+	-1,
+	TEXT("-1: use the SMAA blendables (default)\n")
+	TEXT(" 0: off\n")
+	TEXT(" 1: on for every view"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSMAAThreshold(
+	TEXT("r.SMAA.Threshold"),
+	-1.f,
+	TEXT("Smallest luma difference between two pixels that counts as an edge, 0.05 to 0.2 are sensible. -1 uses the blendables (default)"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarSMAAQuality(
+	TEXT("r.SMAA.Quality"),
+	2,
+	TEXT("How far the blending weight pass follows an edge to find its ends. Longer edges than this get less anti-aliased.\n")
+	TEXT(" 0: 4 pixels each way\n")
+	TEXT(" 1: 8 pixels each way\n")
+	TEXT(" 2: 16 pixels each way (default)\n")
+	TEXT(" 3: 32 pixels each way"),
+	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+static FMultipassPPEffectRegistration SMAARegistration(
+	FSMAASceneExtension::GetEffectName(),
+	[]() -> TSharedPtr<FMultipassPPSceneExtension> { return FSceneViewExtensions::NewExtension<FSMAASceneExtension>(); },
+	{ TEXT("r.SMAA.Enabled") });
+
+IMPLEMENT_GLOBAL_SHADER(FSMAAEdgeDetectionPS, "/MultipassPP/Private/SMAA.usf", "EdgeDetectionPS", SF_Pixel);
+IMPLEMENT_GLOBAL_SHADER(FSMAABlendingWeightPS, "/MultipassPP/Private/SMAA.usf", "BlendingWeightPS", SF_Pixel);
+IMPLEMENT_GLOBAL_SHADER(FSMAANeighborhoodBlendingPS, "/MultipassPP/Private/SMAA.usf", "NeighborhoodBlendingPS", SF_Pixel);
+
+bool FSMAAEdgeDetectionPS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FSMAASceneExtension::GetEffectName());
+}
+
+bool FSMAABlendingWeightPS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FSMAASceneExtension::GetEffectName());
+}
+
+bool FSMAANeighborhoodBlendingPS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return FMultipassPPEffectRegistry::ShouldCompileEffectShaders(FSMAASceneExtension::GetEffectName());
+}
+
+FSMAASceneExtension::FSMAASceneExtension(const FAutoRegister& AutoReg)
+	: BaseT(AutoReg)
+{
+	PostProcessingPassName = "SMAA";
+	PostProcessingPasses = { EPostProcessingPass::FXAA };
+}
+
+void FSMAASceneExtension::SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& InViewData)
+{
+	FSMAAViewData& ViewData = static_cast<FSMAAViewData&>(InViewData);
+
+	const int32 EnabledCVar = CVarSMAAEnabled.GetValueOnAnyThread();
+	const float ThresholdCVar = CVarSMAAThreshold.GetValueOnAnyThread();
+
+	float BlendableWeight = 0.f;
+	float BlendableThreshold = 0.f;
+	int32 NumEntries = 0;
+	if (EnabledCVar < 0 || ThresholdCVar < 0.f)
+	{
+		NumEntries = ForEachBlendable<FSMAANode>(View, [&](const FSMAANode& Node, float Weight)
+		{
+			BlendableWeight += Weight;
+			BlendableThreshold += Node.Threshold;
+		});
+	}
+
+	ViewData.BlendableWeight = EnabledCVar >= 0 ? FMath::Clamp(EnabledCVar, 0, 1) : (NumEntries > 0 ? BlendableWeight / NumEntries : 0.f);
+
+	// Enabled by the cvar without a blendable to take the threshold from
+	const float Threshold = ThresholdCVar >= 0.f ? ThresholdCVar : (NumEntries > 0 ? BlendableThreshold / NumEntries : 0.1f);
+	ViewData.Threshold = FMath::Clamp(Threshold, 0.01f, 0.5f);
+}
+
+bool FSMAASceneExtension::IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const
+{
+	check(IsInGameThread());
+
+	bool bIsActive = true;
+	if (CVarSMAAEnabled.GetValueOnGameThread() > -1)
+	{
+		bIsActive = CVarSMAAEnabled.GetValueOnGameThread() > 0;
+	}
+
+	return BaseT::IsActiveThisFrame_Internal(Context) && bIsActive;
+}
+
+FScreenPassTexture FSMAASceneExtension::PostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& InOutInputs, EPostProcessingPass Pass)
+{
+	checkSlow(View.bIsViewInfo);
+	const FViewInfo& ViewInfo = static_cast<const FViewInfo&>(View);
+
+	TSharedPtr<FSMAAViewData> ViewData = StaticCastSharedPtr<FSMAAViewData>(GetViewData(View));
+	if (ViewData != nullptr && ViewData->BlendableWeight > 0)
+	{
+		FScreenPassTexture Output = BaseT::PostProcessPass_RenderThread(GraphBuilder, View, InOutInputs, Pass);
+		EdgeStencil = nullptr;
+		return Output;
+	}
+
+	return ReturnUntouchedSceneColorForPostProcessing(GraphBuilder, View, ViewInfo, InOutInputs);
+}
+
+uint32 FSMAASceneExtension::GetOutputReuseParameterHash(const FSceneView& View)
+{
+	TSharedPtr<FSMAAViewData> ViewData = StaticCastSharedPtr<FSMAAViewData>(GetViewData(View));
+	return ViewData != nullptr ? HashCombine(::GetTypeHash(ViewData->Threshold), ::GetTypeHash(GetMaxSearchSteps())) : 0;
+}
+
+int32 FSMAASceneExtension::GetQuality() const
+{
+	const int32 Quality = ScalabilitySettings_RenderThread.Quality >= 0 ? ScalabilitySettings_RenderThread.Quality : CVarSMAAQuality.GetValueOnRenderThread();
+	return FMath::Clamp(Quality, 0, MaxQuality);
+}
+
+int32 FSMAASceneExtension::GetMaxSearchSteps() const
+{
+	// Same search lengths as SMAA's low to ultra presets
+	return 4 << GetQuality();
+}
+
+static void SetupViewParameters(const FScreenPassTexture& Input, FVector2f& OutExtent, FIntPoint& OutViewMin, FIntPoint& OutViewMax)
+{
+	OutExtent = FVector2f(Input.Texture->Desc.Extent);
+	OutViewMin = Input.ViewRect.Min;
+	OutViewMax = Input.ViewRect.Max;
+}
+
+void FSMAAEdgeDetectionPass::SetupParameters(FSMAASceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters)
+{
+	TSharedPtr<FSMAAViewData> ViewData = StaticCastSharedPtr<FSMAAViewData>(Context.ViewData);
+
+	const FRDGTextureDesc StencilDesc = FRDGTextureDesc::Create2D(Context.Output.Texture->Desc.Extent, PF_DepthStencil, FClearValueBinding::DepthZero, TexCreate_DepthStencilTargetable | TexCreate_ShaderResource);
+	Extension.EdgeStencil = Context.GraphBuilder.CreateTexture(StencilDesc, TEXT("SMAA.EdgeStencil"));
+
+	Parameters->InputTexture = Context.Input.Texture;
+	SetupViewParameters(Context.Input, Parameters->InputExtent, Parameters->InputViewMin, Parameters->InputViewMax);
+	Parameters->Threshold = ViewData->Threshold;
+	Parameters->RenderTargets[0] = Context.Output.GetRenderTargetBinding();
+	Parameters->RenderTargets.DepthStencil = FDepthStencilBinding(Extension.EdgeStencil, ERenderTargetLoadAction::ENoAction, ERenderTargetLoadAction::EClear, DepthStencilAccess);
+}
+
+void FSMAABlendingWeightPass::SetupParameters(FSMAASceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters)
+{
+	check(Extension.EdgeStencil != nullptr);
+
+	Parameters->InputTexture = Context.Input.Texture;
+	SetupViewParameters(Context.Input, Parameters->InputExtent, Parameters->InputViewMin, Parameters->InputViewMax);
+	Parameters->MaxSearchSteps = Extension.GetMaxSearchSteps();
+	Parameters->RenderTargets[0] = Context.Output.GetRenderTargetBinding();
+	Parameters->RenderTargets.DepthStencil = FDepthStencilBinding(Extension.EdgeStencil, ERenderTargetLoadAction::ENoAction, ERenderTargetLoadAction::ELoad, DepthStencilAccess);
+}
+
+void FSMAANeighborhoodBlendingPass::SetupParameters(FSMAASceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters)
+{
+	// The weights have the scene color's extent and view rect
+	Parameters->InputTexture = Context.Input.Texture;
+	Parameters->SceneColorTexture = Context.SceneColor.Texture;
+	SetupViewParameters(Context.Input, Parameters->InputExtent, Parameters->InputViewMin, Parameters->InputViewMax);
+	Parameters->RenderTargets[0] = Context.Output.GetRenderTargetBinding();
+}
+
+size_t FSMAASceneExtension::GetTypeHash() const
+{
+	static size_t UniquePointer;
+	return reinterpret_cast<size_t>(&UniquePointer);
+}
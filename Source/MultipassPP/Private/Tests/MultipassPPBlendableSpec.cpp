@@ -0,0 +1,367 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPTestFixtures.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "AdaptiveSharpenSceneExtension.h"
+#include "AdaptiveSharpenBlendable.h"
+#include "AccumulationMotionBlurSceneExtension.h"
+#include "AccumulationMotionBlurBlendable.h"
+#include "InterlacePPSceneExtension.h"
+#include "InterlacePPBlendable.h"
+#include "SMAASceneExtension.h"
+#include "SMAABlendable.h"
+
+BEGIN_DEFINE_SPEC(FMultipassPPBlendableSpec, "MultipassPP.Blendables", MULTIPASSPP_TEST_CONTEXT_MASK | EAutomationTestFlags::EngineFilter)
+
+	// Runs the view through SetupView and SetupViewData_RenderThread and returns its view data
+	template<typename TViewData, typename TExtension>
+	TSharedPtr<TViewData> SetupViewData(TExtension& Extension, FMultipassPPTestViews& Views)
+	{
+		MultipassPPTest::SetupViews(Extension, Views);
+		return StaticCastSharedPtr<TViewData>(Extension.GetViewData(*Views.GetViews()[0]));
+	}
+
+	static FAdaptiveSharpenNode MakeAdaptiveSharpenNode(float Strength)
+	{
+		FAdaptiveSharpenNode Node;
+		Node.Strength = Strength;
+		return Node;
+	}
+
+	static FAccumulationMotionBlurNode MakeAccumulationMotionBlurNode(float MotionBlurScale, int32 HistoryScale)
+	{
+		FAccumulationMotionBlurNode Node;
+		Node.MotionBlurScale = MotionBlurScale;
+		Node.HistoryScale = HistoryScale;
+		return Node;
+	}
+
+	static FSMAANode MakeSMAANode(float Threshold)
+	{
+		FSMAANode Node;
+		Node.Threshold = Threshold;
+		return Node;
+	}
+
+END_DEFINE_SPEC(FMultipassPPBlendableSpec)
+
+void FMultipassPPBlendableSpec::Define()
+{
+	Describe("ForEachBlendable", [this]()
+	{
+		using FExtension = TMultipassPPTestExtension<FAdaptiveSharpenSceneExtension>;
+
+		It("Returns 0 without blendables", [this]()
+		{
+			FMultipassPPTestViews Views(1);
+
+			int32 NumCalls = 0;
+			const int32 NumEntries = FExtension::ForEachBlendable<FAdaptiveSharpenNode>(*Views.GetViews()[0], [&NumCalls](const FAdaptiveSharpenNode& Node, float Weight)
+			{
+				++NumCalls;
+			});
+
+			TestEqual(TEXT("Entries"), NumEntries, 0);
+			TestEqual(TEXT("Calls"), NumCalls, 0);
+		});
+
+		It("Visits every blendable of the type in order with its weight, and only those", [this]()
+		{
+			FMultipassPPTestViews Views(1);
+			Views.PushBlendable(0.5f, MakeAdaptiveSharpenNode(2.f));
+			Views.PushBlendable(1.f, MakeAccumulationMotionBlurNode(0.1f, 1));
+			Views.PushBlendable(0.25f, MakeAdaptiveSharpenNode(4.f));
+
+			TArray<float> Weights;
+			TArray<float> Strengths;
+			const int32 NumEntries = FExtension::ForEachBlendable<FAdaptiveSharpenNode>(*Views.GetViews()[0], [&](const FAdaptiveSharpenNode& Node, float Weight)
+			{
+				Weights.Add(Weight);
+				Strengths.Add(Node.Strength);
+			});
+
+			TestEqual(TEXT("Entries"), NumEntries, 2);
+			if (TestEqual(TEXT("Calls"), Weights.Num(), 2))
+			{
+				TestEqual(TEXT("First weight"), Weights[0], 0.5f);
+				TestEqual(TEXT("First strength"), Strengths[0], 2.f);
+				TestEqual(TEXT("Second weight"), Weights[1], 0.25f);
+				TestEqual(TEXT("Second strength"), Strengths[1], 4.f);
+			}
+		});
+	});
+
+	Describe("AdaptiveSharpen", [this]()
+	{
+		using FExtension = TMultipassPPTestExtension<FAdaptiveSharpenSceneExtension>;
+
+		It("Is off without blendables or cvars", [this]()
+		{
+			FMultipassPPTestCVar Enabled(TEXT("r.AdaptiveSharpening.Enabled"), TEXT("-1"));
+			FMultipassPPTestCVar Strength(TEXT("r.AdaptiveSharpening.Strength"), TEXT("-1"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+
+			TSharedPtr<FAdaptiveSharpenViewData> ViewData = SetupViewData<FAdaptiveSharpenViewData>(*Extension, Views);
+			if (TestValid(TEXT("View data"), ViewData))
+			{
+				TestEqual(TEXT("Weight"), ViewData->BlendableWeight, 0.f);
+				TestEqual(TEXT("Strength"), ViewData->Strength, 0.f);
+			}
+		});
+
+		It("Averages the blendables' weights and strengths", [this]()
+		{
+			FMultipassPPTestCVar Enabled(TEXT("r.AdaptiveSharpening.Enabled"), TEXT("-1"));
+			FMultipassPPTestCVar Strength(TEXT("r.AdaptiveSharpening.Strength"), TEXT("-1"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			Views.PushBlendable(0.5f, MakeAdaptiveSharpenNode(2.f));
+			Views.PushBlendable(1.f, MakeAdaptiveSharpenNode(4.f));
+
+			TSharedPtr<FAdaptiveSharpenViewData> ViewData = SetupViewData<FAdaptiveSharpenViewData>(*Extension, Views);
+			if (TestValid(TEXT("View data"), ViewData))
+			{
+				TestEqual(TEXT("Weight"), ViewData->BlendableWeight, 0.75f);
+				TestEqual(TEXT("Strength"), ViewData->Strength, 3.f);
+			}
+		});
+
+		It("Lets the cvars override the blendables", [this]()
+		{
+			FMultipassPPTestCVar Enabled(TEXT("r.AdaptiveSharpening.Enabled"), TEXT("1"));
+			FMultipassPPTestCVar Strength(TEXT("r.AdaptiveSharpening.Strength"), TEXT("0.5"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			Views.PushBlendable(0.25f, MakeAdaptiveSharpenNode(4.f));
+
+			TSharedPtr<FAdaptiveSharpenViewData> ViewData = SetupViewData<FAdaptiveSharpenViewData>(*Extension, Views);
+			if (TestValid(TEXT("View data"), ViewData))
+			{
+				TestEqual(TEXT("Weight"), ViewData->BlendableWeight, 1.f);
+				TestEqual(TEXT("Strength"), ViewData->Strength, 0.5f);
+			}
+		});
+
+		It("Takes the strength from the blendables when only the enabled cvar is set", [this]()
+		{
+			FMultipassPPTestCVar Enabled(TEXT("r.AdaptiveSharpening.Enabled"), TEXT("1"));
+			FMultipassPPTestCVar Strength(TEXT("r.AdaptiveSharpening.Strength"), TEXT("-1"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			Views.PushBlendable(0.25f, MakeAdaptiveSharpenNode(2.f));
+
+			TSharedPtr<FAdaptiveSharpenViewData> ViewData = SetupViewData<FAdaptiveSharpenViewData>(*Extension, Views);
+			if (TestValid(TEXT("View data"), ViewData))
+			{
+				TestEqual(TEXT("Weight"), ViewData->BlendableWeight, 1.f);
+				TestEqual(TEXT("Strength"), ViewData->Strength, 2.f);
+			}
+		});
+
+		It("Only needs the edge map at full quality", [this]()
+		{
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			{
+				FMultipassPPTestCVar Quality(TEXT("r.AdaptiveSharpening.Quality"), TEXT("1"));
+				TSharedPtr<FAdaptiveSharpenViewData> ViewData = SetupViewData<FAdaptiveSharpenViewData>(*Extension, Views);
+				TestFalse(TEXT("Edge map at quality 1"), ViewData.IsValid() && ViewData->bNeedsEdgeMap);
+			}
+			{
+				FMultipassPPTestCVar Quality(TEXT("r.AdaptiveSharpening.Quality"), TEXT("2"));
+				TSharedPtr<FAdaptiveSharpenViewData> ViewData = SetupViewData<FAdaptiveSharpenViewData>(*Extension, Views);
+				TestTrue(TEXT("Edge map at quality 2"), ViewData.IsValid() && ViewData->bNeedsEdgeMap);
+			}
+		});
+	});
+
+	Describe("AccumulationMotionBlur", [this]()
+	{
+		using FExtension = TMultipassPPTestExtension<FAccumulationMotionBlurSceneExtension>;
+
+		It("Averages the blendables' scales, weights and history scales", [this]()
+		{
+			FMultipassPPTestCVar Scale(TEXT("r.AccumulationMotionBlur.Scale"), TEXT("-1"));
+			FMultipassPPTestCVar Weight(TEXT("r.AccumulationMotionBlur.Weight"), TEXT("-1"));
+			FMultipassPPTestCVar HistoryScale(TEXT("r.AccumulationMotionBlur.HistoryScale"), TEXT("-1"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			Views.PushBlendable(0.5f, MakeAccumulationMotionBlurNode(0.2f, 1));
+			Views.PushBlendable(1.f, MakeAccumulationMotionBlurNode(0.4f, 4));
+
+			TSharedPtr<FAccumulationMotionBlurViewData> ViewData = SetupViewData<FAccumulationMotionBlurViewData>(*Extension, Views);
+			if (TestValid(TEXT("View data"), ViewData))
+			{
+				TestEqual(TEXT("Scale"), ViewData->Scale, 0.3f);
+				TestEqual(TEXT("Weight"), ViewData->Weight, 0.75f);
+				TestEqual(TEXT("History scale"), ViewData->HistoryScale, FExtension::GetHistoryScale(2.5f));
+			}
+		});
+
+		It("Clamps the cvar overrides", [this]()
+		{
+			FMultipassPPTestCVar Scale(TEXT("r.AccumulationMotionBlur.Scale"), TEXT("2"));
+			FMultipassPPTestCVar Weight(TEXT("r.AccumulationMotionBlur.Weight"), TEXT("0.5"));
+			FMultipassPPTestCVar HistoryScale(TEXT("r.AccumulationMotionBlur.HistoryScale"), TEXT("1"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			Views.PushBlendable(1.f, MakeAccumulationMotionBlurNode(0.1f, 4));
+
+			TSharedPtr<FAccumulationMotionBlurViewData> ViewData = SetupViewData<FAccumulationMotionBlurViewData>(*Extension, Views);
+			if (TestValid(TEXT("View data"), ViewData))
+			{
+				TestEqual(TEXT("Scale"), ViewData->Scale, 1.f);
+				TestEqual(TEXT("Weight"), ViewData->Weight, 0.5f);
+				TestEqual(TEXT("History scale"), ViewData->HistoryScale, 1);
+			}
+		});
+
+		It("Restarts the history when the history scale changes", [this]()
+		{
+			FMultipassPPTestCVar Scale(TEXT("r.AccumulationMotionBlur.Scale"), TEXT("0.1"));
+			FMultipassPPTestCVar Weight(TEXT("r.AccumulationMotionBlur.Weight"), TEXT("0.5"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			TSharedPtr<FAccumulationMotionBlurViewData> ViewData;
+			{
+				FMultipassPPTestCVar HistoryScale(TEXT("r.AccumulationMotionBlur.HistoryScale"), TEXT("1"));
+				ViewData = SetupViewData<FAccumulationMotionBlurViewData>(*Extension, Views);
+			}
+			if (!TestValid(TEXT("View data"), ViewData))
+			{
+				return;
+			}
+
+			ViewData->LastFrameNumber = 5;
+			{
+				FMultipassPPTestCVar HistoryScale(TEXT("r.AccumulationMotionBlur.HistoryScale"), TEXT("1"));
+				SetupViewData<FAccumulationMotionBlurViewData>(*Extension, Views);
+				TestEqual(TEXT("Same history scale keeps the history"), int32(ViewData->LastFrameNumber), 5);
+			}
+			{
+				FMultipassPPTestCVar HistoryScale(TEXT("r.AccumulationMotionBlur.HistoryScale"), TEXT("2"));
+				SetupViewData<FAccumulationMotionBlurViewData>(*Extension, Views);
+				TestEqual(TEXT("History scale"), ViewData->HistoryScale, 2);
+				TestEqual(TEXT("New history scale restarts the history"), int32(ViewData->LastFrameNumber), 0);
+			}
+		});
+	});
+
+	Describe("AccumulationMotionBlur GetHistoryWeight", [this]()
+	{
+		It("Is 0 without a frame time or a scale", [this]()
+		{
+			TestEqual(TEXT("No frame time"), FAccumulationMotionBlurSceneExtension::GetHistoryWeight(0.f, 0.1f, 0.5f), 0.f);
+			TestEqual(TEXT("No scale"), FAccumulationMotionBlurSceneExtension::GetHistoryWeight(1.f / 60.f, 0.f, 0.5f), 0.f);
+			TestEqual(TEXT("Negative frame time"), FAccumulationMotionBlurSceneExtension::GetHistoryWeight(-1.f, 0.1f, 0.5f), 0.f);
+		});
+
+		It("Is down to the weight after scale seconds, whatever the frame rate", [this]()
+		{
+			TestEqual(TEXT("One frame of Scale seconds"), FAccumulationMotionBlurSceneExtension::GetHistoryWeight(0.1f, 0.1f, 0.25f), 0.25f, 1e-5f);
+
+			const float Weight30 = FAccumulationMotionBlurSceneExtension::GetHistoryWeight(1.f / 30.f, 0.1f, 0.25f);
+			const float Weight60 = FAccumulationMotionBlurSceneExtension::GetHistoryWeight(1.f / 60.f, 0.1f, 0.25f);
+			TestEqual(TEXT("3 frames at 30 fps"), FMath::Pow(Weight30, 3.f), 0.25f, 1e-5f);
+			TestEqual(TEXT("6 frames at 60 fps"), FMath::Pow(Weight60, 6.f), 0.25f, 1e-5f);
+		});
+
+		It("Stays between 0 and 1", [this]()
+		{
+			TestEqual(TEXT("Weight 0"), FAccumulationMotionBlurSceneExtension::GetHistoryWeight(0.1f, 0.1f, 0.f), 0.f, 1e-5f);
+			TestEqual(TEXT("Weight 2"), FAccumulationMotionBlurSceneExtension::GetHistoryWeight(0.1f, 0.1f, 2.f), 1.f);
+		});
+	});
+
+	Describe("InterlacePP", [this]()
+	{
+		using FExtension = TMultipassPPTestExtension<FInterlacePPSceneExtension>;
+
+		It("Averages the blendables' weights unless the cvar is set", [this]()
+		{
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			Views.PushBlendable(0.5f, FInterlacePPNode());
+			Views.PushBlendable(1.f, FInterlacePPNode());
+			{
+				FMultipassPPTestCVar Enabled(TEXT("r.InterlacingPP.Enabled"), TEXT("-1"));
+				TSharedPtr<FInterlacePPViewData> ViewData = SetupViewData<FInterlacePPViewData>(*Extension, Views);
+				TestTrue(TEXT("Blendable weight"), ViewData.IsValid() && FMath::IsNearlyEqual(ViewData->BlendableWeight, 0.75f));
+			}
+			{
+				FMultipassPPTestCVar Enabled(TEXT("r.InterlacingPP.Enabled"), TEXT("0"));
+				TSharedPtr<FInterlacePPViewData> ViewData = SetupViewData<FInterlacePPViewData>(*Extension, Views);
+				TestTrue(TEXT("Cvar weight"), ViewData.IsValid() && ViewData->BlendableWeight == 0.f);
+			}
+		});
+	});
+
+	Describe("SMAA", [this]()
+	{
+		using FExtension = TMultipassPPTestExtension<FSMAASceneExtension>;
+
+		It("Averages the blendables' thresholds and clamps them", [this]()
+		{
+			FMultipassPPTestCVar Enabled(TEXT("r.SMAA.Enabled"), TEXT("-1"));
+			FMultipassPPTestCVar Threshold(TEXT("r.SMAA.Threshold"), TEXT("-1"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+			Views.PushBlendable(1.f, MakeSMAANode(0.6f));
+			Views.PushBlendable(1.f, MakeSMAANode(0.8f));
+
+			TSharedPtr<FSMAAViewData> ViewData = SetupViewData<FSMAAViewData>(*Extension, Views);
+			if (TestValid(TEXT("View data"), ViewData))
+			{
+				TestEqual(TEXT("Weight"), ViewData->BlendableWeight, 1.f);
+				TestEqual(TEXT("Threshold"), ViewData->Threshold, 0.5f);
+			}
+		});
+
+		It("Uses the default threshold when only the enabled cvar is set", [this]()
+		{
+			FMultipassPPTestCVar Enabled(TEXT("r.SMAA.Enabled"), TEXT("1"));
+			FMultipassPPTestCVar Threshold(TEXT("r.SMAA.Threshold"), TEXT("-1"));
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(1);
+
+			TSharedPtr<FSMAAViewData> ViewData = SetupViewData<FSMAAViewData>(*Extension, Views);
+			if (TestValid(TEXT("View data"), ViewData))
+			{
+				TestEqual(TEXT("Weight"), ViewData->BlendableWeight, 1.f);
+				TestEqual(TEXT("Threshold"), ViewData->Threshold, 0.1f);
+			}
+		});
+	});
+
+	Describe("View data", [this]()
+	{
+		using FExtension = TMultipassPPTestExtension<FAdaptiveSharpenSceneExtension>;
+
+		It("Is created once per view state and found again on the next frames", [this]()
+		{
+			TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+			FMultipassPPTestViews Views(8);
+
+			MultipassPPTest::SetupViews(*Extension, Views);
+			TestEqual(TEXT("View data after the first frame"), Extension->GetAllViewData().Num(), 8);
+
+			TArray<TSharedPtr<IMultipassPPViewData>> FirstFrame;
+			for (FSceneView* View : Views.GetViews())
+			{
+				FirstFrame.Add(Extension->GetViewData(*View));
+			}
+
+			MultipassPPTest::SetupViews(*Extension, Views);
+			TestEqual(TEXT("View data after the second frame"), Extension->GetAllViewData().Num(), 8);
+			for (int32 ViewIndex = 0; ViewIndex < Views.GetViews().Num(); ++ViewIndex)
+			{
+				TestTrue(FString::Printf(TEXT("View %d kept its view data"), ViewIndex), Extension->GetViewData(*Views.GetViews()[ViewIndex]) == FirstFrame[ViewIndex]);
+			}
+		});
+	});
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
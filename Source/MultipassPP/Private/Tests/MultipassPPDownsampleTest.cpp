@@ -0,0 +1,244 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPTestFixtures.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "MultipassPPDownsample.h"
+#include "SceneRendering.h"
+#include "Math/Float16Color.h"
+#include "Math/RandomStream.h"
+
+namespace
+{
+	FLinearColor Reduce4OnCPU(EMultipassPPDownsampleReduction Reduction, const FLinearColor& A, const FLinearColor& B, const FLinearColor& C, const FLinearColor& D)
+	{
+		switch (Reduction)
+		{
+		case EMultipassPPDownsampleReduction::Max:
+			return FLinearColor(
+				FMath::Max(FMath::Max(A.R, B.R), FMath::Max(C.R, D.R)),
+				FMath::Max(FMath::Max(A.G, B.G), FMath::Max(C.G, D.G)),
+				FMath::Max(FMath::Max(A.B, B.B), FMath::Max(C.B, D.B)),
+				FMath::Max(FMath::Max(A.A, B.A), FMath::Max(C.A, D.A)));
+		case EMultipassPPDownsampleReduction::LumaWeighted:
+		{
+			// Luminance() in Common.ush
+			auto Weight = [](const FLinearColor& Color) { return 1.f / (1.f + 0.3f * Color.R + 0.59f * Color.G + 0.11f * Color.B); };
+			const float WA = Weight(A), WB = Weight(B), WC = Weight(C), WD = Weight(D);
+			return (A * WA + B * WB + C * WC + D * WD) * (1.f / (WA + WB + WC + WD));
+		}
+		default:
+			return (A + B + C + D) * 0.25f;
+		}
+	}
+
+	// Reduces Levels[0], Size texels, over NumLevels levels like DownsampleTile does. The reads of Levels[0] are clamped to Size, the
+	// levels after it reduce whatever the tile held past the edge, so each level covers the whole tiles and not just the mip
+	void ReduceTilesOnCPU(EMultipassPPDownsampleReduction Reduction, TArray<TArray<FLinearColor>>& Levels, const FIntPoint& Size, const FIntPoint& TileCount, int32 NumLevels)
+	{
+		const TArray<FLinearColor> Base = MoveTemp(Levels[0]);
+
+		FIntPoint LevelSize = TileCount * FMultipassPPDownsampleCS::TileSize;
+		Levels[0].SetNumUninitialized(LevelSize.X * LevelSize.Y);
+		for (int32 Y = 0; Y < LevelSize.Y; ++Y)
+		{
+			for (int32 X = 0; X < LevelSize.X; ++X)
+			{
+				Levels[0][Y * LevelSize.X + X] = Base[FMath::Min(Y, Size.Y - 1) * Size.X + FMath::Min(X, Size.X - 1)];
+			}
+		}
+
+		for (int32 Level = 1; Level <= NumLevels; ++Level)
+		{
+			const TArray<FLinearColor>& Above = Levels[Level - 1];
+			const int32 AboveWidth = LevelSize.X;
+			LevelSize /= 2;
+
+			TArray<FLinearColor> Texels;
+			Texels.SetNumUninitialized(LevelSize.X * LevelSize.Y);
+			for (int32 Y = 0; Y < LevelSize.Y; ++Y)
+			{
+				for (int32 X = 0; X < LevelSize.X; ++X)
+				{
+					const int32 Index = 2 * Y * AboveWidth + 2 * X;
+					Texels[Y * LevelSize.X + X] = Reduce4OnCPU(Reduction, Above[Index], Above[Index + 1], Above[Index + AboveWidth], Above[Index + AboveWidth + 1]);
+				}
+			}
+			Levels.Add(MoveTemp(Texels));
+		}
+	}
+
+	// What AddMultipassPPDownsamplePass writes in each mip, on the CPU, NumMips mips of Size texels. The tail past mip 6 is reduced
+	// from mip 6 as it was stored, in half precision
+	TArray<TArray<FLinearColor>> DownsampleOnCPU(EMultipassPPDownsampleReduction Reduction, const TArray<FLinearColor>& Input, const FIntPoint& Size, int32 NumMips)
+	{
+		static constexpr int32 TileLevels = 6;
+
+		TArray<TArray<FLinearColor>> Levels;
+		Levels.Add(Input);
+		ReduceTilesOnCPU(Reduction, Levels, Size, FIntPoint::DivideAndRoundUp(Size, FMultipassPPDownsampleCS::TileSize), TileLevels);
+
+		auto GetMipSize = [&Size](int32 Mip) { return FIntPoint(FMath::Max(Size.X >> Mip, 1), FMath::Max(Size.Y >> Mip, 1)); };
+
+		// Crops the tile levels to the mips
+		TArray<TArray<FLinearColor>> Mips;
+		for (int32 Mip = 0; Mip <= TileLevels && Mip < NumMips; ++Mip)
+		{
+			const FIntPoint MipSize = GetMipSize(Mip);
+			const int32 LevelWidth = FIntPoint::DivideAndRoundUp(Size, FMultipassPPDownsampleCS::TileSize).X * (FMultipassPPDownsampleCS::TileSize >> Mip);
+
+			TArray<FLinearColor>& Texels = Mips.AddDefaulted_GetRef();
+			for (int32 Y = 0; Y < MipSize.Y; ++Y)
+			{
+				for (int32 X = 0; X < MipSize.X; ++X)
+				{
+					Texels.Add(Mip == 0 ? Input[Y * Size.X + X] : Levels[Mip][Y * LevelWidth + X]);
+				}
+			}
+		}
+
+		if (NumMips > TileLevels + 1)
+		{
+			TArray<TArray<FLinearColor>> TailLevels;
+			TArray<FLinearColor>& Mip6 = TailLevels.Add_GetRef(Mips[TileLevels]);
+			for (FLinearColor& Texel : Mip6)
+			{
+				Texel = FFloat16Color(Texel).GetFloats();
+			}
+			ReduceTilesOnCPU(Reduction, TailLevels, GetMipSize(TileLevels), FIntPoint(1, 1), TileLevels);
+
+			for (int32 Mip = TileLevels + 1; Mip < NumMips; ++Mip)
+			{
+				const FIntPoint MipSize = GetMipSize(Mip);
+				const int32 LevelWidth = FMultipassPPDownsampleCS::TileSize >> (Mip - TileLevels);
+
+				TArray<FLinearColor>& Texels = Mips.AddDefaulted_GetRef();
+				for (int32 Y = 0; Y < MipSize.Y; ++Y)
+				{
+					for (int32 X = 0; X < MipSize.X; ++X)
+					{
+						Texels.Add(TailLevels[Mip - TileLevels][Y * LevelWidth + X]);
+					}
+				}
+			}
+		}
+		return Mips;
+	}
+}
+
+// Runs AddMultipassPPDownsamplePass with every reduction mode on a fixed input, and checks every texel of every mip against the
+// same reduction on the CPU. The input spans several groups and more than 7 mips, so the last group's reduction of mip 6 is covered
+// too. The tolerance covers the half precision mips. Needs an SM5 RHI
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMultipassPPDownsampleTest, "MultipassPP.Rendering.Downsample", MULTIPASSPP_TEST_CONTEXT_MASK | EAutomationTestFlags::EngineFilter)
+
+bool FMultipassPPDownsampleTest::RunTest(const FString& Parameters)
+{
+	if (!MultipassPPTest::CanRender())
+	{
+		AddInfo(TEXT("Skipped, needs an SM5 RHI"));
+		return true;
+	}
+
+	// 3x2 groups with partial tiles on both axes, and 8 mips
+	const FIntPoint Size(160, 72);
+	const int32 NumMips = FMath::FloorLog2(FMath::Max(Size.X, Size.Y)) + 1;
+	static constexpr float Tolerance = 2e-3f;
+
+	// Noise with a few bright texels, so the luma weighting has outliers to hold back
+	FRandomStream Random(0x4D5050);
+	TArray<FFloat16Color> Pixels;
+	TArray<FLinearColor> Input;
+	for (int32 Index = 0; Index < Size.X * Size.Y; ++Index)
+	{
+		const float Bright = Random.FRand() < 0.02f ? 8.f : 1.f;
+		const FFloat16Color& Pixel = Pixels.Emplace_GetRef(FLinearColor(Random.FRand() * Bright, Random.FRand(), Random.FRand() * Bright, Random.FRand()));
+		Input.Add(Pixel.GetFloats());
+	}
+
+	FMultipassPPTestViews Views(1, Size);
+
+	for (int32 ReductionIndex = 0; ReductionIndex < (int32)EMultipassPPDownsampleReduction::MAX; ++ReductionIndex)
+	{
+		const EMultipassPPDownsampleReduction Reduction = (EMultipassPPDownsampleReduction)ReductionIndex;
+
+		int32 NumResultMips = 0;
+		TArray<TArray<FFloat16Color>> Results;
+		MultipassPPTest::RunOnRenderThread([&]()
+		{
+			FRHICommandListImmediate& RHICmdList = FRHICommandListExecutor::GetImmediateCommandList();
+			const FViewInfo ViewInfo(Views.GetViews()[0]);
+
+			TRefCountPtr<IPooledRenderTarget> InputRT = MultipassPPTest::UploadTexture(RHICmdList, Size, PF_FloatRGBA, Pixels.GetData(), TEXT("MultipassPPTest.DownsampleInput"));
+
+			FRDGBuilder GraphBuilder(RHICmdList);
+			const FScreenPassTexture InputTexture(GraphBuilder.RegisterExternalTexture(InputRT));
+			FRDGTextureRef Pyramid = AddMultipassPPDownsamplePass(GraphBuilder, ViewInfo, InputTexture, Reduction);
+			NumResultMips = Pyramid->Desc.NumMips;
+
+			// The readbacks copy mip 0, so each mip goes through a texture of its own
+			TArray<TUniquePtr<FRHIGPUTextureReadback>> Readbacks;
+			for (int32 Mip = 0; Mip < NumResultMips; ++Mip)
+			{
+				const FIntPoint MipSize(FMath::Max(Size.X >> Mip, 1), FMath::Max(Size.Y >> Mip, 1));
+				FRDGTextureRef MipTexture = GraphBuilder.CreateTexture(FRDGTextureDesc::Create2D(MipSize, PF_FloatRGBA, FClearValueBinding::None, TexCreate_ShaderResource), TEXT("MultipassPPTest.DownsampleMip"));
+
+				FRHICopyTextureInfo CopyInfo;
+				CopyInfo.SourceMipIndex = Mip;
+				CopyInfo.Size = FIntVector(MipSize.X, MipSize.Y, 1);
+				AddCopyTexturePass(GraphBuilder, Pyramid, MipTexture, CopyInfo);
+
+				Readbacks.Add(MultipassPPTest::EnqueueReadback(GraphBuilder, MipTexture));
+			}
+			GraphBuilder.Execute();
+
+			MultipassPPTest::FlushGPU(RHICmdList);
+			for (int32 Mip = 0; Mip < NumResultMips; ++Mip)
+			{
+				Results.Add(MultipassPPTest::ReadTexels<FFloat16Color>(*Readbacks[Mip], FIntPoint(FMath::Max(Size.X >> Mip, 1), FMath::Max(Size.Y >> Mip, 1))));
+			}
+		});
+
+		static const TCHAR* ReductionNames[] = { TEXT("Average"), TEXT("Max"), TEXT("LumaWeighted") };
+		static_assert(UE_ARRAY_COUNT(ReductionNames) == (int32)EMultipassPPDownsampleReduction::MAX, "Name every reduction");
+		const FString ReductionName = ReductionNames[ReductionIndex];
+		if (!TestEqual(FString::Printf(TEXT("%s built the full chain"), *ReductionName), NumResultMips, NumMips))
+		{
+			continue;
+		}
+
+		const TArray<TArray<FLinearColor>> Expected = DownsampleOnCPU(Reduction, Input, Size, NumMips);
+
+		for (int32 Mip = 0; Mip < NumMips; ++Mip)
+		{
+			if (!TestEqual(FString::Printf(TEXT("%s mip %d was read back"), *ReductionName, Mip), Results[Mip].Num(), Expected[Mip].Num()))
+			{
+				continue;
+			}
+
+			// Relative above 1, the bright texels carry into the lower mips
+			float MaxError = 0.f;
+			int32 WorstIndex = 0;
+			for (int32 Index = 0; Index < Expected[Mip].Num(); ++Index)
+			{
+				const FLinearColor& ExpectedTexel = Expected[Mip][Index];
+				const FLinearColor Difference = Results[Mip][Index].GetFloats() - ExpectedTexel;
+				const float Scale = FMath::Max(1.f, FMath::Max(FMath::Max(FMath::Abs(ExpectedTexel.R), FMath::Abs(ExpectedTexel.G)), FMath::Max(FMath::Abs(ExpectedTexel.B), FMath::Abs(ExpectedTexel.A))));
+				const float Error = FMath::Max(FMath::Max(FMath::Abs(Difference.R), FMath::Abs(Difference.G)), FMath::Max(FMath::Abs(Difference.B), FMath::Abs(Difference.A))) / Scale;
+				if (Error > MaxError)
+				{
+					MaxError = Error;
+					WorstIndex = Index;
+				}
+			}
+
+			const int32 MipWidth = FMath::Max(Size.X >> Mip, 1);
+			TestTrue(FString::Printf(TEXT("%s mip %d matches the CPU reduction, largest error %.5f at (%d, %d)"), *ReductionName, Mip, MaxError, WorstIndex % MipWidth, WorstIndex / MipWidth),
+				MaxError <= Tolerance);
+		}
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,159 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPTestFixtures.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "AdaptiveSharpenSceneExtension.h"
+#include "MultipassPPImageCompare.h"
+#include "SceneRendering.h"
+#include "Math/Float16Color.h"
+#include "Math/RandomStream.h"
+
+namespace
+{
+	// Scene color with an edge map in alpha, like pass 1 writes it: a gradient, hard edged blocks and a little noise,
+	// so the kernel sees flat areas, ramps and edges. Always the same, the stream is seeded
+	TArray<FFloat16Color> MakeFastMathTestInput(const FIntPoint& Size)
+	{
+		FRandomStream Random(0x4D5050);
+
+		TArray<FLinearColor> Colors;
+		Colors.SetNumUninitialized(Size.X * Size.Y);
+		for (int32 Y = 0; Y < Size.Y; ++Y)
+		{
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				const float Noise = Random.FRandRange(-0.05f, 0.05f);
+				const bool bBlock = ((X / 8) + (Y / 8)) % 2 == 0;
+				Colors[Y * Size.X + X] = FLinearColor(
+					FMath::Clamp(float(X) / (Size.X - 1) + Noise, 0.f, 1.f),
+					bBlock ? 0.9f : 0.1f,
+					FMath::Clamp(float(Y) / (Size.Y - 1) - Noise, 0.f, 1.f),
+					0.f);
+			}
+		}
+
+		// The largest luma step to a neighbour, scaled to about the range pass 1 outputs
+		auto Luma = [&Colors, &Size](int32 X, int32 Y)
+		{
+			const FLinearColor& Color = Colors[FMath::Clamp(Y, 0, Size.Y - 1) * Size.X + FMath::Clamp(X, 0, Size.X - 1)];
+			return 0.2558f * Color.R + 0.6511f * Color.G + 0.0931f * Color.B;
+		};
+
+		TArray<FFloat16Color> Pixels;
+		Pixels.SetNumUninitialized(Size.X * Size.Y);
+		for (int32 Y = 0; Y < Size.Y; ++Y)
+		{
+			for (int32 X = 0; X < Size.X; ++X)
+			{
+				const float Center = Luma(X, Y);
+				const float Step = FMath::Max(
+					FMath::Max(FMath::Abs(Center - Luma(X - 1, Y)), FMath::Abs(Center - Luma(X + 1, Y))),
+					FMath::Max(FMath::Abs(Center - Luma(X, Y - 1)), FMath::Abs(Center - Luma(X, Y + 1))));
+
+				FLinearColor Color = Colors[Y * Size.X + X];
+				Color.A = FMath::Min(Step * 4.f, 2.f);
+				Pixels[Y * Size.X + X] = FFloat16Color(Color);
+			}
+		}
+		return Pixels;
+	}
+}
+
+// Renders the full quality adaptive sharpen pass 2 with the reference and the FAST_MATH shaders on a fixed input, at a few strengths,
+// and checks with FMultipassPPImageCompare that no pixel is over r.AdaptiveSharpening.FastMath.Tolerance. Needs an SM5 RHI
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMultipassPPFastMathImageCompareTest, "MultipassPP.Rendering.AdaptiveSharpenFastMath", MULTIPASSPP_TEST_CONTEXT_MASK | EAutomationTestFlags::EngineFilter)
+
+bool FMultipassPPFastMathImageCompareTest::RunTest(const FString& Parameters)
+{
+	if (!MultipassPPTest::CanRender())
+	{
+		AddInfo(TEXT("Skipped, needs an SM5 RHI"));
+		return true;
+	}
+
+	const FIntPoint Size(64, 64);
+	const float CurveHeights[] = { 0.5f, 1.f, 2.f };
+
+	IConsoleVariable* ToleranceCVar = IConsoleManager::Get().FindConsoleVariable(TEXT("r.AdaptiveSharpening.FastMath.Tolerance"));
+	const float Tolerance = ToleranceCVar != nullptr ? ToleranceCVar->GetFloat() : 2.f / 255.f;
+
+	const TArray<FFloat16Color> Input = MakeFastMathTestInput(Size);
+
+	// Only there to draw with, the pass doesn't read the view uniform buffer
+	FMultipassPPTestViews Views(1, Size);
+
+	TArray<FMultipassPPImageCompareResult> Results;
+	MultipassPPTest::RunOnRenderThread([&]()
+	{
+		FRHICommandListImmediate& RHICmdList = FRHICommandListExecutor::GetImmediateCommandList();
+		const FViewInfo ViewInfo(Views.GetViews()[0]);
+		const FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(ViewInfo.GetFeatureLevel());
+
+		FMultipassPPImageCompare Compare(UE_ARRAY_COUNT(CurveHeights));
+		Compare.SetCallback(FOnMultipassPPImageCompared::CreateLambda([&Results](const FMultipassPPImageCompareResult& Result)
+		{
+			Results.Add(Result);
+		}));
+
+		TRefCountPtr<IPooledRenderTarget> InputRT = MultipassPPTest::UploadTexture(RHICmdList, Size, PF_FloatRGBA, Input.GetData(), TEXT("MultipassPPTest.FastMathInput"));
+
+		FRDGBuilder GraphBuilder(RHICmdList);
+		const FScreenPassTexture InputTexture(GraphBuilder.RegisterExternalTexture(InputRT));
+
+		TShaderMapRef<FScreenPassVS> VertexShader(ShaderMap);
+
+		for (const float CurveHeight : CurveHeights)
+		{
+			FScreenPassTexture Outputs[2];
+			for (int32 FastMath = 0; FastMath < 2; ++FastMath)
+			{
+				FAdaptiveSharpenPixelShaderPass2::FPermutationDomain PermutationVector;
+				PermutationVector.Set<FAdaptiveSharpenPixelShaderPass2::FQualityDim>(FAdaptiveSharpenSceneExtension::FullQuality);
+				PermutationVector.Set<FAdaptiveSharpenPixelShaderPass2::FFastMathDim>(FastMath != 0);
+				TShaderMapRef<FAdaptiveSharpenPixelShaderPass2> PixelShader(ShaderMap, PermutationVector);
+
+				const FRDGTextureDesc OutputDesc = FRDGTextureDesc::Create2D(Size, PF_FloatRGBA, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+				const FScreenPassRenderTarget Output(GraphBuilder.CreateTexture(OutputDesc, FastMath != 0 ? TEXT("MultipassPPTest.FastMath") : TEXT("MultipassPPTest.Reference")), ERenderTargetLoadAction::ENoAction);
+
+				// What SetupPass2Parameters binds, without the view data
+				FAdaptiveSharpenPixelShaderPass2::FParameters* PassParameters = GraphBuilder.AllocParameters<FAdaptiveSharpenPixelShaderPass2::FParameters>();
+				PassParameters->InputTexture = InputTexture.Texture;
+				PassParameters->InputSampler = TStaticSamplerState<>::GetRHI();
+				PassParameters->PixelUVSize = FVector2f(1.f / Size.X, 1.f / Size.Y);
+				PassParameters->CurveHeight = CurveHeight;
+				PassParameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+
+				AddDrawScreenPass(GraphBuilder, RDG_EVENT_NAME("Pass 2 FastMath=%d CurveHeight=%.1f", FastMath, CurveHeight), ViewInfo, FScreenPassTextureViewport(Output), FScreenPassTextureViewport(InputTexture),
+					VertexShader, PixelShader, FAdaptiveSharpenPass2::GetBlendState(), FAdaptiveSharpenPass2::GetDepthStencilState(), PassParameters, EScreenPassDrawFlags::None);
+
+				Outputs[FastMath] = Output;
+			}
+
+			Compare.AddComparePass(GraphBuilder, ShaderMap, Outputs[0], Outputs[1], Tolerance);
+		}
+
+		GraphBuilder.Execute();
+
+		MultipassPPTest::FlushGPU(RHICmdList);
+		Compare.PollReadbacks();
+	});
+
+	if (!TestEqual(TEXT("Every comparison was read back"), Results.Num(), int32(UE_ARRAY_COUNT(CurveHeights))))
+	{
+		return false;
+	}
+
+	for (int32 Index = 0; Index < Results.Num(); ++Index)
+	{
+		const FMultipassPPImageCompareResult& Result = Results[Index];
+		TestEqual(FString::Printf(TEXT("CurveHeight %.1f compared the whole image"), CurveHeights[Index]), int32(Result.NumPixels), Size.X * Size.Y);
+		TestEqual(FString::Printf(TEXT("CurveHeight %.1f pixels over the %.5f tolerance (largest difference %.5f)"), CurveHeights[Index], Result.Tolerance, Result.MaxDifference),
+			int32(Result.NumPixelsOverTolerance), 0);
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,175 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPTestFixtures.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "MultipassPPSeparableFilter.h"
+#include "SceneRendering.h"
+#include "Math/Float16Color.h"
+#include "Math/RandomStream.h"
+
+namespace
+{
+	// FMultipassPPGaussianKernel's taps, normalized the way GetKernelWeightsDefine bakes them into the shader
+	TArray<float> GetNormalizedGaussianWeights()
+	{
+		TArray<float> Weights;
+		float WeightSum = 0.f;
+		for (int32 Offset = 0; Offset <= FMultipassPPGaussianKernel::Radius; ++Offset)
+		{
+			const float Weight = FMath::Max(FMultipassPPGaussianKernel::GetWeight(Offset), 0.f);
+			Weights.Add(Weight);
+			WeightSum += Offset == 0 ? Weight : 2.f * Weight;
+		}
+		for (float& Weight : Weights)
+		{
+			Weight /= WeightSum;
+		}
+		return Weights;
+	}
+
+	// What AddMultipassPPSeparableFilterPasses computes, on the CPU. The shader clamps its fetches to the view, so the edges repeat,
+	// and at half resolution the horizontal pass reads the 2x2 average its bilinear fetch lands on
+	TArray<FLinearColor> FilterOnCPU(const TArray<FLinearColor>& Input, const FIntPoint& InputSize, bool bHalfResolution)
+	{
+		const TArray<float> Weights = GetNormalizedGaussianWeights();
+		const FIntPoint OutputSize = bHalfResolution ? FIntPoint::DivideAndRoundUp(InputSize, 2) : InputSize;
+
+		auto Texel = [&Input, &InputSize](int32 X, int32 Y)
+		{
+			return Input[FMath::Clamp(Y, 0, InputSize.Y - 1) * InputSize.X + FMath::Clamp(X, 0, InputSize.X - 1)];
+		};
+
+		auto HorizontalSource = [&](int32 X, int32 Y) -> FLinearColor
+		{
+			if (!bHalfResolution)
+			{
+				return Texel(X, Y);
+			}
+			if (X < 0 || X >= OutputSize.X)
+			{
+				const int32 EdgeX = X < 0 ? 0 : InputSize.X - 1;
+				return (Texel(EdgeX, 2 * Y) + Texel(EdgeX, 2 * Y + 1)) * 0.5f;
+			}
+			return (Texel(2 * X, 2 * Y) + Texel(2 * X + 1, 2 * Y) + Texel(2 * X, 2 * Y + 1) + Texel(2 * X + 1, 2 * Y + 1)) * 0.25f;
+		};
+
+		TArray<FLinearColor> Horizontal;
+		Horizontal.SetNumUninitialized(OutputSize.X * OutputSize.Y);
+		for (int32 Y = 0; Y < OutputSize.Y; ++Y)
+		{
+			for (int32 X = 0; X < OutputSize.X; ++X)
+			{
+				FLinearColor Sum = HorizontalSource(X, Y) * Weights[0];
+				for (int32 Offset = 1; Offset < Weights.Num(); ++Offset)
+				{
+					Sum += (HorizontalSource(X - Offset, Y) + HorizontalSource(X + Offset, Y)) * Weights[Offset];
+				}
+				Horizontal[Y * OutputSize.X + X] = Sum;
+			}
+		}
+
+		TArray<FLinearColor> Output;
+		Output.SetNumUninitialized(OutputSize.X * OutputSize.Y);
+		for (int32 Y = 0; Y < OutputSize.Y; ++Y)
+		{
+			for (int32 X = 0; X < OutputSize.X; ++X)
+			{
+				auto VerticalSource = [&](int32 SourceY) { return Horizontal[FMath::Clamp(SourceY, 0, OutputSize.Y - 1) * OutputSize.X + X]; };
+
+				FLinearColor Sum = VerticalSource(Y) * Weights[0];
+				for (int32 Offset = 1; Offset < Weights.Num(); ++Offset)
+				{
+					Sum += (VerticalSource(Y - Offset) + VerticalSource(Y + Offset)) * Weights[Offset];
+				}
+				Output[Y * OutputSize.X + X] = Sum;
+			}
+		}
+		return Output;
+	}
+}
+
+// Runs FMultipassPPGaussianKernel through AddMultipassPPSeparableFilterPasses at full and half resolution on a fixed input, and checks
+// every texel against the same filter on the CPU. The tolerance covers the half precision intermediate. Needs an SM5 RHI
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMultipassPPSeparableFilterTest, "MultipassPP.Rendering.SeparableFilter", MULTIPASSPP_TEST_CONTEXT_MASK | EAutomationTestFlags::EngineFilter)
+
+bool FMultipassPPSeparableFilterTest::RunTest(const FString& Parameters)
+{
+	if (!MultipassPPTest::CanRender())
+	{
+		AddInfo(TEXT("Skipped, needs an SM5 RHI"));
+		return true;
+	}
+
+	// Wider than a group, so the row caches of neighbouring groups overlap
+	const FIntPoint Size(96, 40);
+	static constexpr float Tolerance = 2e-3f;
+
+	// Noise, with a hard edge down the middle. The GPU reads the half precision values, so the CPU does too
+	FRandomStream Random(0x4D5050);
+	TArray<FFloat16Color> Pixels;
+	TArray<FLinearColor> Input;
+	for (int32 Y = 0; Y < Size.Y; ++Y)
+	{
+		for (int32 X = 0; X < Size.X; ++X)
+		{
+			const float Edge = X < Size.X / 2 ? 0.f : 0.75f;
+			const FFloat16Color& Pixel = Pixels.Emplace_GetRef(FLinearColor(Random.FRand() * 0.25f + Edge, Random.FRand(), Edge, Random.FRand()));
+			Input.Add(Pixel.GetFloats());
+		}
+	}
+
+	FMultipassPPTestViews Views(1, Size);
+
+	for (const bool bHalfResolution : { false, true })
+	{
+		const FIntPoint OutputSize = bHalfResolution ? FIntPoint::DivideAndRoundUp(Size, 2) : Size;
+
+		TArray<FFloat16Color> Result;
+		MultipassPPTest::RunOnRenderThread([&]()
+		{
+			FRHICommandListImmediate& RHICmdList = FRHICommandListExecutor::GetImmediateCommandList();
+			const FViewInfo ViewInfo(Views.GetViews()[0]);
+
+			TRefCountPtr<IPooledRenderTarget> InputRT = MultipassPPTest::UploadTexture(RHICmdList, Size, PF_FloatRGBA, Pixels.GetData(), TEXT("MultipassPPTest.SeparableFilterInput"));
+
+			FRDGBuilder GraphBuilder(RHICmdList);
+			const FScreenPassTexture InputTexture(GraphBuilder.RegisterExternalTexture(InputRT));
+			const FScreenPassTexture Filtered = AddMultipassPPSeparableFilterPasses<FMultipassPPGaussianKernel>(GraphBuilder, ViewInfo, InputTexture, bHalfResolution, PF_FloatRGBA);
+			TUniquePtr<FRHIGPUTextureReadback> Readback = MultipassPPTest::EnqueueReadback(GraphBuilder, Filtered.Texture);
+			GraphBuilder.Execute();
+
+			MultipassPPTest::FlushGPU(RHICmdList);
+			Result = MultipassPPTest::ReadTexels<FFloat16Color>(*Readback, OutputSize);
+		});
+
+		const TCHAR* Resolution = bHalfResolution ? TEXT("Half resolution") : TEXT("Full resolution");
+		if (!TestEqual(FString::Printf(TEXT("%s was read back"), Resolution), Result.Num(), OutputSize.X * OutputSize.Y))
+		{
+			continue;
+		}
+
+		const TArray<FLinearColor> Expected = FilterOnCPU(Input, Size, bHalfResolution);
+
+		float MaxDifference = 0.f;
+		int32 WorstIndex = 0;
+		for (int32 Index = 0; Index < Expected.Num(); ++Index)
+		{
+			const FLinearColor Difference = Result[Index].GetFloats() - Expected[Index];
+			const float Largest = FMath::Max(FMath::Max(FMath::Abs(Difference.R), FMath::Abs(Difference.G)), FMath::Max(FMath::Abs(Difference.B), FMath::Abs(Difference.A)));
+			if (Largest > MaxDifference)
+			{
+				MaxDifference = Largest;
+				WorstIndex = Index;
+			}
+		}
+
+		TestTrue(FString::Printf(TEXT("%s matches the CPU filter, largest difference %.5f at (%d, %d)"), Resolution, MaxDifference, WorstIndex % OutputSize.X, WorstIndex / OutputSize.X),
+			MaxDifference <= Tolerance);
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "MultipassPPSceneExtension.h"
+#include "SceneView.h"
+#include "SceneManagement.h"
+#include "SceneViewExtension.h"
+#include "UnrealClient.h"
+#include "RenderingThread.h"
+#include "RenderTargetPool.h"
+#include "RenderGraphUtils.h"
+#include "RHIGPUReadback.h"
+#include "HAL/IConsoleManager.h"
+
+#include "Runtime/Launch/Resources/Version.h"
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 5
+#define MULTIPASSPP_TEST_CONTEXT_MASK EAutomationTestFlags_ApplicationContextMask
+#else
+#define MULTIPASSPP_TEST_CONTEXT_MASK EAutomationTestFlags::ApplicationContextMask
+#endif
+
+// Makes the parts of an effect the tests drive directly public. Create it with FSceneViewExtensions::NewExtension
+template<typename TExtension>
+class TMultipassPPTestExtension : public TExtension
+{
+public:
+	TMultipassPPTestExtension(const FAutoRegister& AutoReg)
+		: TExtension(AutoReg)
+	{
+	}
+
+	using TExtension::SetupViewData_RenderThread;
+	using FMultipassPPSceneExtension::ForEachBlendable;
+};
+
+// Render target that only has a size, the fixtures never render
+class FMultipassPPTestRenderTarget : public FRenderTarget
+{
+public:
+	explicit FMultipassPPTestRenderTarget(const FIntPoint& InSize)
+		: Size(InSize)
+	{
+	}
+
+	virtual FIntPoint GetSizeXY() const override { return Size; }
+
+private:
+	FIntPoint Size;
+};
+
+// A view family of NumViews views with their own view states, so every view gets its own view data. Doesn't need a scene or an RHI,
+// so it works with -nullrhi. Game thread
+class FMultipassPPTestViews
+{
+public:
+	FMultipassPPTestViews(int32 NumViews, const FIntPoint& ViewSize = FIntPoint(1280, 720))
+		: RenderTarget(ViewSize)
+	{
+		check(IsInGameThread());
+
+		Family = MakeUnique<FSceneViewFamilyContext>(FSceneViewFamily::ConstructionValues(&RenderTarget, nullptr, FEngineShowFlags(ESFIM_Game)));
+
+		for (int32 ViewIndex = 0; ViewIndex < NumViews; ++ViewIndex)
+		{
+			TUniquePtr<FSceneViewStateReference>& ViewState = ViewStates.Add_GetRef(MakeUnique<FSceneViewStateReference>());
+			ViewState->Allocate(GMaxRHIFeatureLevel);
+
+			FSceneViewInitOptions Options;
+			Options.ViewFamily = Family.Get();
+			Options.SceneViewStateInterface = ViewState->GetReference();
+			Options.SetViewRectangle(FIntRect(FIntPoint::ZeroValue, ViewSize));
+			Options.ViewOrigin = FVector::ZeroVector;
+			Options.ViewRotationMatrix = FMatrix(FPlane(0, 0, 1, 0), FPlane(1, 0, 0, 0), FPlane(0, 1, 0, 0), FPlane(0, 0, 0, 1));
+			Options.ProjectionMatrix = FReversedZPerspectiveMatrix(UE_HALF_PI * 0.5f, ViewSize.X, ViewSize.Y, 10.f);
+
+			FSceneView* View = new FSceneView(Options);
+			Family->Views.Add(View);
+			Views.Add(View);
+		}
+	}
+
+	FSceneViewFamily& GetFamily() { return *Family; }
+	const TArray<FSceneView*>& GetViews() const { return Views; }
+
+	// Adds the blendable to every view, like an IBlendableInterface::OverrideBlendableSettings would
+	template<typename TNode>
+	void PushBlendable(float Weight, const TNode& Node)
+	{
+		for (FSceneView* View : Views)
+		{
+			View->FinalPostProcessSettings.BlendableManager.PushBlendableData(Weight, Node);
+		}
+	}
+
+private:
+	// In this order, so the family deletes its views before the view states and the render target go away
+	FMultipassPPTestRenderTarget RenderTarget;
+	TArray<TUniquePtr<FSceneViewStateReference>> ViewStates;
+	TUniquePtr<FSceneViewFamilyContext> Family;
+	TArray<FSceneView*> Views;
+};
+
+// Sets a console variable for the lifetime of the scope, at the priority it was last set with, and puts the previous value back
+class FMultipassPPTestCVar
+{
+public:
+	FMultipassPPTestCVar(const TCHAR* Name, const TCHAR* Value)
+		: CVar(IConsoleManager::Get().FindConsoleVariable(Name))
+	{
+		if (CVar != nullptr)
+		{
+			PreviousValue = CVar->GetString();
+			CVar->Set(Value, GetSetBy());
+		}
+	}
+
+	~FMultipassPPTestCVar()
+	{
+		if (CVar != nullptr)
+		{
+			CVar->Set(*PreviousValue, GetSetBy());
+		}
+	}
+
+private:
+	EConsoleVariableFlags GetSetBy() const { return EConsoleVariableFlags(CVar->GetFlags() & ECVF_SetByMask); }
+
+	IConsoleVariable* CVar = nullptr;
+	FString PreviousValue;
+};
+
+namespace MultipassPPTest
+{
+	// Runs Func on the render thread and waits for it, so the _RenderThread functions read the render thread values of the cvars.
+	// Without a rendering thread it runs inline
+	template<typename TFunc>
+	void RunOnRenderThread(TFunc&& Func)
+	{
+		ENQUEUE_RENDER_COMMAND(MultipassPPTest)(
+			[&Func](FRHICommandListImmediate& RHICmdList)
+			{
+				Func();
+			});
+		FlushRenderingCommands();
+	}
+
+	// Nothing renders with -nullrhi, and the compute passes the rendering tests go through need SM5
+	inline bool CanRender()
+	{
+		return !GUsingNullRHI && GMaxRHIFeatureLevel >= ERHIFeatureLevel::SM5;
+	}
+
+	// Pooled texture holding Data, rows tightly packed. Recorded before the graph executes, like FMultipassPPReplay does. Render thread
+	inline TRefCountPtr<IPooledRenderTarget> UploadTexture(FRHICommandListImmediate& RHICmdList, const FIntPoint& Size, EPixelFormat Format, const void* Data, const TCHAR* DebugName)
+	{
+		const FPooledRenderTargetDesc Desc = FPooledRenderTargetDesc::Create2DDesc(Size, Format, FClearValueBinding::None, TexCreate_None, TexCreate_ShaderResource | TexCreate_RenderTargetable, false);
+
+		TRefCountPtr<IPooledRenderTarget> RT;
+		GRenderTargetPool.FindFreeElement(RHICmdList, Desc, RT, DebugName);
+
+		const FUpdateTextureRegion2D Region(0, 0, 0, 0, Size.X, Size.Y);
+		RHICmdList.UpdateTexture2D(RT->GetRHI(), 0, Region, Size.X * GPixelFormats[Format].BlockBytes, static_cast<const uint8*>(Data));
+		return RT;
+	}
+
+	// Submits what was recorded so far and waits for the GPU, so the readbacks queued by an executed graph are ready. Render thread
+	inline void FlushGPU(FRHICommandListImmediate& RHICmdList)
+	{
+		RHICmdList.SubmitCommandsAndFlushGPU();
+		RHICmdList.BlockUntilGPUIdle();
+	}
+
+	// Queues a copy of Texture for ReadTexels. Render thread
+	inline TUniquePtr<FRHIGPUTextureReadback> EnqueueReadback(FRDGBuilder& GraphBuilder, FRDGTextureRef Texture)
+	{
+		TUniquePtr<FRHIGPUTextureReadback> Readback = MakeUnique<FRHIGPUTextureReadback>(TEXT("MultipassPPTest.Readback"));
+		AddEnqueueCopyPass(GraphBuilder, Readback.Get(), Texture);
+		return Readback;
+	}
+
+	// The first Size texels of a readback, rows tightly packed. Empty if it isn't ready, call FlushGPU first. Render thread
+	template<typename TTexel>
+	TArray<TTexel> ReadTexels(FRHIGPUTextureReadback& Readback, const FIntPoint& Size)
+	{
+		TArray<TTexel> Texels;
+
+		int32 RowPitchInPixels = 0;
+		const TTexel* Data = Readback.IsReady() ? static_cast<const TTexel*>(Readback.Lock(RowPitchInPixels)) : nullptr;
+		if (Data != nullptr)
+		{
+			Texels.SetNumUninitialized(Size.X * Size.Y);
+			for (int32 Row = 0; Row < Size.Y; ++Row)
+			{
+				FMemory::Memcpy(&Texels[Row * Size.X], Data + SIZE_T(Row) * RowPitchInPixels, Size.X * sizeof(TTexel));
+			}
+			Readback.Unlock();
+		}
+		return Texels;
+	}
+
+	// What the game thread and the render thread do for every view each frame, without the passes: SetupView finds or creates the
+	// view data, then PreRenderView_RenderThread resolves its parameters
+	template<typename TExtension>
+	void SetupViews(TExtension& Extension, FMultipassPPTestViews& Views)
+	{
+		for (FSceneView* View : Views.GetViews())
+		{
+			Extension.SetupView(Views.GetFamily(), *View);
+		}
+
+		RunOnRenderThread([&Extension, &Views]()
+		{
+			for (FSceneView* View : Views.GetViews())
+			{
+				if (TSharedPtr<IMultipassPPViewData> ViewData = Extension.GetViewData(*View))
+				{
+					Extension.SetupViewData_RenderThread(*View, *ViewData);
+				}
+			}
+		});
+	}
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
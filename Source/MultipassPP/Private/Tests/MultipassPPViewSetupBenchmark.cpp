@@ -0,0 +1,200 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "MultipassPPTestFixtures.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "AdaptiveSharpenSceneExtension.h"
+#include "AdaptiveSharpenBlendable.h"
+#include "HAL/MemoryBase.h"
+#include "HAL/PlatformTLS.h"
+
+#include <atomic>
+
+// Forwards to the allocator it replaces, and counts the allocations made on one thread while it's installed.
+// Installed over GMalloc for the measured loops only, and never deleted, a thread may still be inside it after it's uninstalled
+class FMultipassPPAllocationCounter final : public FMalloc
+{
+public:
+	explicit FMultipassPPAllocationCounter(FMalloc* InInner)
+		: Inner(InInner)
+	{
+	}
+
+	// Counts the allocations the calling thread makes until the returned count is read with EndCounting
+	void BeginCounting()
+	{
+		NumAllocations = 0;
+		CountedThreadId = FPlatformTLS::GetCurrentThreadId();
+	}
+
+	uint64 EndCounting()
+	{
+		CountedThreadId = 0;
+		return NumAllocations;
+	}
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+	{
+		CountAllocation();
+		return Inner->Malloc(Count, Alignment);
+	}
+
+	virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+	{
+		CountAllocation();
+		return Inner->TryMalloc(Count, Alignment);
+	}
+
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		CountAllocation();
+		return Inner->Realloc(Original, Count, Alignment);
+	}
+
+	virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		CountAllocation();
+		return Inner->TryRealloc(Original, Count, Alignment);
+	}
+
+	virtual void Free(void* Original) override { Inner->Free(Original); }
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+	virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+	virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+	virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+	virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+	virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+	virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+
+private:
+	void CountAllocation()
+	{
+		if (CountedThreadId != 0 && FPlatformTLS::GetCurrentThreadId() == CountedThreadId)
+		{
+			++NumAllocations;
+		}
+	}
+
+	FMalloc* Inner;
+	std::atomic<uint32> CountedThreadId { 0 };
+	uint64 NumAllocations = 0;
+};
+
+// Installs the counter over GMalloc for the lifetime of the scope
+class FMultipassPPScopedAllocationCounter
+{
+public:
+	FMultipassPPScopedAllocationCounter()
+	{
+		static FMultipassPPAllocationCounter* AllocationCounter = new FMultipassPPAllocationCounter(GMalloc);
+		Counter = AllocationCounter;
+		Previous = GMalloc;
+		GMalloc = Counter;
+	}
+
+	~FMultipassPPScopedAllocationCounter()
+	{
+		GMalloc = Previous;
+	}
+
+	FMultipassPPAllocationCounter& Get() { return *Counter; }
+
+private:
+	FMultipassPPAllocationCounter* Counter;
+	FMalloc* Previous;
+};
+
+// Game thread and render thread cost per view of the view setup, with no passes: IsActiveThisFrame and SetupView on the game thread,
+// the view data lookup and the blendable resolution in SetupViewData_RenderThread on the render thread. Adaptive sharpen is used since
+// its blendables carry a parameter besides the weight. Runs with -nullrhi. The results are logged, there's nothing to compare them to
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMultipassPPViewSetupBenchmark, "MultipassPP.Benchmark.ViewSetup", MULTIPASSPP_TEST_CONTEXT_MASK | EAutomationTestFlags::PerfFilter)
+
+bool FMultipassPPViewSetupBenchmark::RunTest(const FString& Parameters)
+{
+	using FExtension = TMultipassPPTestExtension<FAdaptiveSharpenSceneExtension>;
+
+	static constexpr int32 NumFrames = 200;
+	const int32 ViewCounts[] = { 1, 8, 64 };
+	const int32 BlendableCounts[] = { 0, 1, 8, 32 };
+
+	// The blendables are walked, instead of the cvars short-circuiting them
+	FMultipassPPTestCVar Enabled(TEXT("r.AdaptiveSharpening.Enabled"), TEXT("-1"));
+	FMultipassPPTestCVar Strength(TEXT("r.AdaptiveSharpening.Strength"), TEXT("-1"));
+
+	TSharedRef<FExtension, ESPMode::ThreadSafe> Extension = FSceneViewExtensions::NewExtension<FExtension>();
+	const FSceneViewExtensionContext Context;
+
+	for (const int32 NumViews : ViewCounts)
+	{
+		for (const int32 NumBlendables : BlendableCounts)
+		{
+			FMultipassPPTestViews Views(NumViews);
+			for (int32 BlendableIndex = 0; BlendableIndex < NumBlendables; ++BlendableIndex)
+			{
+				FAdaptiveSharpenNode Node;
+				Node.Strength = 1.f + BlendableIndex;
+				Views.PushBlendable(1.f / (1 + BlendableIndex), Node);
+			}
+
+			// The first frame creates the view data, the measured ones only find it
+			MultipassPPTest::SetupViews(*Extension, Views);
+
+			uint64 GameThreadCycles = 0;
+			uint64 GameThreadAllocations = 0;
+			uint64 RenderThreadCycles = 0;
+			uint64 RenderThreadAllocations = 0;
+			{
+				FMultipassPPScopedAllocationCounter AllocationCounter;
+
+				AllocationCounter.Get().BeginCounting();
+				const uint64 StartCycles = FPlatformTime::Cycles64();
+				for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+				{
+					if (Extension->IsActiveThisFrame_Internal(Context))
+					{
+						for (FSceneView* View : Views.GetViews())
+						{
+							Extension->SetupView(Views.GetFamily(), *View);
+						}
+					}
+				}
+				GameThreadCycles = FPlatformTime::Cycles64() - StartCycles;
+				GameThreadAllocations = AllocationCounter.Get().EndCounting();
+
+				MultipassPPTest::RunOnRenderThread([&]()
+				{
+					AllocationCounter.Get().BeginCounting();
+					const uint64 RenderThreadStartCycles = FPlatformTime::Cycles64();
+					for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+					{
+						for (FSceneView* View : Views.GetViews())
+						{
+							if (TSharedPtr<IMultipassPPViewData> ViewData = Extension->GetViewData(*View))
+							{
+								Extension->SetupViewData_RenderThread(*View, *ViewData);
+							}
+						}
+					}
+					RenderThreadCycles = FPlatformTime::Cycles64() - RenderThreadStartCycles;
+					RenderThreadAllocations = AllocationCounter.Get().EndCounting();
+				});
+			}
+
+			// Make sure the measured loops did the work
+			TSharedPtr<FAdaptiveSharpenViewData> ViewData = StaticCastSharedPtr<FAdaptiveSharpenViewData>(Extension->GetViewData(*Views.GetViews()[0]));
+			TestTrue(FString::Printf(TEXT("%d views, %d blendables resolved"), NumViews, NumBlendables), ViewData.IsValid() && (NumBlendables == 0) == (ViewData->Strength == 0.f));
+
+			const double NumViewFrames = double(NumViews) * NumFrames;
+			AddInfo(FString::Printf(TEXT("%2d views, %2d blendables: game thread %7.1f ns/view, %5.2f allocations/frame. Render thread %7.1f ns/view, %5.2f allocations/frame"),
+				NumViews, NumBlendables,
+				FPlatformTime::ToSeconds64(GameThreadCycles) * 1e9 / NumViewFrames, double(GameThreadAllocations) / NumFrames,
+				FPlatformTime::ToSeconds64(RenderThreadCycles) * 1e9 / NumViewFrames, double(RenderThreadAllocations) / NumFrames));
+		}
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
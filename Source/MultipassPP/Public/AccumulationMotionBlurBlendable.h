@@ -16,6 +16,7 @@ struct MULTIPASSPP_API FAccumulationMotionBlurNode
 	}
 
 	float MotionBlurScale = 0.f;
+	int32 HistoryScale = 1;
 };
 
 /**
@@ -30,4 +31,9 @@ public:
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Accumulation Motion Blur", meta=(ExposeOnSpawn=true))
 		float MotionBlurScale = 0.01f;
+
+	// Keeps the history at a half (2) or a quarter (4) of the view resolution on each axis, and upsamples it guided by the
+	// full resolution frame. Saves 4x or 16x of the history's memory and bandwidth
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Accumulation Motion Blur", meta=(ExposeOnSpawn=true, ClampMin=1, ClampMax=4))
+		int32 HistoryScale = 1;
 };
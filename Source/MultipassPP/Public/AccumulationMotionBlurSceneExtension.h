@@ -9,10 +9,7 @@ public:
 	DECLARE_SHADER_TYPE(FAccumulationMotionBlurPixelShader, Global);
 	SHADER_USE_PARAMETER_STRUCT(FAccumulationMotionBlurPixelShader, FGlobalShader);
 
-	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
-	{
-		return true;
-	}
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
 
 	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
 		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
@@ -22,13 +19,88 @@ public:
 		SHADER_PARAMETER(uint32, LastFrameNumber)
 		SHADER_PARAMETER(FIntPoint, InputTextureSize)
 		SHADER_PARAMETER(FIntPoint, OutputTextureSize)
-		SHADER_PARAMETER(float, DeltaTime)
-		SHADER_PARAMETER(float, FadeTime)
-		SHADER_PARAMETER(float, FadeWeight)
+		SHADER_PARAMETER(float, HistoryWeight)
+		SHADER_PARAMETER(FVector2f, InputFootprintOffset)
+		RENDER_TARGET_BINDING_SLOTS()
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// Blends the full resolution frame with a reduced resolution history, upsampled by how close its luma is to the frame's
+class MULTIPASSPP_API FAccumulationMotionBlurCompositePS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FAccumulationMotionBlurCompositePS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FAccumulationMotionBlurCompositePS, FGlobalShader);
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, HistoryTexture)
+		SHADER_PARAMETER(FIntPoint, InputViewMin)
+		SHADER_PARAMETER(FIntPoint, OutputViewMin)
+		SHADER_PARAMETER(FIntPoint, OutputViewSize)
+		SHADER_PARAMETER(FIntPoint, HistoryViewSize)
+		SHADER_PARAMETER(uint32, LastFrameNumber)
+		SHADER_PARAMETER(float, HistoryWeight)
 		RENDER_TARGET_BINDING_SLOTS()
 	END_SHADER_PARAMETER_STRUCT()
 };
 
+BEGIN_SHADER_PARAMETER_STRUCT(FAccumulationMotionBlurTileParameters, MULTIPASSPP_API)
+	SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+	SHADER_PARAMETER_SAMPLER(SamplerState, InputSampler)
+	SHADER_PARAMETER(FVector4f, InputUVScaleBias)
+	SHADER_PARAMETER(FVector2f, InputFootprintOffset)
+	SHADER_PARAMETER(FIntPoint, OutputViewMin)
+	SHADER_PARAMETER(FIntPoint, OutputViewSize)
+	SHADER_PARAMETER(float, HistoryWeight)
+	SHADER_PARAMETER(float, ChangeThreshold)
+	SHADER_PARAMETER(uint32, bResetHistory)
+END_SHADER_PARAMETER_STRUCT()
+
+// Lists the tiles whose current frame still differs from the history
+class MULTIPASSPP_API FAccumulationMotionBlurClassifyCS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FAccumulationMotionBlurClassifyCS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FAccumulationMotionBlurClassifyCS, FGlobalShader);
+
+	// Picked per GPU and resolution by the AccumulationMotionBlur.TileSize tunable, see FMultipassPPAutoTuner
+	class FTileSizeDim : SHADER_PERMUTATION_SPARSE_INT("TILE_SIZE", 8, 16);
+	using FPermutationDomain = TShaderPermutationDomain<FTileSizeDim>;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FAccumulationMotionBlurTileParameters, Common)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, HistoryTexture)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, TileListUAV)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, IndirectArgsUAV)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// Blends the listed tiles into the history, dispatched indirectly
+class MULTIPASSPP_API FAccumulationMotionBlurBlendCS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FAccumulationMotionBlurBlendCS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FAccumulationMotionBlurBlendCS, FGlobalShader);
+
+	using FPermutationDomain = FAccumulationMotionBlurClassifyCS::FPermutationDomain;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FAccumulationMotionBlurTileParameters, Common)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, TileList)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, OutputTexture)
+		RDG_BUFFER_ACCESS(IndirectDispatchArgs, ERHIAccess::IndirectArgs)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
 struct MULTIPASSPP_API FAccumulationMotionBlurViewData : public FMultipassPPViewData
 {
 	FAccumulationMotionBlurViewData()
@@ -38,6 +110,14 @@ struct MULTIPASSPP_API FAccumulationMotionBlurViewData : public FMultipassPPView
 	uint32 LastFrameNumber = 0;
 	float Scale = 0.f;
 	float Weight = 0.f;
+
+	// The history is kept at 1/HistoryScale of the view resolution on each axis, 1, 2 or 4
+	int32 HistoryScale = 1;
+
+	virtual void SerializeParameters(FArchive& Ar) override
+	{
+		Ar << LastFrameNumber << Scale << Weight << HistoryScale;
+	}
 };
 
 class MULTIPASSPP_API FAccumulationMotionBlurSceneExtension
@@ -46,10 +126,25 @@ class MULTIPASSPP_API FAccumulationMotionBlurSceneExtension
 public:
 	FAccumulationMotionBlurSceneExtension(const FAutoRegister& AutoReg);
 
-	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override;
+	static FName GetEffectName()
+	{
+		static FName Name = "AccumulationMotionBlur";
+		return Name;
+	}
+
+	// Tile size of the tile skip passes, see FMultipassPPAutoTuner
+	static constexpr const TCHAR* TileSizeTunable = TEXT("AccumulationMotionBlur.TileSize");
+
+	// r.AccumulationMotionBlur.HistoryScale or the blendables' HistoryScale, rounded to 1, 2 or 4
+	static int32 GetHistoryScale(float Scale);
+
+	// Weight of the history for a frame DeltaTime long. It's down to Weight after Scale seconds. Constant across the frame, so it's computed here instead of per pixel
+	static float GetHistoryWeight(float DeltaTime, float Scale, float Weight);
+
 	virtual bool IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const override;
 
 protected:
+	virtual void SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& InViewData) override;
 	virtual FScreenPassTexture PostProcessPass_RenderThread(
 		FRDGBuilder& GraphBuilder,
 		const FSceneView& View,
@@ -66,6 +161,45 @@ protected:
 		FAccumulationMotionBlurPixelShader::FParameters* Parameters
 	);
 
+	// Draws the full resolution output from the frame and the reduced resolution history, before the frame is accumulated into it
+	void AddCompositePass_RenderThread(
+		FRDGBuilder& GraphBuilder,
+		const FViewInfo& ViewInfo,
+		const FScreenPassTexture& Input,
+		const FScreenPassTexture& History,
+		const FScreenPassRenderTarget& Output);
+
+	// Uses the tiled compute path when r.AccumulationMotionBlur.TileSkip is on, the pixel shader otherwise
+	virtual void AddPass_RenderThread(
+		FRDGBuilder& GraphBuilder,
+		const FSceneView& View,
+		const FViewInfo& ViewInfo,
+		const FScreenPassTexture& Input,
+		const FScreenPassRenderTarget& Output
+	) override;
+
+	// Classifies the tiles against the history, then only blends the ones that changed. The converged tiles are left untouched
+	void AddTiledPasses_RenderThread(
+		FRDGBuilder& GraphBuilder,
+		const FViewInfo& ViewInfo,
+		const FScreenPassTexture& Input,
+		const FScreenPassRenderTarget& Output);
+
+	virtual void PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap) override;
+
+	// The history is blurry by nature, so it can be kept at a lower resolution
+	virtual bool SupportsResolutionFraction() const override { return true; }
+
+	// The lower of the scalability settings' fraction and 1/HistoryScale
+	virtual float GetResolutionFraction(const IMultipassPPViewData& ViewData) const override;
+
+	// The history converges on a static image geometrically, the output is reused once it's within 1/255 of it
+	virtual int32 GetOutputReuseSettleFrames(const FSceneView& View) const override;
+	virtual uint32 GetOutputReuseParameterHash(const FSceneView& View) override;
+
+	// There's nothing to smear on a static frame
+	virtual float GetImageStatsImpact(const FMultipassPPImageStatsResult& Stats) const override { return Stats.MeanLumaDelta; }
+
 	virtual TSharedPtr<IMultipassPPViewData> ConstructViewData(const FSceneView& InView) override
 	{
 		return MakeShared<FAccumulationMotionBlurViewData>();
@@ -2,7 +2,9 @@
 
 #pragma once
 
-#include "MultipassPPSceneExtension.h"
+#include "MultipassPPPipeline.h"
+#include "MultipassPPImageCompare.h"
+#include "SceneRenderTargetParameters.h"
 
 class MULTIPASSPP_API FAdaptiveSharpenPixelShaderPass1 : public FGlobalShader
 {
@@ -10,15 +12,29 @@ public:
 	DECLARE_SHADER_TYPE(FAdaptiveSharpenPixelShaderPass1, Global);
 	SHADER_USE_PARAMETER_STRUCT(FAdaptiveSharpenPixelShaderPass1, FGlobalShader);
 
-	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
-	{
-		return true;
-	}
+	// Also writes the edge map to a second target, and reprojects last frame's edges instead of recomputing them outside of this frame's update band
+	class FEdgeHistoryDim : SHADER_PERMUTATION_BOOL("EDGE_HISTORY");
+	using FPermutationDomain = TShaderPermutationDomain<FEdgeHistoryDim>;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
 
 	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
 		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
 		SHADER_PARAMETER_SAMPLER(SamplerState, InputSampler)
 		SHADER_PARAMETER(FVector2f, PixelUVSize)
+
+		// EDGE_HISTORY only
+		SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+		SHADER_PARAMETER_RDG_UNIFORM_BUFFER(FSceneTextureUniformParameters, SceneTexturesStruct)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, EdgeHistoryTexture)
+		SHADER_PARAMETER_SAMPLER(SamplerState, EdgeHistorySampler)
+		SHADER_PARAMETER(FVector2f, OutputViewMin)
+		SHADER_PARAMETER(FVector2f, OutputViewSize)
+		SHADER_PARAMETER(FVector2f, EdgeHistoryInvExtent)
+		SHADER_PARAMETER(uint32, bEdgeHistoryValid)
+		SHADER_PARAMETER(uint32, NumEdgeUpdateBands)
+		SHADER_PARAMETER(uint32, EdgeUpdateBand)
+
 		RENDER_TARGET_BINDING_SLOTS()
 	END_SHADER_PARAMETER_STRUCT()
 };
@@ -29,10 +45,14 @@ public:
 	DECLARE_SHADER_TYPE(FAdaptiveSharpenPixelShaderPass2, Global);
 	SHADER_USE_PARAMETER_STRUCT(FAdaptiveSharpenPixelShaderPass2, FGlobalShader);
 
-	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
-	{
-		return true;
-	}
+	// r.AdaptiveSharpening.Quality. 0: 5 tap contrast adaptive, 1: 9 tap contrast adaptive, 2: full adaptive sharpen. The first two don't need pass 1
+	class FQualityDim : SHADER_PERMUTATION_RANGE_INT("QUALITY", 0, 3);
+	// r.AdaptiveSharpening.FastMath. Half precision and cheaper transcendentals, full quality only
+	class FFastMathDim : SHADER_PERMUTATION_BOOL("FAST_MATH");
+	using FPermutationDomain = TShaderPermutationDomain<FQualityDim, FFastMathDim>;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
 
 	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
 		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
@@ -49,24 +69,104 @@ struct MULTIPASSPP_API FAdaptiveSharpenViewData : public FMultipassPPViewData
 	{
 		RTDebugName = "AdaptiveSharpen_RT";
 		RTPixelFormat = ETextureRenderTargetFormat::RTF_RGBA32f;
+		RTCompactPixelFormat = ETextureRenderTargetFormat::RTF_RGBA16f;
 		RTClearValueBinding = FClearValueBinding::Transparent;
 	}
 
 	float BlendableWeight = 0.f;
 	float Strength = 1.f;
+
+	// Set when the view family has the adaptive sharpen spatial upscaler installed as its primary or secondary upscaler, in which
+	// case the FXAA time pass can be skipped
+	bool bPrimaryUpscalerInstalled = false;
+	bool bSecondaryUpscalerInstalled = false;
+
+	// Only the full quality tier reads the edge map, the CAS tiers sharpen straight from scene color
+	bool bNeedsEdgeMap = true;
+
+	// Last frame's edge map, when r.AdaptiveSharpening.EdgeUpdateInterval is above 1. Render thread only
+	TRefCountPtr<IPooledRenderTarget> EdgeHistory;
+	uint32 EdgeUpdateFrame = 0;
+
+	virtual void SetupRT(const FIntPoint& Resolution) override
+	{
+		if (!bNeedsEdgeMap)
+		{
+			RT.SafeRelease();
+			EdgeHistory.SafeRelease();
+			return;
+		}
+		FMultipassPPViewData::SetupRT(Resolution);
+	}
+
+	virtual SIZE_T ComputeGPUMemorySize_RenderThread() const override
+	{
+		return FMultipassPPViewData::ComputeGPUMemorySize_RenderThread() + (EdgeHistory.IsValid() ? EdgeHistory->ComputeMemorySize() : 0);
+	}
+
+	// The edge history itself isn't captured, so replays with r.AdaptiveSharpening.EdgeUpdateInterval above 1 reproject the view's own
+	virtual void SerializeParameters(FArchive& Ar) override
+	{
+		Ar << BlendableWeight << Strength << bPrimaryUpscalerInstalled << bSecondaryUpscalerInstalled << EdgeUpdateFrame;
+	}
+};
+
+class FAdaptiveSharpenSceneExtension;
+
+// Pass 1: Scene color -> view data RT
+struct FAdaptiveSharpenPass1 : public FMultipassPPPipelinePass
+{
+	using ShaderType = FAdaptiveSharpenPixelShaderPass1;
+	static constexpr int32 Input = MultipassPPPipeline::SceneColor;
+	static constexpr EMultipassPPPassTarget Target = EMultipassPPPassTarget::ViewData;
+
+	static const TCHAR* GetName() { return TEXT("Pass 1"); }
+	static FRHIBlendState* GetBlendState() { return TStaticBlendStateWriteMask<CW_RGBA, CW_RED, CW_NONE, CW_NONE, CW_NONE, CW_NONE, CW_NONE, CW_NONE>::GetRHI(); }
+	static void SetupParameters(FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters);
+	static ShaderType::FPermutationDomain GetPermutationVector(const FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context);
+
+	// Only the full quality kernel needs the edge map
+	static bool IsEnabled(const FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context);
 };
 
+// Pass 2: View data RT (or the scene color on the lower quality tiers) -> Output
+struct FAdaptiveSharpenPass2 : public FMultipassPPPipelinePass
+{
+	using ShaderType = FAdaptiveSharpenPixelShaderPass2;
+	static constexpr int32 Input = 0;
+	static constexpr EMultipassPPPassTarget Target = EMultipassPPPassTarget::Output;
+
+	static const TCHAR* GetName() { return TEXT("Pass 2"); }
+	static FRHIBlendState* GetBlendState() { return TStaticBlendStateWriteMask<CW_RGBA, CW_NONE, CW_NONE, CW_NONE, CW_NONE, CW_NONE, CW_NONE, CW_NONE>::GetRHI(); }
+	static void SetupParameters(FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters);
+	static ShaderType::FPermutationDomain GetPermutationVector(const FAdaptiveSharpenSceneExtension& Extension, const FMultipassPPPipelineContext& Context);
+};
 
 /**
  * 
  */
 class MULTIPASSPP_API FAdaptiveSharpenSceneExtension
-	: public FMultipassPPSceneExtension
+	: public TMultipassPPPipeline<FAdaptiveSharpenSceneExtension, FAdaptiveSharpenPass1, FAdaptiveSharpenPass2>
 {
 public:
 	FAdaptiveSharpenSceneExtension(const FAutoRegister& AutoReg);
 
-	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override;
+	static FName GetEffectName()
+	{
+		static FName Name = "AdaptiveSharpening";
+		return Name;
+	}
+
+	// r.MultipassPP.AdaptiveSharpening.Quality if the scalability settings set it, r.AdaptiveSharpening.Quality otherwise.
+	// Clamped to the tiers FAdaptiveSharpenPixelShaderPass2 has. Render thread
+	int32 GetQuality() const;
+	static constexpr int32 FullQuality = 2;
+
+	// Pass 2 permutation for the current quality and r.AdaptiveSharpening.FastMath. Render thread
+	FAdaptiveSharpenPixelShaderPass2::FPermutationDomain GetPass2PermutationVector() const;
+
+	virtual void SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& InViewData) override;
+	virtual void BeginRenderViewFamily(FSceneViewFamily& InViewFamily) override;
 	virtual bool IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const override;
 
 	virtual FScreenPassTexture PostProcessPass_RenderThread(
@@ -92,14 +192,45 @@ public:
 		const FScreenPassRenderTarget& Output,
 		FAdaptiveSharpenPixelShaderPass2::FParameters* Parameters);
 
-	// PassNum is either 1 or 2
-	void DrawPass(int32 PassNum, FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output);
+	// Called by the spatial upscaler. Runs pass 1 at the input resolution, then pass 2 at the output resolution
+	// with a bilinear fetch of pass 1, so the edge-aware sharpen is also the upscale filter
+	FScreenPassTexture AddUpscalePasses_RenderThread(
+		FRDGBuilder& GraphBuilder,
+		const FViewInfo& ViewInfo,
+		const FScreenPassTexture& SceneColor,
+		const FScreenPassRenderTarget& OverrideOutput,
+		const FIntRect& OutputRect);
+
+	// Binds the edge history and queues this frame's edge map as the next frame's history, when the edge map is amortized over several frames.
+	// Returns false if it isn't
+	bool SetupEdgeHistoryParameters(
+		FRDGBuilder& GraphBuilder,
+		const FViewInfo& ViewInfo,
+		const FPostProcessMaterialInputs& InOutInputs,
+		const FScreenPassRenderTarget& Output,
+		FAdaptiveSharpenPixelShaderPass1::FParameters* Parameters);
 
 	virtual size_t GetTypeHash() const override;
 
 protected:
-	FRHIBlendState* BlendState = TStaticBlendStateWriteMask<CW_RGBA, CW_NONE, CW_NONE, CW_NONE, CW_NONE, CW_NONE, CW_NONE, CW_NONE>::GetRHI();
-	FRHIDepthStencilState* DepthStencilState = FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI();
+	// Sharpening has no history, so the output can be reused as soon as the view stops changing
+	virtual int32 GetOutputReuseSettleFrames(const FSceneView& View) const override { return 0; }
+	virtual uint32 GetOutputReuseParameterHash(const FSceneView& View) override;
+
+	// Soft or dark frames have little to sharpen
+	virtual float GetImageStatsImpact(const FMultipassPPImageStatsResult& Stats) const override { return Stats.MeanEdgeStrength; }
+
+	virtual void GetViewDataPixelFormats(TArray<EPixelFormat>& OutFormats) const override;
+
+	// True if the spatial upscaler is going to sharpen this view later in the frame. Never while a region mask is set
+	bool WillSpatialUpscalerRun(const FViewInfo& ViewInfo, const FAdaptiveSharpenViewData& ViewData) const;
+
+	// r.AdaptiveSharpening.FastMath.Validate. Renders pass 2 again with the reference shader and compares it with Output
+	void AddFastMathValidationPasses_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassTexture& Output);
+
+	// Created on the first validated frame, and released once its readbacks are drained after validation is turned off. Render thread only
+	TUniquePtr<FMultipassPPImageCompare> FastMathCompare;
+	float FastMathMaxDifference = 0.f;
 
 	virtual TSharedPtr<IMultipassPPViewData> ConstructViewData(const FSceneView& InView) { return MakeShared<FAdaptiveSharpenViewData>(); };
 };
@@ -1,26 +1,55 @@
 #pragma once
 
 #include "MultipassPPSceneExtension.h"
+#include "MultipassPPComputeShader.h"
 
+// Weaves the current field with the previous one. Only runs one thread per pixel of the field
+class MULTIPASSPP_API FInterlacePPComputeShader : public TMultipassPPComputeShader<8, 8>
+{
+public:
+	DECLARE_SHADER_TYPE(FInterlacePPComputeShader, Global);
+	SHADER_USE_PARAMETER_STRUCT(FInterlacePPComputeShader, TMultipassPPComputeShader);
+
+	// Group shapes the InterlacingPP.GroupShape tunable picks from, see FMultipassPPAutoTuner. Wider groups read longer runs of each row
+	static constexpr int32 NumGroupShapes = 3;
+	static FIntPoint GetGroupShape(int32 GroupShape);
+	class FGroupShapeDim : SHADER_PERMUTATION_INT("GROUP_SHAPE", NumGroupShapes);
+	using FPermutationDomain = TShaderPermutationDomain<FGroupShapeDim>;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FMultipassPPComputeCommonParameters, Common)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+		SHADER_PARAMETER_SAMPLER(SamplerState, InputSampler)
+		SHADER_PARAMETER(FVector4f, InputUVScaleBias)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, FieldHistory)
+		SHADER_PARAMETER(uint32, FrameNumber)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// Same as FInterlacePPComputeShader for the feature levels without compute. One permutation weaves the fields into the view,
+// the other stores the current field in the history
 class MULTIPASSPP_API FInterlacePPPixelShader : public FGlobalShader
 {
 public:
 	DECLARE_SHADER_TYPE(FInterlacePPPixelShader, Global);
 	SHADER_USE_PARAMETER_STRUCT(FInterlacePPPixelShader, FGlobalShader);
 
-	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
-	{
-		return true;
-	}
+	class FWriteHistoryDim : SHADER_PERMUTATION_BOOL("WRITE_HISTORY");
+	using FPermutationDomain = TShaderPermutationDomain<FWriteHistoryDim>;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
 
 	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
 		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
 		SHADER_PARAMETER_SAMPLER(SamplerState, InputSampler)
-		SHADER_PARAMETER(float, Time)
-		SHADER_PARAMETER(float, Weight)
+		SHADER_PARAMETER(FVector4f, InputUVScaleBias)
+		SHADER_PARAMETER(FIntPoint, OutputViewMin)
+		SHADER_PARAMETER(FIntPoint, OutputViewSize)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, FieldHistory)
 		SHADER_PARAMETER(uint32, FrameNumber)
-		SHADER_PARAMETER(uint32, ResX)
-		SHADER_PARAMETER(uint32, ResY)
 		RENDER_TARGET_BINDING_SLOTS()
 	END_SHADER_PARAMETER_STRUCT()
 };
@@ -30,28 +59,54 @@ struct MULTIPASSPP_API FInterlacePPViewData : public FMultipassPPViewData
 	FInterlacePPViewData()
 	{
 		RTDebugName = "InterlacePP_RT";
+
+		// Written through a UAV, which can't have an sRGB format. The scene color is already encoded at this point, and SetupRT never
+		// created the target with TexCreate_SRGB, so this is the same 8 bit target the sRGB format gave
+		RTPixelFormat = ETextureRenderTargetFormat::RTF_RGBA8;
+	}
+
+	// The RT only holds one field, so it's half the height of the view
+	virtual void SetupRT(const FIntPoint& Resolution) override
+	{
+		FMultipassPPViewData::SetupRT(FIntPoint(Resolution.X, (Resolution.Y + 1) / 2));
 	}
 
 	float BlendableWeight = 0.f;
 	uint32 LastFrameNumber = 0;
 	float LastFrameTime = 0.f;
+
+	virtual void SerializeParameters(FArchive& Ar) override
+	{
+		Ar << BlendableWeight << LastFrameNumber << LastFrameTime;
+	}
 };
 
-class MULTIPASSPP_API FInterlacePPSceneExtension 
-	: public FMultipassPPSceneExtensionWithShader<FInterlacePPSceneExtension, FInterlacePPPixelShader>
+class MULTIPASSPP_API FInterlacePPSceneExtension : public FMultipassPPSceneExtension
 {
 public:
 	FInterlacePPSceneExtension(const FAutoRegister& AutoReg);
 
-	virtual bool IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const override;
+	static FName GetEffectName()
+	{
+		static FName Name = "InterlacingPP";
+		return Name;
+	}
 
-	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override;
+	// Group shape of the interlace dispatch, see FMultipassPPAutoTuner
+	static constexpr const TCHAR* GroupShapeTunable = TEXT("InterlacingPP.GroupShape");
+
+	virtual bool IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const override;
 
 	virtual int32 GetPriority() const override { return 100; }
 
 	virtual size_t GetTypeHash() const override;
 
+	virtual void PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap) override;
+
 protected:
+	virtual void SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& InViewData) override;
+
+	// Writes the whole frame in one compute dispatch over the field, instead of blending every pixel of the view into a full height RT
 	virtual FScreenPassTexture PostProcessPass_RenderThread(
 		FRDGBuilder& GraphBuilder,
 		const FSceneView& View,
@@ -65,10 +120,25 @@ protected:
 		const FViewInfo& ViewInfo,
 		const FScreenPassTexture& Input,
 		const FScreenPassRenderTarget& Output,
-		FInterlacePPPixelShader::FParameters* Parameters
+		FRDGTextureRef FieldHistory,
+		FInterlacePPComputeShader::FParameters* Parameters
+	);
+
+	// Below SM5, draws the view then the history with FInterlacePPPixelShader
+	FScreenPassTexture AddPixelShaderPasses_RenderThread(
+		FRDGBuilder& GraphBuilder,
+		const FViewInfo& ViewInfo,
+		const FPostProcessMaterialInputs& InOutInputs,
+		const FScreenPassTexture& SceneColor,
+		FRDGTextureRef FieldHistory
 	);
 
 	virtual TSharedPtr<IMultipassPPViewData> ConstructViewData(const FSceneView& InView) override;
 
-	friend class FMultipassPPSceneExtensionWithShader<FInterlacePPSceneExtension, FInterlacePPPixelShader, FInterlacePPPixelShader::FParameters>;
-};
\ No newline at end of file
+	// Each frame only writes every other line, so it takes two frames for both fields to hold the same image
+	virtual int32 GetOutputReuseSettleFrames(const FSceneView& View) const override { return 2; }
+	virtual uint32 GetOutputReuseParameterHash(const FSceneView& View) override;
+
+	// The fields only differ where the frame changes
+	virtual float GetImageStatsImpact(const FMultipassPPImageStatsResult& Stats) const override { return Stats.MeanLumaDelta; }
+};
@@ -5,8 +5,11 @@
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
 
+DECLARE_LOG_CATEGORY_EXTERN(LogMultipassPP, Log, All);
+
 class FInterlacePPSceneExtension;
 class FAccumulationMotionBlurSceneExtension;
+class FAdaptiveSharpenSceneExtension;
 
 class FMultipassPPModule : public IModuleInterface
 {
@@ -16,12 +19,11 @@ public:
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
 
+	// These return nullptr until the effect has been created by the effect registry. See FMultipassPPEffectRegistry
 	TSharedPtr<class FInterlacePPSceneExtension> GetInterlaceSceneExtension();
 	TSharedPtr<class FAccumulationMotionBlurSceneExtension> GetAccumulationMotionBlurSceneExtension();
 	TSharedPtr<class FAdaptiveSharpenSceneExtension> GetSharpenSceneExtension();
 
 protected:
-	TSharedPtr<class FInterlacePPSceneExtension> InterlaceSceneExtension;
-	TSharedPtr<class FAccumulationMotionBlurSceneExtension> MotionBlurSceneExtension;
-	TSharedPtr<class FAdaptiveSharpenSceneExtension> SharpenSceneExtension;
+	FDelegateHandle PostEngineInitHandle;
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RHIResources.h"
+
+class FRDGBuilder;
+
+// A dispatch setting with a few candidate values whose best choice depends on the GPU and the resolution, e.g. a tile or group size.
+// Every candidate has to produce the same image, only its cost may differ
+struct FMultipassPPTunableDesc
+{
+	FName Name;
+
+	// Shown in the log and written to the saved results, e.g. "8x8"
+	TArray<FString> Candidates;
+
+	// Used until the tunable has been tuned for the adapter and resolution bucket
+	int32 DefaultCandidate = 0;
+};
+
+// Picks the fastest candidate of every tunable per GPU and resolution bucket. While a tunable is being tuned, the frames cycle
+// through its candidates and the passes it affects are timed with GPU timestamps. The winner is saved to
+// Saved/Config/MultipassPPAutoTune.ini under the adapter's name, and loaded on the next start, so tuning only happens once per machine.
+// Tuning is started with r.MultipassPP.AutoTune, or automatically the first time a tunable runs with r.MultipassPP.AutoTune.OnFirstUse
+class MULTIPASSPP_API FMultipassPPAutoTuner
+{
+public:
+	static FMultipassPPAutoTuner& Get();
+
+	void RegisterTunable(FMultipassPPTunableDesc&& Desc);
+
+	// Loads the saved results for this adapter. Called by the module on post engine init
+	void Initialize();
+	void Shutdown();
+
+	// Starts tuning the named tunables, or every tunable if Names is empty, at the resolution of the next views they run in. Game thread only
+	void StartTuning(const TArray<FName>& Names, int32 FramesPerCandidate);
+
+	// Forgets every result for this adapter, saved ones included. Game thread only
+	void ResetResults();
+
+	// Name of the resolution bucket results are saved under, e.g. "1080p"
+	static FString GetResolutionBucket(FIntPoint ViewSize);
+
+private:
+	friend class FMultipassPPAutoTuneScope;
+
+	struct FPendingTiming
+	{
+		int32 Candidate = 0;
+		FRHIPooledRenderQuery Begin;
+		FRHIPooledRenderQuery End;
+	};
+
+	struct FTunableState
+	{
+		FMultipassPPTunableDesc Desc;
+
+		// Bucket to winning candidate. Render thread only after Initialize
+		TMap<FString, int32> Winners;
+
+		// Tuning state, render thread only
+		bool bTuneRequested = false;
+		bool bTuning = false;
+		FString TuningBucket;
+		int32 FramesPerCandidate = 16;
+		int32 NumTunedFrames = 0;
+		uint64 LastTunedFrame = 0;
+		int32 FrameCandidate = 0;
+		TArray<TArray<double>> Samples;
+		TArray<FPendingTiming> Pending;
+	};
+
+	// Candidate to use for this frame, and whether it should be timed. Render thread only
+	int32 BeginUse_RenderThread(FTunableState& State, FIntPoint ViewSize, bool& bOutTimed);
+
+	// Reads the timings that are ready, and picks the winner once every candidate has enough of them
+	void PollTimings_RenderThread(FTunableState& State);
+	void FinishTuning_RenderThread(FTunableState& State);
+
+	void SaveResult(FName Tunable, const FString& Bucket, const FString& Candidate) const;
+	FString GetConfigFilename() const;
+	FString GetAdapterSection() const;
+
+	TMap<FName, FTunableState> Tunables;
+	FRenderQueryPoolRHIRef QueryPool;
+};
+
+// Brackets the passes of a tunable with GPU timestamps while it's being tuned, and tells them which candidate to use.
+// Create it before adding the passes and let it go out of scope after them. Render thread only
+class MULTIPASSPP_API FMultipassPPAutoTuneScope
+{
+public:
+	FMultipassPPAutoTuneScope(FRDGBuilder& InGraphBuilder, FName Tunable, FIntPoint ViewSize);
+	~FMultipassPPAutoTuneScope();
+
+	int32 GetCandidate() const { return Candidate; }
+
+private:
+	FRDGBuilder& GraphBuilder;
+	FMultipassPPAutoTuner::FTunableState* State = nullptr;
+	int32 TimingIndex = INDEX_NONE;
+	int32 Candidate = 0;
+};
+
+// Registers a tunable with the auto tuner on static init
+struct MULTIPASSPP_API FMultipassPPTunableRegistration
+{
+	FMultipassPPTunableRegistration(FName Name, std::initializer_list<const TCHAR*> Candidates, int32 DefaultCandidate = 0);
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ScreenPass.h"
+#include "HAL/PlatformMemory.h"
+
+class FRHIGPUTextureReadback;
+
+// A captured frame. Data is only valid for the duration of the callback
+struct FMultipassPPCapturedFrame
+{
+	uint64 FrameNumber = 0;
+	// FSceneViewStateInterface::GetViewKey of the view the frame was captured from, to tell views apart in split screen
+	uint32 ViewKey = 0;
+	FIntPoint Size = FIntPoint::ZeroValue;
+	EPixelFormat Format = PF_Unknown;
+	int32 RowPitchInBytes = 0;
+	const uint8* Data = nullptr;
+};
+
+// Called on the render thread whenever a captured frame is read back
+DECLARE_DELEGATE_OneParam(FOnMultipassPPFrameCaptured, const FMultipassPPCapturedFrame&);
+
+// Layout of the shared memory ring written by FMultipassPPCaptureTap::OpenSharedMemory, for external consumers:
+// FMultipassPPCaptureSharedHeader, then NumSlots slots of SlotSize bytes. Each slot is a FMultipassPPCaptureSlotHeader followed by the pixels.
+// The producer writes slot WriteCount % NumSlots and then increments WriteCount. The consumer increments ReadCount when it's done with a slot.
+// Frames are dropped, and DroppedFrames incremented, while WriteCount - ReadCount == NumSlots.
+struct FMultipassPPCaptureSharedHeader
+{
+	static constexpr uint32 ExpectedMagic = 0x4D505043; // 'MPPC'
+	static constexpr uint32 ExpectedVersion = 2;
+
+	uint32 Magic;
+	uint32 Version;
+	uint32 NumSlots;
+	uint32 SlotSize;
+	volatile uint64 WriteCount;
+	volatile uint64 ReadCount;
+	volatile uint64 DroppedFrames;
+};
+
+struct FMultipassPPCaptureSlotHeader
+{
+	uint64 FrameNumber;
+	uint32 Width;
+	uint32 Height;
+	uint32 RowPitchInBytes;
+	uint32 PixelFormat;
+	uint32 ViewKey;
+};
+
+// Copies an effect's output into a ring of staging textures and reads them back a few frames later, once the GPU is done with them,
+// so capturing never stalls the render thread. Set it on an extension with FMultipassPPSceneExtension::SetCaptureTap.
+// A frame is dropped when every staging texture is still in flight or when the shared memory consumer hasn't caught up.
+// The readbacks are polled at the end of every frame, so the last frames are still delivered once the tap stops being used.
+class MULTIPASSPP_API FMultipassPPCaptureTap : public TSharedFromThis<FMultipassPPCaptureTap, ESPMode::ThreadSafe>
+{
+public:
+	FMultipassPPCaptureTap(int32 InNumReadbacks = 3);
+	// Delivers the frames still in flight before it goes
+	~FMultipassPPCaptureTap();
+
+	// Not thread safe. Set these up before handing the tap to an extension
+	void SetCallback(FOnMultipassPPFrameCaptured&& InCallback) { Callback = MoveTemp(InCallback); }
+
+	// Also writes every frame into a named shared memory ring another process can map. Frames bigger than MaxFrameBytes are dropped
+	bool OpenSharedMemory(const FString& Name, int32 NumSlots, SIZE_T MaxFrameBytes);
+	void CloseSharedMemory();
+
+	// Delivers the readbacks that are ready, then queues a copy of Texture's view rect. Render thread only
+	void AddCapturePass(FRDGBuilder& GraphBuilder, const FScreenPassTexture& Texture, uint32 ViewKey);
+
+	// Delivers the readbacks that are ready without queueing a new one. Render thread only
+	void PollReadbacks();
+
+	uint64 GetNumCapturedFrames() const { return NumCapturedFrames; }
+	uint64 GetNumDroppedFrames() const { return NumDroppedFrames; }
+
+private:
+	// Takes over Other's readbacks and shared memory, for a destructor that isn't on the render thread
+	FMultipassPPCaptureTap(FMultipassPPCaptureTap&& Other);
+
+	// Waits for the GPU and delivers every readback still in flight. Render thread only
+	void DrainReadbacks();
+
+	struct FReadback
+	{
+		TUniquePtr<FRHIGPUTextureReadback> Readback;
+		uint64 FrameNumber = 0;
+		uint32 ViewKey = 0;
+		FIntPoint Size = FIntPoint::ZeroValue;
+		EPixelFormat Format = PF_Unknown;
+		bool bInFlight = false;
+	};
+
+	void Deliver(const FMultipassPPCapturedFrame& Frame);
+	void WriteToSharedMemory(const FMultipassPPCapturedFrame& Frame);
+
+	TArray<FReadback> Readbacks;
+	int32 NextWrite = 0;
+	int32 NextRead = 0;
+
+	// Set once the tap is polled at the end of every frame. Render thread only
+	bool bPolledAtEndOfFrame = false;
+
+	FOnMultipassPPFrameCaptured Callback;
+
+	FPlatformMemory::FSharedMemoryRegion* SharedMemory = nullptr;
+	FMultipassPPCaptureSharedHeader* SharedHeader = nullptr;
+
+	uint64 NumCapturedFrames = 0;
+	uint64 NumDroppedFrames = 0;
+};
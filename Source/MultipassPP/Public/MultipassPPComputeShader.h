@@ -0,0 +1,200 @@
+#pragma once
+
+#include "MultipassPPSceneExtension.h"
+#include "MultipassPPRegionMask.h"
+#include "GlobalShader.h"
+#include "RenderGraphUtils.h"
+#include "SystemTextures.h"
+
+// Parameters every TMultipassPPComputeShader needs. Include them in the shader's parameter struct as
+// SHADER_PARAMETER_STRUCT_INCLUDE(FMultipassPPComputeCommonParameters, Common) and include /MultipassPP/Private/MultipassPPCompute.ush in the usf
+BEGIN_SHADER_PARAMETER_STRUCT(FMultipassPPComputeCommonParameters, MULTIPASSPP_API)
+	SHADER_PARAMETER(FIntPoint, InputViewMin)
+	SHADER_PARAMETER(FIntPoint, InputViewSize)
+	SHADER_PARAMETER(FIntPoint, OutputViewMin)
+	SHADER_PARAMETER(FIntPoint, OutputViewSize)
+	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, OutputTexture)
+	// Set with MultipassPPCompute::SetupRegionMaskTiles. With a region mask, the groups are dispatched over RegionTileList
+	SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, RegionTileList)
+	SHADER_PARAMETER(uint32, bRegionTileList)
+	RDG_BUFFER_ACCESS(IndirectDispatchArgs, ERHIAccess::IndirectArgs)
+END_SHADER_PARAMETER_STRUCT()
+
+namespace MultipassPPCompute
+{
+	// Binds the tiles of AddMultipassPPRegionMaskClassifyPass, or an unused tile list when Tiles is null
+	inline void SetupRegionMaskTiles(FRDGBuilder& GraphBuilder, const FMultipassPPRegionMaskTiles* Tiles, FMultipassPPComputeCommonParameters& Common)
+	{
+		FRDGBufferRef TileList = Tiles != nullptr ? Tiles->TileList : GSystemTextures.GetDefaultBuffer(GraphBuilder, sizeof(uint32));
+		Common.RegionTileList = GraphBuilder.CreateSRV(TileList, PF_R32_UINT);
+		Common.bRegionTileList = Tiles != nullptr ? 1 : 0;
+		Common.IndirectDispatchArgs = Tiles != nullptr ? Tiles->IndirectArgs : nullptr;
+	}
+
+	// Dispatches GroupCount groups, or one group per listed tile when SetupRegionMaskTiles was given tiles
+	template<typename TShaderType>
+	void AddPass(FRDGBuilder& GraphBuilder, FRDGEventName&& PassName, const TShaderRef<TShaderType>& ComputeShader, typename TShaderType::FParameters* Parameters, const FIntVector& GroupCount)
+	{
+		if (Parameters->Common.IndirectDispatchArgs != nullptr)
+		{
+			FComputeShaderUtils::AddPass(GraphBuilder, MoveTemp(PassName), ComputeShader, Parameters, Parameters->Common.IndirectDispatchArgs, 0);
+		}
+		else
+		{
+			FComputeShaderUtils::AddPass(GraphBuilder, MoveTemp(PassName), ComputeShader, Parameters, GroupCount);
+		}
+	}
+}
+
+// Base class for compute shaders used with FMultipassPPSceneExtensionWithComputeShader. Each group covers a
+// GroupSizeX x GroupSizeY tile of the output. With a TileBorder, MultipassPPComputeTile.ush can cache the tile plus
+// TileBorder texels on each side in groupshared memory for shaders that read their neighbours.
+// Shaders find their tile with GetGroupTile(SV_GroupID), not SV_DispatchThreadID, so they can be dispatched over the tiles of a region mask.
+template<int32 InGroupSizeX, int32 InGroupSizeY = InGroupSizeX, int32 InTileBorder = 0>
+class TMultipassPPComputeShader : public FGlobalShader
+{
+public:
+	static constexpr int32 GroupSizeX = InGroupSizeX;
+	static constexpr int32 GroupSizeY = InGroupSizeY;
+	static constexpr int32 TileBorder = InTileBorder;
+
+	static_assert(GroupSizeX * GroupSizeY <= 1024, "Compute groups can't have more than 1024 threads");
+	static_assert(TileBorder >= 0 && TileBorder <= FMath::Min(GroupSizeX, GroupSizeY), "The tile border can't be wider than the group");
+
+	TMultipassPPComputeShader() = default;
+	TMultipassPPComputeShader(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
+		: FGlobalShader(Initializer)
+	{
+
+	}
+
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZEX"), GroupSizeX);
+		OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZEY"), GroupSizeY);
+		OutEnvironment.SetDefine(TEXT("TILE_BORDER"), TileBorder);
+	}
+
+	static FIntVector GetGroupCount(const FIntPoint& OutputSize)
+	{
+		return FComputeShaderUtils::GetGroupCount(OutputSize, FIntPoint(GroupSizeX, GroupSizeY));
+	}
+};
+
+// Same as FMultipassPPSceneExtensionWithShader, but dispatches a compute shader over the output's ViewRect instead of drawing a full screen triangle.
+// The output is bound as a UAV through TParametersType::Common, derived classes bind everything else in SetupParameters.
+// With a region mask, only the tiles holding included pixels are dispatched, and the excluded pixels are filled with the input afterwards.
+template<typename TDerivedType, typename TShaderType, typename TParametersType = typename TShaderType::FParameters>
+class FMultipassPPSceneExtensionWithComputeShader : public FMultipassPPSceneExtension
+{
+public:
+	FMultipassPPSceneExtensionWithComputeShader(const FAutoRegister& AutoReg)
+		: FMultipassPPSceneExtension(AutoReg)
+	{
+
+	}
+
+	using BaseT = FMultipassPPSceneExtensionWithComputeShader<TDerivedType, TShaderType, TParametersType>;
+
+	virtual void PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap) override
+	{
+		FMultipassPPSceneExtension::PrecachePSOs_RenderThread(RHICmdList, ShaderMap);
+		MultipassPPPSOPrecache::PrecacheCompute(RHICmdList, TShaderMapRef<TShaderType>(ShaderMap));
+		if (RegionMask_RenderThread.IsEnabled())
+		{
+			MultipassPPPSOPrecache::PrecacheCompute(RHICmdList, TShaderMapRef<FMultipassPPRegionMaskClassifyCS>(ShaderMap));
+		}
+	}
+
+protected:
+	virtual void AddPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output) override
+	{
+		check(IsInRenderingThread());
+
+		TShaderMapRef<TShaderType> ComputeShader(ViewInfo.ShaderMap);
+		check(ComputeShader.IsValid());
+
+		const FIntPoint OutputSize = Output.ViewRect.Size();
+
+		TParametersType* Parameters = GraphBuilder.AllocParameters<TParametersType>();
+		Parameters->Common.InputViewMin = Input.ViewRect.Min;
+		Parameters->Common.InputViewSize = Input.ViewRect.Size();
+		Parameters->Common.OutputViewMin = Output.ViewRect.Min;
+		Parameters->Common.OutputViewSize = OutputSize;
+		Parameters->Common.OutputTexture = GraphBuilder.CreateUAV(Output.Texture);
+		static_cast<TDerivedType*>(this)->SetupParameters(GraphBuilder, View, ViewInfo, Input, Output, Parameters);
+
+		// The dispatch can't be stencil tested, so it skips the tiles the mask excludes entirely, and the excluded pixels are filled
+		// with the input afterwards
+		FRDGTextureRef RegionMask = AddRegionMaskPass_RenderThread(GraphBuilder, ViewInfo, Output);
+		FMultipassPPRegionMaskTiles RegionTiles;
+		if (RegionMask != nullptr)
+		{
+			RegionTiles = AddMultipassPPRegionMaskClassifyPass(GraphBuilder, ViewInfo, Output, RegionMask, FIntPoint(TShaderType::GroupSizeX, TShaderType::GroupSizeY));
+		}
+		MultipassPPCompute::SetupRegionMaskTiles(GraphBuilder, RegionMask != nullptr ? &RegionTiles : nullptr, Parameters->Common);
+
+		MultipassPPCompute::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("%s (CS) %dx%d", *PostProcessingPassName, OutputSize.X, OutputSize.Y),
+			ComputeShader,
+			Parameters,
+			TShaderType::GetGroupCount(OutputSize));
+
+		if (RegionMask != nullptr)
+		{
+			AddMultipassPPRegionMaskFillPass(GraphBuilder, ViewInfo, Input, Output, RegionMask);
+		}
+	}
+
+	virtual void SetupParameters(
+		FRDGBuilder& GraphBuilder,
+		const FSceneView& View,
+		const FViewInfo& ViewInfo,
+		const FScreenPassTexture& Input,
+		const FScreenPassRenderTarget& Output,
+		TParametersType* Parameters)
+	{
+		//Parameters->InputTexture = Input.Texture;
+	}
+};
+
+// This is just an example of a compute shader that can be used with this
+//
+//class FMultipassPPComputeShader : public TMultipassPPComputeShader<8, 8, 1>
+//{
+//public:
+//	DECLARE_SHADER_TYPE(FMultipassPPComputeShader, Global);
+//	SHADER_USE_PARAMETER_STRUCT(FMultipassPPComputeShader, TMultipassPPComputeShader);
+//
+//	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+//	{
+//		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+//	}
+//
+//	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+//		SHADER_PARAMETER_STRUCT_INCLUDE(FMultipassPPComputeCommonParameters, Common)
+//		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+//	END_SHADER_PARAMETER_STRUCT()
+//};
+//
+// And the usf, for an input the same size as the output:
+//
+//#include "/MultipassPP/Private/MultipassPPCompute.ush"
+//
+//Texture2D InputTexture;
+//
+//#define MULTIPASSPP_TILE_TYPE float4
+//float4 LoadTileTexel(int2 ViewPixel) { return InputTexture[InputViewMin + clamp(ViewPixel, 0, InputViewSize - 1)]; }
+//#include "/MultipassPP/Private/MultipassPPComputeTile.ush"
+//
+//[numthreads(THREADGROUP_SIZEX, THREADGROUP_SIZEY, 1)]
+//void MainCS(uint2 GroupId : SV_GroupID, uint GroupThreadIndex : SV_GroupIndex, uint2 GroupThreadId : SV_GroupThreadID)
+//{
+//	const uint2 GroupTile = GetGroupTile(GroupId);
+//	LoadTile(GroupTile, GroupThreadIndex);
+//	float4 Center = GetTileTexel(GroupThreadId, int2(0, 0));
+//	...
+//	WriteOutput(GroupTile * uint2(THREADGROUP_SIZEX, THREADGROUP_SIZEY) + GroupThreadId, Result);
+//}
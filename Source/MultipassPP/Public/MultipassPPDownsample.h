@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ScreenPass.h"
+#include "ShaderParameters.h"
+#include "ShaderParameterStruct.h"
+#include "ShaderPermutation.h"
+#include "GlobalShader.h"
+
+enum class EMultipassPPDownsampleReduction : uint8
+{
+	// Box filter, each texel is the mean of the four texels above it
+	Average,
+
+	// Each texel is the component-wise max of the four texels above it
+	Max,
+
+	// Average weighted by 1 / (1 + luma), keeps bright outliers from dominating the lower mips. Use this for glow/bloom style effects
+	LumaWeighted,
+
+	MAX
+};
+
+// Builds a whole mip chain in one dispatch, modelled on AMD's single pass downsampler. Each work group reduces a 64x64 tile down
+// to mip 6, and the last work group to finish reduces mip 6 down to the rest of the chain.
+class MULTIPASSPP_API FMultipassPPDownsampleCS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FMultipassPPDownsampleCS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FMultipassPPDownsampleCS, FGlobalShader);
+
+	static constexpr int32 MaxMips = 13;
+	static constexpr int32 TileSize = 64;
+
+	class FReductionDim : SHADER_PERMUTATION_INT("REDUCTION_MODE", (int32)EMultipassPPDownsampleReduction::MAX);
+	using FPermutationDomain = TShaderPermutationDomain<FReductionDim>;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+		SHADER_PARAMETER(FIntPoint, InputViewMin)
+		SHADER_PARAMETER(FIntPoint, InputViewSize)
+		SHADER_PARAMETER(uint32, NumMips)
+		SHADER_PARAMETER(uint32, NumWorkGroups)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, AtomicCounter)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV_ARRAY(RWTexture2D<float4>, OutputMips, [MaxMips])
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// Builds the mip chain of Input's ViewRect into a new transient texture and returns it. Mip 0 is a copy of the ViewRect.
+// NumMips <= 0 builds the full chain. Inputs larger than 4096 pixels on a side stop at mip 6.
+MULTIPASSPP_API FRDGTextureRef AddMultipassPPDownsamplePass(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	const FScreenPassTexture& Input,
+	EMultipassPPDownsampleReduction Reduction,
+	int32 NumMips = 0,
+	EPixelFormat OutputFormat = PF_FloatRGBA);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/SharedPointer.h"
+#include "Templates/Function.h"
+#include "HAL/IConsoleManager.h"
+
+class FMultipassPPSceneExtension;
+class IConsoleVariable;
+
+// How an effect is made available to the project. Set per effect with r.MultipassPP.<EffectName>.Mode in the [SystemSettings] section of DefaultEngine.ini
+enum class EMultipassPPEffectMode : int32
+{
+	// The effect's shaders are not compiled and its scene extension is never created
+	Disabled = 0,
+
+	// The scene extension is created the first time one of the effect's cvars or blendables is used
+	OnDemand = 1,
+
+	// The scene extension is created on engine init
+	AlwaysCreated = 2,
+};
+
+struct MULTIPASSPP_API FMultipassPPEffectDesc
+{
+	FName Name;
+
+	// Constructs the scene extension. Usually just FSceneViewExtensions::NewExtension<T>()
+	TFunction<TSharedPtr<FMultipassPPSceneExtension>()> CreateExtension;
+
+	// Cvars that create the extension when they're set to a value greater than zero
+	TArray<FString> ActivationCVars;
+};
+
+// Keeps track of every effect in the plugin and creates their scene extensions lazily, so effects that are never used don't cost anything
+class MULTIPASSPP_API FMultipassPPEffectRegistry
+{
+public:
+	static FMultipassPPEffectRegistry& Get();
+
+	void RegisterEffect(FMultipassPPEffectDesc&& Desc);
+
+	// Called by the module on post engine init. Creates the AlwaysCreated effects and the effects whose cvars were already set by config
+	void Initialize();
+
+	// Destroys all of the created extensions
+	void Shutdown();
+
+	// Creates the effect's extension if it doesn't exist yet. Returns nullptr if the effect is disabled or unknown. Game thread only
+	TSharedPtr<FMultipassPPSceneExtension> RequestEffect(FName EffectName);
+
+	// Returns the effect's extension, or nullptr if it hasn't been created
+	TSharedPtr<FMultipassPPSceneExtension> FindEffect(FName EffectName) const;
+
+	template<typename TExtensionType>
+	TSharedPtr<TExtensionType> FindEffect() const
+	{
+		return StaticCastSharedPtr<TExtensionType>(FindEffect(TExtensionType::GetEffectName()));
+	}
+
+	EMultipassPPEffectMode GetEffectMode(FName EffectName) const;
+
+	// Effects with a lower priority are disabled first when the plugin goes over its memory budget. Set with r.MultipassPP.<EffectName>.BudgetPriority
+	int32 GetBudgetPriority(FName EffectName) const;
+
+	// Calls Func for every effect whose extension has been created
+	void ForEachCreatedEffect(TFunctionRef<void(FMultipassPPSceneExtension& Extension)> Func) const;
+
+	// Reads the r.MultipassPP.<EffectName>.Enabled/ScreenPercentage/Quality/Precision/AutoSkipThreshold scalability cvars into every created effect.
+	// Runs automatically whenever cvars change, e.g. when a scalability group or device profile is applied. Game thread only
+	void ApplyScalabilitySettings();
+
+	// Precaches the pipeline states of every created effect, see FMultipassPPSceneExtension::PrecachePSOs_RenderThread.
+	// Call it behind a loading screen to avoid hitches when effects turn on later. Game thread only
+	void PrecachePSOs();
+
+	// Use this in ShouldCompilePermutation so disabled effects don't get their shaders compiled or cooked
+	static bool ShouldCompileEffectShaders(FName EffectName);
+
+private:
+	struct FEffectEntry
+	{
+		FMultipassPPEffectDesc Desc;
+		IConsoleVariable* ModeCVar = nullptr;
+		IConsoleVariable* BudgetPriorityCVar = nullptr;
+		IConsoleVariable* EnabledCVar = nullptr;
+		IConsoleVariable* ScreenPercentageCVar = nullptr;
+		IConsoleVariable* QualityCVar = nullptr;
+		IConsoleVariable* PrecisionCVar = nullptr;
+		IConsoleVariable* AutoSkipThresholdCVar = nullptr;
+		TSharedPtr<FMultipassPPSceneExtension> Extension;
+		TArray<TPair<IConsoleVariable*, FDelegateHandle>> ActivationHandles;
+	};
+
+	void OnActivationCVarChanged(IConsoleVariable* CVar, FName EffectName);
+	void ApplyScalabilitySettingsToEntry(FEffectEntry& Entry);
+
+	TMap<FName, FEffectEntry> Effects;
+	FConsoleVariableSinkHandle ScalabilitySinkHandle;
+	bool bInitialized = false;
+};
+
+// Registers an effect with the registry on static init, the same way TAutoConsoleVariable registers a cvar
+struct MULTIPASSPP_API FMultipassPPEffectRegistration
+{
+	FMultipassPPEffectRegistration(FName EffectName, TFunction<TSharedPtr<FMultipassPPSceneExtension>()>&& CreateExtension, std::initializer_list<const TCHAR*> ActivationCVars);
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ScreenPass.h"
+#include "ShaderParameters.h"
+#include "ShaderParameterStruct.h"
+#include "GlobalShader.h"
+
+class FRHIGPUBufferReadback;
+
+// Largest per channel difference between two images, and how many pixels differ by more than the tolerance
+struct FMultipassPPImageCompareResult
+{
+	uint64 FrameNumber = 0;
+	float MaxDifference = 0.f;
+	float Tolerance = 0.f;
+	uint32 NumPixels = 0;
+	uint32 NumPixelsOverTolerance = 0;
+};
+
+// Called on the render thread whenever a comparison is read back
+DECLARE_DELEGATE_OneParam(FOnMultipassPPImageCompared, const FMultipassPPImageCompareResult&);
+
+class MULTIPASSPP_API FMultipassPPImageCompareCS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FMultipassPPImageCompareCS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FMultipassPPImageCompareCS, FGlobalShader);
+
+	static constexpr int32 GroupSize = 8;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, TextureA)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, TextureB)
+		SHADER_PARAMETER(FIntPoint, ViewMinA)
+		SHADER_PARAMETER(FIntPoint, ViewMinB)
+		SHADER_PARAMETER(FIntPoint, ViewSize)
+		SHADER_PARAMETER(float, Tolerance)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, ResultUAV)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// Compares two images on the GPU and reads the result back a few frames later, so it never stalls the render thread.
+// Meant for checking a cheaper variant of an effect against the reference one on real frames, see r.AdaptiveSharpening.FastMath.Validate.
+// Comparisons are dropped while every readback is still in flight
+class MULTIPASSPP_API FMultipassPPImageCompare
+{
+public:
+	FMultipassPPImageCompare(int32 InNumReadbacks = 3);
+	~FMultipassPPImageCompare();
+
+	// Not thread safe. Set it up before the first comparison
+	void SetCallback(FOnMultipassPPImageCompared&& InCallback) { Callback = MoveTemp(InCallback); }
+
+	// Delivers the readbacks that are ready, then compares the view rects of A and B, clipped to the smaller of the two. Render thread only
+	void AddComparePass(FRDGBuilder& GraphBuilder, const FGlobalShaderMap* ShaderMap, const FScreenPassTexture& A, const FScreenPassTexture& B, float Tolerance);
+
+	// Delivers the readbacks that are ready without queueing a new comparison. Keep calling it after the last AddComparePass
+	// until HasReadbacksInFlight is false, or the last comparisons are never delivered. Render thread only
+	void PollReadbacks();
+
+	bool HasReadbacksInFlight() const { return Readbacks[NextRead].bInFlight; }
+
+private:
+	struct FReadback
+	{
+		TUniquePtr<FRHIGPUBufferReadback> Readback;
+		uint64 FrameNumber = 0;
+		uint32 NumPixels = 0;
+		float Tolerance = 0.f;
+		bool bInFlight = false;
+	};
+
+	TArray<FReadback> Readbacks;
+	int32 NextWrite = 0;
+	int32 NextRead = 0;
+
+	FOnMultipassPPImageCompared Callback;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ScreenPass.h"
+#include "ShaderParameters.h"
+#include "ShaderParameterStruct.h"
+#include "GlobalShader.h"
+
+class FRHIGPUBufferReadback;
+struct IPooledRenderTarget;
+
+// Statistics of an image's luma, all in luma units
+struct FMultipassPPImageStatsResult
+{
+	uint64 FrameNumber = 0;
+	uint32 NumPixels = 0;
+
+	float MeanLuma = 0.f;
+
+	// Mean of the absolute luma differences with the right and bottom neighbours
+	float MeanEdgeStrength = 0.f;
+
+	// Mean absolute luma change since the previous measurement, on a sparse grid. -1 on the first measurement and after a resize
+	float MeanLumaDelta = -1.f;
+
+	// Fraction of the pixels whose edge strength is over the active threshold
+	float ActiveFraction = 0.f;
+};
+
+// Called on the render thread whenever statistics are read back
+DECLARE_DELEGATE_OneParam(FOnMultipassPPImageStats, const FMultipassPPImageStatsResult&);
+
+class MULTIPASSPP_API FMultipassPPImageStatsCS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FMultipassPPImageStatsCS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FMultipassPPImageStatsCS, FGlobalShader);
+
+	static constexpr int32 GroupSize = 8;
+
+	// Every HistorySpacing-th pixel in both directions keeps its luma for the next measurement's delta
+	static constexpr int32 HistorySpacing = 4;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+		SHADER_PARAMETER(FIntPoint, ViewMin)
+		SHADER_PARAMETER(FIntPoint, ViewSize)
+		SHADER_PARAMETER(float, ActiveThreshold)
+		SHADER_PARAMETER(uint32, bLumaHistoryValid)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float>, LumaHistory)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, ResultUAV)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// Reduces an image to a few statistics on the GPU and reads them back a few frames later, so it never stalls the render thread.
+// Meant for telling whether an effect changes anything visible on the current frames, see r.MultipassPP.AutoSkip.
+// Keeps a sparse luma history for the delta between measurements. Measurements are dropped while every readback is still in flight
+class MULTIPASSPP_API FMultipassPPImageStats
+{
+public:
+	FMultipassPPImageStats(int32 InNumReadbacks = 3);
+	~FMultipassPPImageStats();
+
+	// Not thread safe. Set it up before the first measurement
+	void SetCallback(FOnMultipassPPImageStats&& InCallback) { Callback = MoveTemp(InCallback); }
+
+	// Delivers the readbacks that are ready, then measures Input's view rect. Render thread only
+	void AddStatsPass(FRDGBuilder& GraphBuilder, const FGlobalShaderMap* ShaderMap, const FScreenPassTexture& Input, float ActiveThreshold);
+
+	// Delivers the readbacks that are ready without queueing a new measurement. Render thread only
+	void PollReadbacks();
+
+	SIZE_T GetGPUMemorySize() const;
+
+private:
+	struct FReadback
+	{
+		TUniquePtr<FRHIGPUBufferReadback> Readback;
+		uint64 FrameNumber = 0;
+		uint32 NumPixels = 0;
+		bool bInFlight = false;
+	};
+
+	TArray<FReadback> Readbacks;
+	int32 NextWrite = 0;
+	int32 NextRead = 0;
+
+	TRefCountPtr<IPooledRenderTarget> LumaHistory;
+	FIntPoint LumaHistoryViewSize = FIntPoint::ZeroValue;
+
+	FOnMultipassPPImageStats Callback;
+};
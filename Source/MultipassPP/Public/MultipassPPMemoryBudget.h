@@ -0,0 +1,51 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+class FMultipassPPSceneExtension;
+
+// Tracks the GPU memory held by every created effect and keeps it inside r.MultipassPP.MemoryBudgetMB.
+// When the budget is exceeded it responds in this order, one step at a time:
+// 1. Evicts the least recently used view data that wasn't used this frame
+// 2. Switches every effect's view data to its compact formats
+// 3. Disables effects, lowest r.MultipassPP.<EffectName>.BudgetPriority first
+// Steps 2 and 3 stay in effect until the budget is changed.
+class MULTIPASSPP_API FMultipassPPMemoryBudget
+{
+public:
+	static FMultipassPPMemoryBudget& Get();
+
+	void Initialize();
+	void Shutdown();
+
+	// Updates the memory stats and enforces the budget. Called at the end of every frame on the game thread
+	void Update();
+
+	// Prints the memory used per effect and per view. Used by r.MultipassPP.DumpMemory
+	void DumpMemory(FOutputDevice& Ar) const;
+
+	SIZE_T GetTotalGPUMemorySize() const;
+
+private:
+	enum class EStage : uint8
+	{
+		WithinBudget,
+		CompactFormats,
+		DisablingEffects,
+	};
+
+	bool EvictLeastRecentlyUsedViewData(SIZE_T& InOutTotalSize);
+	bool DisableLowestPriorityEffect(SIZE_T& InOutTotalSize);
+	void ResetBudgetResponse();
+	void UpdateStats(SIZE_T TotalSize);
+
+	FDelegateHandle EndFrameHandle;
+	EStage Stage = EStage::WithinBudget;
+	uint64 StageStartFrame = 0;
+	int32 LastBudgetMB = 0;
+
+#if STATS
+	TMap<FName, TStatId> EffectMemoryStats;
+#endif
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RHI.h"
+#include "Shader.h"
+
+// Helpers to create the pipeline states effects draw with ahead of time, so turning an effect on doesn't hitch while
+// its PSOs compile. Uses the engine's PSO precaching where it's available, and creates the PSOs directly otherwise.
+// See FMultipassPPSceneExtension::PrecachePSOs_RenderThread and FMultipassPPEffectRegistry::PrecachePSOs
+namespace MultipassPPPSOPrecache
+{
+	// Scene color formats the post processing passes can see, tried when the actual one isn't known yet
+	MULTIPASSPP_API TConstArrayView<EPixelFormat> GetSceneColorFormats();
+
+	// A full screen FScreenPassVS draw with PixelShader into RenderTargetFormats, as AddDrawScreenPass issues it. Render thread
+	MULTIPASSPP_API void PrecacheScreenPass(
+		FRHICommandList& RHICmdList,
+		const TShaderRef<FShader>& VertexShader,
+		const TShaderRef<FShader>& PixelShader,
+		FRHIBlendState* BlendState,
+		FRHIDepthStencilState* DepthStencilState,
+		TConstArrayView<EPixelFormat> RenderTargetFormats,
+		EPixelFormat DepthStencilFormat = PF_Unknown,
+		FExclusiveDepthStencil::Type DepthStencilAccess = FExclusiveDepthStencil::DepthNop_StencilRead);
+
+	// Same for every one of Formats as a single render target
+	MULTIPASSPP_API void PrecacheScreenPassForFormats(
+		FRHICommandList& RHICmdList,
+		const TShaderRef<FShader>& VertexShader,
+		const TShaderRef<FShader>& PixelShader,
+		FRHIBlendState* BlendState,
+		FRHIDepthStencilState* DepthStencilState,
+		TConstArrayView<EPixelFormat> Formats);
+
+	// A compute dispatch. Render thread
+	MULTIPASSPP_API void PrecacheCompute(FRHICommandList& RHICmdList, const TShaderRef<FShader>& ComputeShader);
+}
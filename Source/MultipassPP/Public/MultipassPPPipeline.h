@@ -0,0 +1,280 @@
+#pragma once
+
+#include "MultipassPPSceneExtension.h"
+#include "PostProcess/PostProcessMaterial.h"
+#include "Templates/IntegerSequence.h"
+
+#include <type_traits>
+
+// Where a pipeline pass writes to
+enum class EMultipassPPPassTarget : uint8
+{
+	// The view data's RT. Use this for anything that has to survive until the next frame
+	ViewData,
+	// A transient texture the size of the pass input, in TPass::TransientFormat or the input's format if that's PF_Unknown
+	Transient,
+	// The pipeline output: InOutInputs.OverrideOutput if it's valid, otherwise a transient texture like the scene color. Only the last pass can target it
+	Output,
+};
+
+namespace MultipassPPPipeline
+{
+	// Input index of passes that read the scene color instead of an earlier pass
+	static constexpr int32 SceneColor = -1;
+}
+
+// Everything a pass needs to set up its parameters
+struct FMultipassPPPipelineContext
+{
+	FRDGBuilder& GraphBuilder;
+	const FSceneView& View;
+	const FViewInfo& ViewInfo;
+	const FPostProcessMaterialInputs& InOutInputs;
+	TSharedPtr<IMultipassPPViewData> ViewData;
+	FScreenPassTexture SceneColor;
+
+	// Input and output of the pass being added
+	FScreenPassTexture Input;
+	FScreenPassRenderTarget Output;
+	int32 PassIndex = 0;
+};
+
+// Defaults for pipeline passes. A pass derives from this and declares:
+//   using ShaderType = FMyPixelShader;
+//   static constexpr int32 Input = 0;                                        // Index of the earlier pass it reads, or MultipassPPPipeline::SceneColor
+//   static constexpr EMultipassPPPassTarget Target = EMultipassPPPassTarget::Transient;
+//   static const TCHAR* GetName();
+//   static void SetupParameters(FMyExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters);
+// It can also hide GetBlendState, GetDepthStencilState, TransientFormat, bClearTransient, DepthStencilFormat, DepthStencilAccess and IsEnabled, and declare
+//   static ShaderType::FPermutationDomain GetPermutationVector(const FMyExtension& Extension, const FMultipassPPPipelineContext& Context);
+// if its shader has permutations. It's called after SetupParameters.
+struct FMultipassPPPipelinePass
+{
+	static constexpr int32 Input = MultipassPPPipeline::SceneColor;
+	static constexpr EMultipassPPPassTarget Target = EMultipassPPPassTarget::Transient;
+	static constexpr EPixelFormat TransientFormat = PF_Unknown;
+
+	// Starts the transient target cleared to transparent black, with the clear on the pass's own load action, for passes that don't draw every pixel
+	static constexpr bool bClearTransient = false;
+
+	// Depth stencil target SetupParameters binds, if any. Only used to precache the pass with the right pipeline state
+	static constexpr EPixelFormat DepthStencilFormat = PF_Unknown;
+	static constexpr FExclusiveDepthStencil::Type DepthStencilAccess = FExclusiveDepthStencil::DepthNop_StencilRead;
+
+	static FRHIBlendState* GetBlendState() { return FScreenPassPipelineState::FDefaultBlendState::GetRHI(); }
+	static FRHIDepthStencilState* GetDepthStencilState() { return FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI(); }
+
+	// Disabled passes are skipped and their output is their input
+	template<typename TExtension>
+	static bool IsEnabled(const TExtension& Extension, const FMultipassPPPipelineContext& Context) { return true; }
+};
+
+namespace MultipassPPPipeline
+{
+	template<typename TPass, typename = void>
+	struct THasPermutationVector : std::false_type {};
+
+	template<typename TPass>
+	struct THasPermutationVector<TPass, std::void_t<decltype(&TPass::GetPermutationVector)>> : std::true_type {};
+}
+
+// Scene extension that runs a fixed chain of pixel shader passes. The pass list, what every pass reads and where it writes
+// are all resolved at compile time, so there are no virtual calls or runtime pass switches between the passes.
+// If the pipeline ends up writing anywhere other than OverrideOutput, the result is copied into it.
+template<typename TDerivedType, typename... TPasses>
+class TMultipassPPPipeline : public FMultipassPPSceneExtension
+{
+public:
+	static constexpr int32 NumPasses = sizeof...(TPasses);
+	static_assert(NumPasses > 0, "A pipeline needs at least one pass");
+
+	TMultipassPPPipeline(const FAutoRegister& AutoReg)
+		: FMultipassPPSceneExtension(AutoReg)
+	{
+
+	}
+
+	using BaseT = TMultipassPPPipeline<TDerivedType, TPasses...>;
+
+	virtual void PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap) override
+	{
+		FMultipassPPSceneExtension::PrecachePSOs_RenderThread(RHICmdList, ShaderMap);
+		(PrecachePassPSOs<TPasses>(RHICmdList, ShaderMap), ...);
+	}
+
+protected:
+	virtual FScreenPassTexture PostProcessPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& InOutInputs, EPostProcessingPass Pass) override
+	{
+		const FScreenPassTexture& SceneColor = InOutInputs.GetInput(EPostProcessMaterialInput::SceneColor);
+		check(SceneColor.IsValid());
+		checkSlow(View.bIsViewInfo);
+		const FViewInfo& ViewInfo = static_cast<const FViewInfo&>(View);
+		InOutInputs.Validate();
+
+		TSharedPtr<IMultipassPPViewData> ViewData = GetViewData(View);
+		if (ViewData == nullptr)
+		{
+			return ReturnUntouchedSceneColorForPostProcessing(GraphBuilder, View, ViewInfo, InOutInputs);
+		}
+
+		RDG_EVENT_SCOPE(GraphBuilder, "%s", *PostProcessingPassName);
+
+		FMultipassPPPipelineContext Context{ GraphBuilder, View, ViewInfo, InOutInputs, ViewData, SceneColor };
+		FScreenPassTexture Outputs[NumPasses];
+		AddPipelinePasses(Context, Outputs, TMakeIntegerSequence<int32, NumPasses>());
+
+		return CopyToOverrideOutput(GraphBuilder, ViewInfo, InOutInputs, Outputs[NumPasses - 1]);
+	}
+
+private:
+	template<int32... PassIndices>
+	void AddPipelinePasses(FMultipassPPPipelineContext& Context, FScreenPassTexture* Outputs, TIntegerSequence<int32, PassIndices...>)
+	{
+		(AddPipelinePass<PassIndices, TPasses>(Context, Outputs), ...);
+	}
+
+	template<int32 PassIndex, typename TPass>
+	void AddPipelinePass(FMultipassPPPipelineContext& Context, FScreenPassTexture* Outputs)
+	{
+		static_assert(TPass::Input >= MultipassPPPipeline::SceneColor && TPass::Input < PassIndex, "Pipeline passes can only read the scene color or an earlier pass");
+		static_assert(TPass::Target != EMultipassPPPassTarget::Output || PassIndex == NumPasses - 1, "Only the last pipeline pass can target the output");
+
+		using FShader = typename TPass::ShaderType;
+		using FParameters = typename FShader::FParameters;
+
+		TDerivedType& Derived = static_cast<TDerivedType&>(*this);
+
+		FScreenPassTexture Input;
+		if constexpr (TPass::Input == MultipassPPPipeline::SceneColor)
+		{
+			Input = Context.SceneColor;
+		}
+		else
+		{
+			Input = Outputs[TPass::Input];
+		}
+
+		Context.Input = Input;
+		Context.Output = FScreenPassRenderTarget();
+		Context.PassIndex = PassIndex;
+
+		if (!TPass::IsEnabled(Derived, Context))
+		{
+			Outputs[PassIndex] = Input;
+			return;
+		}
+
+		Context.Output = CreatePassOutput<TPass>(Context);
+
+		FParameters* Parameters = Context.GraphBuilder.AllocParameters<FParameters>();
+		TPass::SetupParameters(Derived, Context, Parameters);
+
+		const FViewInfo& ViewInfo = Context.ViewInfo;
+		TShaderMapRef<FScreenPassVS> VertexShader(ViewInfo.ShaderMap);
+		typename FShader::FPermutationDomain PermutationVector;
+		if constexpr (MultipassPPPipeline::THasPermutationVector<TPass>::value)
+		{
+			PermutationVector = TPass::GetPermutationVector(Derived, Context);
+		}
+		TShaderMapRef<FShader> PixelShader(ViewInfo.ShaderMap, PermutationVector);
+
+		// The region mask only applies to the pass writing the output, the earlier passes may be read around the region's edges
+		FRDGTextureRef RegionMask = nullptr;
+		if constexpr (TPass::Target == EMultipassPPPassTarget::Output)
+		{
+			RegionMask = AddRegionMaskPass_RenderThread(Context.GraphBuilder, ViewInfo, Context.Output);
+			if (RegionMask != nullptr)
+			{
+				Parameters->RenderTargets.DepthStencil = MultipassPPRegionMask::GetBinding(RegionMask);
+			}
+		}
+
+		AddDrawScreenPass(
+			Context.GraphBuilder,
+			RDG_EVENT_NAME("%s", TPass::GetName()),
+			ViewInfo,
+			FScreenPassTextureViewport(Context.Output),
+			FScreenPassTextureViewport(Input),
+			VertexShader,
+			PixelShader,
+			TPass::GetBlendState(),
+			RegionMask != nullptr ? MultipassPPRegionMask::GetIncludedDepthStencilState() : TPass::GetDepthStencilState(),
+			Parameters,
+			EScreenPassDrawFlags::None);
+
+		if (RegionMask != nullptr)
+		{
+			AddMultipassPPRegionMaskFillPass(Context.GraphBuilder, ViewInfo, Context.SceneColor, Context.Output, RegionMask);
+		}
+
+		Outputs[PassIndex] = Context.Output;
+	}
+
+	// Every permutation of the pass, into every format its target can have
+	template<typename TPass>
+	void PrecachePassPSOs(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap)
+	{
+		using FShader = typename TPass::ShaderType;
+
+		TArray<EPixelFormat> Formats;
+		if constexpr (TPass::Target == EMultipassPPPassTarget::ViewData)
+		{
+			GetViewDataPixelFormats(Formats);
+		}
+		else if constexpr (TPass::Target == EMultipassPPPassTarget::Transient && TPass::TransientFormat != PF_Unknown)
+		{
+			Formats.Add(TPass::TransientFormat);
+		}
+		else
+		{
+			Formats.Append(MultipassPPPSOPrecache::GetSceneColorFormats());
+		}
+
+		TShaderMapRef<FScreenPassVS> VertexShader(ShaderMap);
+		for (int32 PermutationId = 0; PermutationId < FShader::FPermutationDomain::PermutationCount; ++PermutationId)
+		{
+			// Permutations ShouldCompilePermutation rejected aren't in the shader map
+			TShaderRef<FShader> PixelShader = ShaderMap->GetShader(&FShader::GetStaticType(), PermutationId);
+			if constexpr (TPass::DepthStencilFormat != PF_Unknown)
+			{
+				for (EPixelFormat Format : Formats)
+				{
+					MultipassPPPSOPrecache::PrecacheScreenPass(RHICmdList, VertexShader, PixelShader, TPass::GetBlendState(), TPass::GetDepthStencilState(),
+						MakeArrayView(&Format, 1), TPass::DepthStencilFormat, TPass::DepthStencilAccess);
+				}
+			}
+			else
+			{
+				MultipassPPPSOPrecache::PrecacheScreenPassForFormats(RHICmdList, VertexShader, PixelShader, TPass::GetBlendState(), TPass::GetDepthStencilState(), Formats);
+			}
+		}
+	}
+
+	template<typename TPass>
+	FScreenPassRenderTarget CreatePassOutput(const FMultipassPPPipelineContext& Context) const
+	{
+		if constexpr (TPass::Target == EMultipassPPPassTarget::ViewData)
+		{
+			FRDGTextureRef Texture = Context.GraphBuilder.RegisterExternalTexture(Context.ViewData->GetRT());
+			return FScreenPassRenderTarget(Texture, Context.ViewInfo.ViewRect, ERenderTargetLoadAction::ELoad);
+		}
+		else
+		{
+			constexpr bool bIsOutput = TPass::Target == EMultipassPPPassTarget::Output;
+			if (bIsOutput && Context.InOutInputs.OverrideOutput.IsValid())
+			{
+				return Context.InOutInputs.OverrideOutput;
+			}
+
+			// The pipeline output has to look like the scene color to the passes after it
+			const FScreenPassTexture& Like = bIsOutput ? Context.SceneColor : Context.Input;
+			const FRDGTextureDesc& LikeDesc = Like.Texture->Desc;
+			const EPixelFormat Format = !bIsOutput && TPass::TransientFormat != PF_Unknown ? TPass::TransientFormat : LikeDesc.Format;
+			constexpr bool bClear = !bIsOutput && TPass::bClearTransient;
+			const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(LikeDesc.Extent, Format, bClear ? FClearValueBinding::Transparent : FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_RenderTargetable);
+
+			FRDGTextureRef Texture = Context.GraphBuilder.CreateTexture(Desc, TPass::GetName());
+			return FScreenPassRenderTarget(Texture, Like.ViewRect, bClear ? ERenderTargetLoadAction::EClear : ERenderTargetLoadAction::ENoAction);
+		}
+	}
+};
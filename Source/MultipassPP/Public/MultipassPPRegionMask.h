@@ -0,0 +1,152 @@
+#pragma once
+
+#include "ScreenPass.h"
+#include "ShaderParameters.h"
+#include "ShaderParameterStruct.h"
+#include "ShaderPermutation.h"
+#include "GlobalShader.h"
+#include "SceneTexturesConfig.h"
+#include "SceneRenderTargetParameters.h"
+
+enum class EMultipassPPRegionMaskMode : uint8
+{
+	// Every pixel of the view rect is processed
+	None,
+
+	// Pixels whose custom stencil is StencilValue are processed. Needs r.CustomDepth 3
+	CustomStencil,
+
+	// Pixels whose scene depth, in world units, is between MinDepth and MaxDepth are processed
+	DepthRange,
+
+	// Pixels inside any of the Rects are processed
+	Rects,
+
+	MAX
+};
+
+// Restricts an effect to part of the view. Set it on an extension with FMultipassPPSceneExtension::SetRegionMask
+struct FMultipassPPRegionMask
+{
+	static constexpr int32 MaxRects = 8;
+
+	EMultipassPPRegionMaskMode Mode = EMultipassPPRegionMaskMode::None;
+
+	uint8 StencilValue = 1;
+
+	float MinDepth = 0.f;
+	float MaxDepth = UE_BIG_NUMBER;
+
+	// In viewport UVs, so they don't depend on the screen percentage. Only the first MaxRects are used
+	TArray<FBox2f> Rects;
+
+	// Process the pixels outside of the region instead
+	bool bInvert = false;
+
+	bool IsEnabled() const { return Mode != EMultipassPPRegionMaskMode::None; }
+};
+
+// Writes a non zero stencil on the pixels the mask excludes, and discards the rest
+class MULTIPASSPP_API FMultipassPPRegionMaskPS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FMultipassPPRegionMaskPS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FMultipassPPRegionMaskPS, FGlobalShader);
+
+	class FModeDim : SHADER_PERMUTATION_RANGE_INT("MASK_MODE", 1, (int32)EMultipassPPRegionMaskMode::MAX - 1);
+	using FPermutationDomain = TShaderPermutationDomain<FModeDim>;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+		SHADER_PARAMETER_RDG_UNIFORM_BUFFER(FSceneTextureUniformParameters, SceneTexturesStruct)
+		SHADER_PARAMETER(FVector2f, OutputViewMin)
+		SHADER_PARAMETER(FVector2f, OutputViewSize)
+		SHADER_PARAMETER(uint32, StencilValue)
+		SHADER_PARAMETER(FVector2f, DepthRange)
+		SHADER_PARAMETER_ARRAY(FVector4f, Rects, [FMultipassPPRegionMask::MaxRects])
+		SHADER_PARAMETER(uint32, NumRects)
+		SHADER_PARAMETER(uint32, bInvert)
+		RENDER_TARGET_BINDING_SLOTS()
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// Lists the tiles of a compute pass' output that hold at least one pixel the mask includes, see AddMultipassPPRegionMaskClassifyPass
+class MULTIPASSPP_API FMultipassPPRegionMaskClassifyCS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FMultipassPPRegionMaskClassifyCS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FMultipassPPRegionMaskClassifyCS, FGlobalShader);
+
+	static constexpr int32 GroupSize = 8;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2D<uint2>, MaskTexture)
+		SHADER_PARAMETER(FIntPoint, OutputViewMin)
+		SHADER_PARAMETER(FIntPoint, OutputViewSize)
+		SHADER_PARAMETER(FIntPoint, TileSize)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, TileListUAV)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, IndirectArgsUAV)
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// The tiles AddMultipassPPRegionMaskClassifyPass kept
+struct FMultipassPPRegionMaskTiles
+{
+	// One tile per entry, x in the low 16 bits and y in the high ones
+	FRDGBufferRef TileList = nullptr;
+
+	// FRHIDispatchIndirectParameters with one group per listed tile
+	FRDGBufferRef IndirectArgs = nullptr;
+};
+
+namespace MultipassPPRegionMask
+{
+	// For the effect's draw, only passes the pixels the mask includes. The stencil reference has to be 0, which is AddDrawScreenPass' default
+	inline FRHIDepthStencilState* GetIncludedDepthStencilState()
+	{
+		return TStaticDepthStencilState<false, CF_Always, true, CF_Equal, SO_Keep, SO_Keep, SO_Keep, true, CF_Equal, SO_Keep, SO_Keep, SO_Keep>::GetRHI();
+	}
+
+	inline FRHIDepthStencilState* GetExcludedDepthStencilState()
+	{
+		return TStaticDepthStencilState<false, CF_Always, true, CF_NotEqual, SO_Keep, SO_Keep, SO_Keep, true, CF_NotEqual, SO_Keep, SO_Keep, SO_Keep>::GetRHI();
+	}
+
+	// Bind the mask to a draw using GetIncludedDepthStencilState or GetExcludedDepthStencilState
+	inline FDepthStencilBinding GetBinding(FRDGTextureRef MaskTexture)
+	{
+		return FDepthStencilBinding(MaskTexture, ERenderTargetLoadAction::ENoAction, ERenderTargetLoadAction::ELoad, FExclusiveDepthStencil::DepthNop_StencilRead);
+	}
+}
+
+// Builds the stencil mask for Output's view rect, in a new depth stencil texture the size of Output's texture.
+// Returns nullptr when the mask is disabled, or when it needs the scene textures and SceneTextures isn't valid
+MULTIPASSPP_API FRDGTextureRef AddMultipassPPRegionMaskPass(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures,
+	const FMultipassPPRegionMask& Mask,
+	const FScreenPassRenderTarget& Output);
+
+// Copies Input into the pixels of Output the mask excludes, so they show the unprocessed scene color
+MULTIPASSPP_API void AddMultipassPPRegionMaskFillPass(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	const FScreenPassTexture& Input,
+	const FScreenPassRenderTarget& Output,
+	FRDGTextureRef MaskTexture);
+
+// Compute passes can't be stencil tested. This lists the TileSize tiles of Output's view rect that hold at least one pixel the mask
+// includes, so the pass can be dispatched indirectly over those only. The excluded pixels of the listed tiles are still computed
+MULTIPASSPP_API FMultipassPPRegionMaskTiles AddMultipassPPRegionMaskClassifyPass(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	const FScreenPassRenderTarget& Output,
+	FRDGTextureRef MaskTexture,
+	const FIntPoint& TileSize);
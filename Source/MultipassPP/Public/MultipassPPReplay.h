@@ -0,0 +1,102 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ScreenPass.h"
+#include "RHIResources.h"
+
+class FRHIGPUTextureReadback;
+struct IMultipassPPViewData;
+
+// One frame of an effect's inputs: the scene color, the view data RT as it was before the effect ran, and the view data's
+// parameters. Enough to run the effect's passes again without the scene, see r.MultipassPP.CaptureFrame and r.MultipassPP.Replay
+struct MULTIPASSPP_API FMultipassPPFrameCapture
+{
+	static constexpr uint32 ExpectedMagic = 0x4650504D; // 'MPPF'
+	static constexpr uint32 ExpectedVersion = 1;
+
+	FString EffectName;
+	uint64 FrameNumber = 0;
+
+	// The scene color's view rect, rows tightly packed
+	FIntPoint SceneColorSize = FIntPoint::ZeroValue;
+	EPixelFormat SceneColorFormat = PF_Unknown;
+	TArray<uint8> SceneColor;
+
+	// The whole view data RT, rows tightly packed. Empty if the effect has none
+	FIntPoint HistorySize = FIntPoint::ZeroValue;
+	EPixelFormat HistoryFormat = PF_Unknown;
+	TArray<uint8> History;
+
+	// Written by IMultipassPPViewData::SerializeParameters
+	TArray<uint8> Parameters;
+
+	bool SaveToFile(const FString& Filename) const;
+	bool LoadFromFile(const FString& Filename);
+
+	friend FArchive& operator<<(FArchive& Ar, FMultipassPPFrameCapture& Capture);
+};
+
+// Reads back one frame of an effect's inputs and writes them to a file once the GPU is done with them. Render thread only
+class MULTIPASSPP_API FMultipassPPFrameCaptureRequest
+{
+public:
+	FMultipassPPFrameCaptureRequest(FName InEffectName, const FString& InFilename);
+	~FMultipassPPFrameCaptureRequest();
+
+	bool HasCaptured() const { return bCaptured; }
+
+	// Queues the readbacks of SceneColor's view rect and of the view data RT, and saves the view data's parameters. Call it before the effect's passes
+	void AddCapturePasses(FRDGBuilder& GraphBuilder, const FScreenPassTexture& SceneColor, IMultipassPPViewData& ViewData);
+
+	// Writes the file on a worker thread once both readbacks are done. Returns true when the request is finished
+	bool Poll();
+
+private:
+	FString Filename;
+	FMultipassPPFrameCapture Capture;
+	TUniquePtr<FRHIGPUTextureReadback> SceneColorReadback;
+	TUniquePtr<FRHIGPUTextureReadback> HistoryReadback;
+	bool bCaptured = false;
+};
+
+// Runs an effect's passes on a capture several times in one frame, with GPU timestamps around each run, then logs the timings.
+// See FMultipassPPSceneExtension::StartReplay. Render thread only
+class MULTIPASSPP_API FMultipassPPReplay
+{
+public:
+	FMultipassPPReplay(TSharedRef<const FMultipassPPFrameCapture, ESPMode::ThreadSafe> InCapture, int32 InNumIterations, bool bInQuitWhenDone);
+	~FMultipassPPReplay();
+
+	const FMultipassPPFrameCapture& GetCapture() const { return *Capture; }
+	int32 GetNumIterations() const { return NumIterations; }
+	bool HasRun() const { return bHasRun; }
+	void MarkRun() { bHasRun = true; }
+
+	// Uploads the captured textures the first time they're used
+	FScreenPassTexture RegisterSceneColor(FRDGBuilder& GraphBuilder);
+	FRDGTextureRef RegisterHistory(FRDGBuilder& GraphBuilder);
+
+	// Writes a GPU timestamp at this point of the graph. Timestamps are paired up, begin and end of every run
+	void AddTimestampPass(FRDGBuilder& GraphBuilder);
+
+	// Keeps the output of a run alive, passes nothing reads from would be culled otherwise
+	void KeepOutput(FRDGBuilder& GraphBuilder, FRDGTextureRef Output);
+
+	// Logs the timings once every timestamp is available. Returns true when the replay is finished
+	bool Poll();
+
+private:
+	TRefCountPtr<IPooledRenderTarget> Upload(FRHICommandListImmediate& RHICmdList, FIntPoint Size, EPixelFormat Format, const TArray<uint8>& Data, const TCHAR* DebugName);
+
+	TSharedRef<const FMultipassPPFrameCapture, ESPMode::ThreadSafe> Capture;
+	int32 NumIterations = 1;
+	bool bQuitWhenDone = false;
+	bool bHasRun = false;
+
+	TRefCountPtr<IPooledRenderTarget> SceneColorRT;
+	TRefCountPtr<IPooledRenderTarget> HistoryRT;
+	TArray<TRefCountPtr<IPooledRenderTarget>> Outputs;
+
+	FRenderQueryPoolRHIRef QueryPool;
+	TArray<FRHIPooledRenderQuery> Timestamps;
+};
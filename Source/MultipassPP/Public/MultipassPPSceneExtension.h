@@ -9,6 +9,11 @@
 #include "ShaderParameterStruct.h"
 #include "ScreenPass.h"
 #include "Engine/TextureRenderTarget2D.h"
+#include "MultipassPPRegionMask.h"
+#include "MultipassPPPSOPrecache.h"
+#include "MultipassPPImageStats.h"
+
+#include <atomic>
 
 #include "Runtime/Launch/Resources/Version.h"
 #if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 3
@@ -16,15 +21,54 @@
 #endif
 
 struct IPooledRenderTarget;
+class FMultipassPPCaptureTap;
+class FMultipassPPFrameCaptureRequest;
+class FMultipassPPReplay;
+struct FMultipassPPFrameCapture;
 
 struct MULTIPASSPP_API IMultipassPPViewData : public TSharedFromThis<IMultipassPPViewData, ESPMode::ThreadSafe>
 {
 	virtual TRefCountPtr<IPooledRenderTarget> GetRT() { return nullptr; };
 
-	// Called on SetupView by the scene extension
+	// Called before the view renders by the scene extension. Render thread
 	virtual void SetupRT(const FIntPoint& Resolution) {};
 
+	// Size in bytes of the GPU resources this view data is holding on to, as last published by the render thread. Any thread
+	SIZE_T GetGPUMemorySize() const { return GPUMemorySize.load(std::memory_order_relaxed); }
+
+	// Size in bytes of the targets. Render thread only, that's where they're reassigned and released
+	virtual SIZE_T ComputeGPUMemorySize_RenderThread() const { return 0; };
+
+	// Publishes ComputeGPUMemorySize_RenderThread for GetGPUMemorySize. Called by the scene extension after SetupRT, so targets the
+	// passes extract or release are picked up the next frame the view renders. Render thread
+	void UpdateGPUMemorySize_RenderThread() { GPUMemorySize.store(ComputeGPUMemorySize_RenderThread(), std::memory_order_relaxed); }
+
+	// Called by the memory budget. View data that supports it should switch its targets to a smaller format on the next SetupRT
+	virtual void SetUseCompactFormat(bool bInUseCompactFormat) {};
+
+	// Saves or loads everything besides the RT the effect's passes read, so a captured frame can be replayed, see FMultipassPPFrameCapture
+	virtual void SerializeParameters(FArchive& Ar) {};
+
 	virtual ~IMultipassPPViewData() {};
+
+	// GFrameCounter of the last SetupView this view data was used in. Used to evict the least recently used view data. Game thread only
+	uint64 LastUsedFrame = 0;
+
+	// Fraction of the view resolution the targets were last set up at, see FMultipassPPSceneExtension::GetResolutionFraction. Render thread only
+	float ResolutionFraction = 1.f;
+
+	// Idle output reuse state, see FMultipassPPSceneExtension::GetOutputReuseSettleFrames. Render thread only
+	uint32 OutputReuseHash = 0;
+	int32 NumUnchangedFrames = 0;
+	TRefCountPtr<IPooledRenderTarget> ReusedOutput;
+
+	// Statistics of the effect's input, and how many results in a row were under the effect's auto skip threshold,
+	// see r.MultipassPP.ImageStats and r.MultipassPP.AutoSkip. Render thread only
+	TSharedPtr<FMultipassPPImageStats> ImageStats;
+	int32 NumLowImpactResults = 0;
+
+private:
+	std::atomic<SIZE_T> GPUMemorySize { 0 };
 };
 
 // Default view data implementation. Just holds the RT
@@ -32,11 +76,68 @@ struct MULTIPASSPP_API FMultipassPPViewData : public IMultipassPPViewData
 {
 	virtual TRefCountPtr<IPooledRenderTarget> GetRT() override { return RT; };
 	virtual void SetupRT(const FIntPoint& Resolution) override;
+	virtual SIZE_T ComputeGPUMemorySize_RenderThread() const override;
+	virtual void SetUseCompactFormat(bool bInUseCompactFormat) override { bUseCompactFormat = bInUseCompactFormat; };
+
+	// Returns RTCompactPixelFormat if the memory budget asked for compact formats, RTPixelFormat otherwise
+	ETextureRenderTargetFormat GetEffectiveRTPixelFormat() const;
 
 	TRefCountPtr<IPooledRenderTarget> RT;
 	FString RTDebugName = "Multipass PP View Data RT";
 	ETextureRenderTargetFormat RTPixelFormat = ETextureRenderTargetFormat::RTF_RGBA8_SRGB;
 	FClearValueBinding RTClearValueBinding = FClearValueBinding::None;
+
+	// Smaller format to fall back to when the plugin is over its memory budget. Leave unset if RTPixelFormat can't be reduced
+	TOptional<ETextureRenderTargetFormat> RTCompactPixelFormat;
+	bool bUseCompactFormat = false;
+};
+
+// Per effect settings driven by the engine's scalability groups and device profiles through the
+// r.MultipassPP.<EffectName>.Enabled/ScreenPercentage/Quality/Precision/AutoSkipThreshold cvars. Applied by the effect registry
+struct FMultipassPPScalabilitySettings
+{
+	bool bEnabled = true;
+
+	// Fraction of the view resolution the effect runs at, for effects that support it
+	float ResolutionFraction = 1.f;
+
+	// Effect specific quality tier, 0 being the cheapest. -1 leaves it to the effect's own cvars
+	int32 Quality = -1;
+
+	// -1: effect default, 0: full precision targets even over the memory budget, 1: compact targets, same as when over the memory budget
+	int32 Precision = -1;
+
+	// Measured impact under which r.MultipassPP.AutoSkip skips or downgrades the effect, see GetImageStatsImpact. 0 never does
+	float AutoSkipThreshold = 0.f;
+
+	bool operator==(const FMultipassPPScalabilitySettings& Other) const
+	{
+		return bEnabled == Other.bEnabled && ResolutionFraction == Other.ResolutionFraction && Quality == Other.Quality && Precision == Other.Precision
+			&& AutoSkipThreshold == Other.AutoSkipThreshold;
+	}
+	bool operator!=(const FMultipassPPScalabilitySettings& Other) const { return !(*this == Other); }
+};
+
+// What r.MultipassPP.AutoSkip does with a view whose measured impact stayed under the effect's threshold
+enum class EMultipassPPAutoSkipAction : uint8
+{
+	None,
+	// The effect returns the scene color untouched
+	Skip,
+	// The effect runs at quality tier 0
+	Downgrade,
+};
+
+// Latest image statistics of an effect's input, see FMultipassPPSceneExtension::GetLatestImageStats
+struct FMultipassPPEffectImageStats
+{
+	FMultipassPPImageStatsResult Stats;
+
+	// What the effect made of Stats, see FMultipassPPSceneExtension::GetImageStatsImpact. -1 if it doesn't measure its impact
+	float Impact = -1.f;
+
+	// What r.MultipassPP.AutoSkip is doing with the view the stats are from
+	EMultipassPPAutoSkipAction AutoSkipAction = EMultipassPPAutoSkipAction::None;
 };
 
 class MULTIPASSPP_API FMultipassPPSceneExtension : public FSceneViewExtensionBase
@@ -45,7 +146,13 @@ public:
 	FMultipassPPSceneExtension(const FAutoRegister& AutoReg);
 
 	// Begin ISceneViewExtension interface
+	// Only finds or creates the view data. Everything else is set up in PreRenderView_RenderThread
 	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override;
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1
+	virtual void PreRenderView_RenderThread(FRDGBuilder& GraphBuilder, FSceneView& InView) override;
+#else
+	virtual void PreRenderView_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneView& InView) override;
+#endif
 	virtual void SetupViewFamily(FSceneViewFamily&) override {}; // = 0
 	virtual void BeginRenderViewFamily(FSceneViewFamily& InViewFamily) {}; // = 0
 	virtual void SubscribeToPostProcessingPass(EPostProcessingPass Pass, FAfterPassCallbackDelegateArray& InOutPassCallbacks, bool bIsPassEnabled) override;
@@ -54,21 +161,194 @@ public:
 	// Just returns the inputted scene color as the output screen pass texture. Use this if you don't want to do any post processing
 	FScreenPassTexture ReturnUntouchedSceneColorForPostProcessing(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FPostProcessMaterialInputs& InOutInputs) const;
 
+	// Copies Texture into InOutInputs.OverrideOutput if it's valid and returns OverrideOutput. Otherwise just returns Texture
+	FScreenPassTexture CopyToOverrideOutput(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FPostProcessMaterialInputs& InOutInputs, const FScreenPassTexture& Texture) const;
+
 	// Looks up the ViewData in ViewDataMap. May return nullptr
-	virtual TSharedPtr<IMultipassPPViewData> GetViewData(const FSceneView& InView);
+	virtual TSharedPtr<IMultipassPPViewData> GetViewData(const FSceneView& InView) const;
 
 	// Same as GetViewData, but calls ConstructViewData if the ViewData does not exist
 	virtual TSharedPtr<IMultipassPPViewData> GetOrCreateViewData(const FSceneView& InView);
 
 	virtual size_t GetTypeHash() const;
 
+	virtual bool IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const override;
+
+	// Name the effect registry created this extension under
+	FName GetRegisteredName() const { return RegisteredName; }
+
+	// Memory budget interface. These are all game thread only. The sizes are the ones the render thread last published, see
+	// IMultipassPPViewData::UpdateGPUMemorySize_RenderThread
+	SIZE_T GetGPUMemorySize() const;
+	const TMap<uint32, TSharedPtr<IMultipassPPViewData>>& GetAllViewData() const { check(IsInGameThread()); return ViewDataMap; }
+	// Removes the view data and releases its targets on the render thread. Returns the number of bytes freed
+	SIZE_T EvictViewData(uint32 ViewKey);
+	void SetUseCompactFormats(bool bInUseCompactFormats);
+	bool IsUsingCompactFormats() const { return bUseCompactFormats; }
+	void SetDisabledByBudget(bool bInDisabledByBudget) { bDisabledByBudget = bInDisabledByBudget; }
+	bool IsDisabledByBudget() const { return bDisabledByBudget; }
+
+	// Scalability settings. Set by the effect registry whenever the scalability cvars change. Game thread only
+	void SetScalabilitySettings(const FMultipassPPScalabilitySettings& InSettings);
+	const FMultipassPPScalabilitySettings& GetScalabilitySettings() const { return ScalabilitySettings; }
+
+	// Tells every effect the scene color isn't changing, e.g. while a loading screen or a static menu backdrop is up.
+	// With r.MultipassPP.OutputReuse 2 this allows output reuse even when the world isn't paused. Any thread
+	static void SetSceneStaticHint(bool bInSceneIsStatic);
+
+	// Puts the view with this FSceneViewStateInterface::GetViewKey() in a sharing group. Every effect then only runs for the first view
+	// of a group each frame, and the other views get its output, resampled if their size differs. Group 0 takes the view out of its
+	// group. Groups share even when r.MultipassPP.ShareViews is 0. Game thread only
+	static void SetViewSharingGroup(uint32 ViewKey, uint32 Group);
+
+	// Restricts the effect to part of the view, see FMultipassPPRegionMask. Pixels outside of the region keep the scene color. Game thread only
+	void SetRegionMask(const FMultipassPPRegionMask& InRegionMask);
+
+	// Creates the pipeline states the effect draws with, so they don't compile on the frame the effect is first used. Render thread
+	virtual void PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap);
+
+	// Reads back the output of every post processing pass this extension runs, see FMultipassPPCaptureTap. Pass nullptr to stop capturing. Game thread only
+	void SetCaptureTap(TSharedPtr<FMultipassPPCaptureTap, ESPMode::ThreadSafe> InCaptureTap);
+
+	// Saves the inputs of the next frame the effect renders to Filename, see FMultipassPPFrameCapture. Game thread only
+	void CaptureNextFrame(const FString& Filename);
+
+	// Runs the effect's passes NumIterations times on Capture in the next frame the effect renders, and logs their GPU time.
+	// The view has to be the captured size. The view's own history and parameters are put back afterwards. Game thread only
+	void StartReplay(TSharedRef<const FMultipassPPFrameCapture, ESPMode::ThreadSafe> Capture, int32 NumIterations, bool bQuitWhenDone);
+
+	// Latest image statistics read back for any of the effect's views, with r.MultipassPP.ImageStats or an auto skip threshold set.
+	// Returns false if there are none yet. Any thread
+	bool GetLatestImageStats(FMultipassPPEffectImageStats& OutStats) const;
+
 protected:
+	friend class FMultipassPPEffectRegistry;
+
+	FName RegisteredName = "MultipassPP";
+
+	bool bUseCompactFormats = false;
+	bool bUseCompactFormats_RenderThread = false;
+	bool bDisabledByBudget = false;
+
+	FMultipassPPScalabilitySettings ScalabilitySettings;
+	FMultipassPPScalabilitySettings ScalabilitySettings_RenderThread;
+
+	// Single pass over the view's blendables of type TNode. Calls Func(const TNode& Node, float Weight) for each of them and returns how many there were
+	template<typename TNode, typename TFunc>
+	static int32 ForEachBlendable(const FSceneView& View, TFunc&& Func)
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_MultipassPP_ForEachBlendable);
+
+		int32 NumEntries = 0;
+		FBlendableEntry* BlendableIt = nullptr;
+		while (TNode* DataPtr = View.FinalPostProcessSettings.BlendableManager.IterateBlendables<TNode>(BlendableIt))
+		{
+			Func(*DataPtr, BlendableIt->Weight);
+			++NumEntries;
+		}
+		return NumEntries;
+	}
+
+	// Resolves the view data's parameters from the cvars and the view's blendables, before its targets are set up. Called from
+	// PreRenderView_RenderThread, so the game thread doesn't pay for it per view. Render thread
+	virtual void SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& ViewData) {}
+
+	// Effects whose output can be rendered at a lower resolution and upsampled return true. The default RT is then allocated at
+	// GetResolutionFraction of the view, and the base PostProcessPass_RenderThread upsamples it to the scene color
+	virtual bool SupportsResolutionFraction() const { return false; }
+
+	// Fraction of the view resolution the view data's targets are set up at, after SetupViewData_RenderThread resolved its parameters.
+	// ScalabilitySettings.ResolutionFraction for effects that SupportsResolutionFraction, 1 otherwise. Render thread
+	virtual float GetResolutionFraction(const IMultipassPPViewData& ViewData) const;
+
+	// Bilinear draw of Input's ViewRect into Output's ViewRect
+	void AddResamplePass(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output) const;
+
 	// Which PP passes to bind to. Defaults to the tonemapping pass
 	TSet<EPostProcessingPass> PostProcessingPasses;
 
 	// The pass name that shows up in ProfileGPU
 	FString PostProcessingPassName = "MultipassPP";
 	
+	// Effects whose output only depends on the scene color, the camera and their parameters can return how many frames it takes
+	// their output to settle once those stop changing. After that many unchanged frames the output is kept, and reused instead of
+	// running the effect for as long as nothing changes. -1 (the default) opts out. Render thread
+	virtual int32 GetOutputReuseSettleFrames(const FSceneView& View) const { return -1; }
+
+	// Hash of everything besides the camera and the view rect the effect's output depends on. Render thread
+	virtual uint32 GetOutputReuseParameterHash(const FSceneView& View) { return 0; }
+
+	// Updates the view's reuse state. Returns true if the effect can be skipped and ViewData.ReusedOutput used instead.
+	// bOutKeepOutput is set when this frame's output should be kept for the next frames
+	bool UpdateOutputReuse_RenderThread(const FSceneView& View, IMultipassPPViewData& ViewData, int32 SettleFrames, bool& bOutKeepOutput);
+
+	// Pixel formats the view data's RT can have, for PSO precaching. Override if ConstructViewData changes RTPixelFormat
+	virtual void GetViewDataPixelFormats(TArray<EPixelFormat>& OutFormats) const;
+
+	// How much the effect would visibly change a frame with these input statistics, in the unit of the statistic it's based on.
+	// Compared against r.MultipassPP.<EffectName>.AutoSkipThreshold. Negative if unknown, which never skips. Render thread
+	virtual float GetImageStatsImpact(const FMultipassPPImageStatsResult& Stats) const { return -1.f; }
+
+	// Measures the scene color with the view's FMultipassPPImageStats every r.MultipassPP.ImageStats.Interval frames when needed,
+	// and returns what r.MultipassPP.AutoSkip should do with the view this frame
+	EMultipassPPAutoSkipAction UpdateImageStats_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FPostProcessMaterialInputs& InOutInputs, IMultipassPPViewData& ViewData);
+
+	// Set by the views' image stats callbacks, see GetLatestImageStats
+	mutable FCriticalSection LatestImageStatsLock;
+	FMultipassPPEffectImageStats LatestImageStats;
+	bool bHasImageStats = false;
+
+	// Render thread copy of the mask set with SetRegionMask
+	FMultipassPPRegionMask RegionMask_RenderThread;
+
+	// Scene textures of the post processing pass being rendered. Only valid inside PostProcessPass_RenderThread
+	TRDGUniformBufferRef<FSceneTextureUniformParameters> SceneTextures_RenderThread;
+
+	// Builds the region mask for Output, see AddMultipassPPRegionMaskPass. Returns nullptr when every pixel should be processed
+	FRDGTextureRef AddRegionMaskPass_RenderThread(FRDGBuilder& GraphBuilder, const FViewInfo& ViewInfo, const FScreenPassRenderTarget& Output) const;
+
+	// Output of the first view with a given sharing key this frame, see GetViewSharingKey_RenderThread. Render thread only
+	struct FSharedViewOutput
+	{
+		uint64 ProducedFrame = 0;
+
+		// Last frame a view wanted this output from another graph. The output is only kept past its graph while that's recent
+		uint64 WantedFrame = 0;
+		TRefCountPtr<IPooledRenderTarget> Extracted;
+		FIntRect ViewRect;
+	};
+	TMap<uint32, TSharedPtr<FSharedViewOutput>> SharedViewOutputs_RenderThread;
+
+	// Sharing key of the view: its sharing group, or with r.MultipassPP.ShareViews its camera, scene, show flags and scene color
+	// format, and the effect's parameters. 0 if the view doesn't share. Only effects whose output settles right away,
+	// GetOutputReuseSettleFrames of 0, can share. Their output depends on nothing else, and they have no history to keep up to date
+	uint32 GetViewSharingKey_RenderThread(const FSceneView& View, EPostProcessingPass Pass, const FScreenPassTexture& SceneColor);
+
+	// Returns the output an earlier view with the same key produced this frame, or an invalid texture
+	FScreenPassTexture FindSharedViewOutput_RenderThread(FRDGBuilder& GraphBuilder, uint32 SharingKey);
+
+	// Makes Output available to the next views with the same key
+	void PublishSharedViewOutput_RenderThread(FRDGBuilder& GraphBuilder, uint32 SharingKey, const FScreenPassTexture& Output);
+
+	// Render thread copy of the tap set with SetCaptureTap
+	TSharedPtr<FMultipassPPCaptureTap, ESPMode::ThreadSafe> CaptureTap_RenderThread;
+
+	// Set by CaptureNextFrame and StartReplay, and kept until their results are written
+	TSharedPtr<FMultipassPPFrameCaptureRequest> FrameCapture_RenderThread;
+	TSharedPtr<FMultipassPPReplay> Replay_RenderThread;
+
+	// Runs the replay set with StartReplay on the captured inputs instead of the view's
+	void AddReplayPasses_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& InOutInputs, EPostProcessingPass Pass);
+
+	// The callback SubscribeToPostProcessingPass binds. Runs a pending replay or frame capture, measures the input, calls
+	// PostProcessPass_RenderThread or reuses the previous output, then the capture tap
+	FScreenPassTexture OnPostProcessPass_RenderThread(
+		FRDGBuilder& GraphBuilder,
+		const FSceneView& View,
+		const FPostProcessMaterialInputs& InOutInputs,
+		EPostProcessingPass Pass
+	);
+
 	// Called by SubscribeToPostProcessingPass. Calls AddPass_RenderThread
 	virtual FScreenPassTexture PostProcessPass_RenderThread(
 		FRDGBuilder& GraphBuilder,
@@ -88,7 +368,10 @@ protected:
 
 	// Map of ViewState index to ViewData
 	// Each view should have a ViewData associated to it
+	// Only the game thread adds and removes entries, under a write lock of ViewDataMapLock. The render thread looks them up
+	// under a read lock, the game thread can read the map without one
 	TMap<uint32, TSharedPtr<IMultipassPPViewData>> ViewDataMap;
+	mutable FRWLock ViewDataMapLock;
 
 	// Just constructs the view data. Called in GetOrCreateViewData if the viewdata is null. Override this function and return your custom viewdata type here
 	virtual TSharedPtr<IMultipassPPViewData> ConstructViewData(const FSceneView& InView);
@@ -127,11 +410,44 @@ protected:
 		TParametersType* Parameters = GraphBuilder.AllocParameters<TParametersType>();
 		static_cast<TDerivedType*>(this)->SetupParameters(GraphBuilder, View, ViewInfo, Input, Output, Parameters);
 
+		// Pixels outside of the region are rejected by the stencil test, then filled with the input
+		FRDGTextureRef RegionMask = AddRegionMaskPass_RenderThread(GraphBuilder, ViewInfo, Output);
+		if (RegionMask != nullptr)
+		{
+			Parameters->RenderTargets.DepthStencil = MultipassPPRegionMask::GetBinding(RegionMask);
+		}
+
 		FRDGEventName PassName = FRDGEventName(TEXT("%s"), *PostProcessingPassName);
 
 		TShaderMapRef<FScreenPassVS> VertexShader(ViewInfo.ShaderMap);
 
-		AddDrawScreenPass(GraphBuilder, Forward<FRDGEventName&&>(PassName), ViewInfo, OutputViewport, InputViewport, VertexShader, PixelShader, BlendState, DepthStencilState, Parameters, EScreenPassDrawFlags::None);
+		AddDrawScreenPass(GraphBuilder, Forward<FRDGEventName&&>(PassName), ViewInfo, OutputViewport, InputViewport, VertexShader, PixelShader, BlendState,
+			RegionMask != nullptr ? MultipassPPRegionMask::GetIncludedDepthStencilState() : DepthStencilState, Parameters, EScreenPassDrawFlags::None);
+
+		if (RegionMask != nullptr)
+		{
+			AddMultipassPPRegionMaskFillPass(GraphBuilder, ViewInfo, Input, Output, RegionMask);
+		}
+	}
+
+	virtual void PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap) override
+	{
+		FMultipassPPSceneExtension::PrecachePSOs_RenderThread(RHICmdList, ShaderMap);
+
+		TArray<EPixelFormat> Formats;
+		GetViewDataPixelFormats(Formats);
+
+		TShaderMapRef<FScreenPassVS> VertexShader(ShaderMap);
+		TShaderMapRef<TShaderType> PixelShader(ShaderMap);
+		MultipassPPPSOPrecache::PrecacheScreenPassForFormats(RHICmdList, VertexShader, PixelShader, BlendState, DepthStencilState, Formats);
+
+		if (RegionMask_RenderThread.IsEnabled())
+		{
+			for (EPixelFormat Format : Formats)
+			{
+				MultipassPPPSOPrecache::PrecacheScreenPass(RHICmdList, VertexShader, PixelShader, BlendState, MultipassPPRegionMask::GetIncludedDepthStencilState(), MakeArrayView(&Format, 1), PF_DepthStencil);
+			}
+		}
 	}
 
 	virtual void SetupParameters(
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "MultipassPPSceneExtension.h"
+#include "GlobalShader.h"
+#include "ShaderPermutation.h"
+#include "RenderGraphUtils.h"
+
+// Kernels used by TMultipassPPSeparableFilterCS need:
+//   static constexpr int32 Radius;            // Taps on each side of the center, between 1 and the group size
+//   static float GetWeight(int32 Offset);     // Weight of the tap Offset pixels from the center, Offset is in [0, Radius]
+// The weights are mirrored, normalized, and baked into the shader as constants when it's compiled.
+template<int32 InRadius>
+struct TMultipassPPGaussianKernel
+{
+	static constexpr int32 Radius = InRadius;
+
+	static float GetWeight(int32 Offset)
+	{
+		// Falls off to about 1% at the radius
+		const float Sigma = FMath::Max(Radius / 3.f, 0.5f);
+		return FMath::Exp(-float(Offset * Offset) / (2.f * Sigma * Sigma));
+	}
+};
+
+template<int32 InRadius>
+struct TMultipassPPBoxKernel
+{
+	static constexpr int32 Radius = InRadius;
+
+	static float GetWeight(int32 Offset)
+	{
+		return 1.f;
+	}
+};
+
+// Instantiated by the plugin, so effects that just need a blur don't have to instantiate a kernel of their own
+using FMultipassPPGaussianKernel = TMultipassPPGaussianKernel<8>;
+
+BEGIN_SHADER_PARAMETER_STRUCT(FMultipassPPSeparableFilterParameters, MULTIPASSPP_API)
+	SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+	SHADER_PARAMETER_SAMPLER(SamplerState, InputSampler)
+	SHADER_PARAMETER(FVector2f, InputUVMin)
+	SHADER_PARAMETER(FVector2f, InputUVMax)
+	SHADER_PARAMETER(FVector2f, InputViewOrigin)
+	SHADER_PARAMETER(FVector2f, OutputPixelToInputUV)
+	SHADER_PARAMETER(FIntPoint, OutputViewMin)
+	SHADER_PARAMETER(FIntPoint, OutputViewSize)
+	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, OutputTexture)
+END_SHADER_PARAMETER_STRUCT()
+
+namespace MultipassPPSeparableFilter
+{
+	static constexpr int32 GroupSize = 64;
+
+	// Builds the KERNEL_WEIGHTS define: Radius + 1 normalized weights, center first
+	MULTIPASSPP_API FString GetKernelWeightsDefine(int32 Radius, TFunctionRef<float(int32)> GetWeight);
+
+	// Fills in the parameters for one direction of the filter, reading Input and writing OutputRect of Output
+	MULTIPASSPP_API FMultipassPPSeparableFilterParameters* AllocParameters(FRDGBuilder& GraphBuilder, const FScreenPassTexture& Input, FRDGTextureRef Output, const FIntRect& OutputRect);
+}
+
+// Compute shader for one direction of a separable filter. Each group of 64 threads caches the 64 + 2 * Radius texels of its
+// row (or column) in groupshared memory, so every input texel is fetched once instead of once per tap.
+// Instantiate it for your kernel with IMPLEMENT_MULTIPASSPP_SEPARABLE_FILTER(FMyKernel) in a cpp file.
+template<typename TKernel>
+class TMultipassPPSeparableFilterCS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(TMultipassPPSeparableFilterCS, Global);
+	SHADER_USE_PARAMETER_STRUCT(TMultipassPPSeparableFilterCS, FGlobalShader);
+
+	static_assert(TKernel::Radius > 0 && TKernel::Radius <= MultipassPPSeparableFilter::GroupSize, "Separable filter kernels need a radius between 1 and the group size");
+
+	using FParameters = FMultipassPPSeparableFilterParameters;
+
+	class FVerticalDim : SHADER_PERMUTATION_BOOL("FILTER_VERTICAL");
+	using FPermutationDomain = TShaderPermutationDomain<FVerticalDim>;
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("GROUP_SIZE"), MultipassPPSeparableFilter::GroupSize);
+		OutEnvironment.SetDefine(TEXT("KERNEL_RADIUS"), TKernel::Radius);
+		OutEnvironment.SetDefine(TEXT("KERNEL_WEIGHTS"), *MultipassPPSeparableFilter::GetKernelWeightsDefine(TKernel::Radius, &TKernel::GetWeight));
+	}
+};
+
+#define IMPLEMENT_MULTIPASSPP_SEPARABLE_FILTER(KernelType) \
+	IMPLEMENT_SHADER_TYPE(template<>, TMultipassPPSeparableFilterCS<KernelType>, TEXT("/MultipassPP/Private/MultipassPPSeparableFilter.usf"), TEXT("MainCS"), SF_Compute)
+
+// Filters Input's ViewRect horizontally into a transient intermediate, then vertically into a new transient texture, and returns it.
+// With bHalfResolution both passes run at half resolution and the first pass uses a bilinear fetch as its 2x2 prefilter.
+template<typename TKernel>
+FScreenPassTexture AddMultipassPPSeparableFilterPasses(
+	FRDGBuilder& GraphBuilder,
+	const FViewInfo& View,
+	const FScreenPassTexture& Input,
+	bool bHalfResolution,
+	EPixelFormat Format = PF_FloatRGBA)
+{
+	using FShader = TMultipassPPSeparableFilterCS<TKernel>;
+	using MultipassPPSeparableFilter::GroupSize;
+
+	const FIntPoint OutputSize = bHalfResolution ? FIntPoint::DivideAndRoundUp(Input.ViewRect.Size(), 2) : Input.ViewRect.Size();
+	const FIntRect OutputRect(FIntPoint::ZeroValue, OutputSize);
+	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(OutputSize, Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+
+	FRDGTextureRef Intermediate = GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.SeparableFilterIntermediate"));
+	FRDGTextureRef Output = GraphBuilder.CreateTexture(Desc, TEXT("MultipassPP.SeparableFilter"));
+
+	{
+		typename FShader::FPermutationDomain PermutationVector;
+		PermutationVector.template Set<typename FShader::FVerticalDim>(false);
+		TShaderMapRef<FShader> ComputeShader(View.ShaderMap, PermutationVector);
+
+		FComputeShaderUtils::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("MultipassPP SeparableFilter Horizontal (Radius=%d) %dx%d", TKernel::Radius, OutputSize.X, OutputSize.Y),
+			ComputeShader,
+			MultipassPPSeparableFilter::AllocParameters(GraphBuilder, Input, Intermediate, OutputRect),
+			FIntVector(FMath::DivideAndRoundUp(OutputSize.X, GroupSize), OutputSize.Y, 1));
+	}
+
+	{
+		typename FShader::FPermutationDomain PermutationVector;
+		PermutationVector.template Set<typename FShader::FVerticalDim>(true);
+		TShaderMapRef<FShader> ComputeShader(View.ShaderMap, PermutationVector);
+
+		FComputeShaderUtils::AddPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("MultipassPP SeparableFilter Vertical (Radius=%d) %dx%d", TKernel::Radius, OutputSize.X, OutputSize.Y),
+			ComputeShader,
+			MultipassPPSeparableFilter::AllocParameters(GraphBuilder, FScreenPassTexture(Intermediate, OutputRect), Output, OutputRect),
+			FIntVector(OutputSize.X, FMath::DivideAndRoundUp(OutputSize.Y, GroupSize), 1));
+	}
+
+	return FScreenPassTexture(Output, OutputRect);
+}
+
+// Same as FMultipassPPSceneExtension, but AddPass_RenderThread runs TKernel over the scene color and writes the result to the view data RT,
+// upsampling it if bHalfResolution is set. Derived classes get large kernels for the cost of 2 * (2 * Radius + 1) cached taps per pixel.
+// TKernel's shader has to be instantiated with IMPLEMENT_MULTIPASSPP_SEPARABLE_FILTER, FMultipassPPGaussianKernel already is.
+// With a region mask, the filter still runs over the whole view, but the composite is stencil tested and the excluded pixels keep the input.
+template<typename TDerivedType, typename TKernel>
+class FMultipassPPSceneExtensionWithSeparableFilter : public FMultipassPPSceneExtension
+{
+public:
+	FMultipassPPSceneExtensionWithSeparableFilter(const FAutoRegister& AutoReg)
+		: FMultipassPPSceneExtension(AutoReg)
+	{
+
+	}
+
+	using BaseT = FMultipassPPSceneExtensionWithSeparableFilter<TDerivedType, TKernel>;
+
+	virtual void PrecachePSOs_RenderThread(FRHICommandList& RHICmdList, const FGlobalShaderMap* ShaderMap) override
+	{
+		FMultipassPPSceneExtension::PrecachePSOs_RenderThread(RHICmdList, ShaderMap);
+
+		using FShader = TMultipassPPSeparableFilterCS<TKernel>;
+		for (const bool bVertical : { false, true })
+		{
+			typename FShader::FPermutationDomain PermutationVector;
+			PermutationVector.template Set<typename FShader::FVerticalDim>(bVertical);
+			MultipassPPPSOPrecache::PrecacheCompute(RHICmdList, TShaderMapRef<FShader>(ShaderMap, PermutationVector));
+		}
+
+		TArray<EPixelFormat> Formats;
+		GetViewDataPixelFormats(Formats);
+
+		TShaderMapRef<FScreenPassVS> VertexShader(ShaderMap);
+		TShaderMapRef<FCopyRectPS> CopyPixelShader(ShaderMap);
+		MultipassPPPSOPrecache::PrecacheScreenPassForFormats(RHICmdList, VertexShader, CopyPixelShader, BlendState, FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI(), Formats);
+
+		if (RegionMask_RenderThread.IsEnabled())
+		{
+			for (EPixelFormat Format : Formats)
+			{
+				MultipassPPPSOPrecache::PrecacheScreenPass(RHICmdList, VertexShader, CopyPixelShader, BlendState, MultipassPPRegionMask::GetIncludedDepthStencilState(), MakeArrayView(&Format, 1), PF_DepthStencil);
+			}
+		}
+	}
+
+protected:
+	// Run the filter at half resolution. Can be changed per frame
+	bool bHalfResolution = false;
+
+	EPixelFormat IntermediateFormat = PF_FloatRGBA;
+
+	FRHIBlendState* BlendState = FScreenPassPipelineState::FDefaultBlendState::GetRHI();
+
+	virtual void AddPass_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FViewInfo& ViewInfo, const FScreenPassTexture& Input, const FScreenPassRenderTarget& Output) override
+	{
+		check(IsInRenderingThread());
+
+		RDG_EVENT_SCOPE(GraphBuilder, "%s", *PostProcessingPassName);
+
+		const FScreenPassTexture Filtered = AddMultipassPPSeparableFilterPasses<TKernel>(GraphBuilder, ViewInfo, Input, bHalfResolution, IntermediateFormat);
+
+		// Bilinear copy into the output, which is also the upsample when running at half resolution
+		FCopyRectPS::FParameters* Parameters = GraphBuilder.AllocParameters<FCopyRectPS::FParameters>();
+		Parameters->InputTexture = Filtered.Texture;
+		Parameters->InputSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp>::GetRHI();
+		Parameters->RenderTargets[0] = Output.GetRenderTargetBinding();
+
+		// Pixels outside of the region are rejected by the stencil test, then filled with the input
+		FRDGTextureRef RegionMask = AddRegionMaskPass_RenderThread(GraphBuilder, ViewInfo, Output);
+		if (RegionMask != nullptr)
+		{
+			Parameters->RenderTargets.DepthStencil = MultipassPPRegionMask::GetBinding(RegionMask);
+		}
+
+		TShaderMapRef<FCopyRectPS> CopyPixelShader(ViewInfo.ShaderMap);
+		TShaderMapRef<FScreenPassVS> VertexShader(ViewInfo.ShaderMap);
+
+		AddDrawScreenPass(
+			GraphBuilder,
+			RDG_EVENT_NAME("Composite"),
+			ViewInfo,
+			FScreenPassTextureViewport(Output),
+			FScreenPassTextureViewport(Filtered),
+			VertexShader,
+			CopyPixelShader,
+			BlendState,
+			RegionMask != nullptr ? MultipassPPRegionMask::GetIncludedDepthStencilState() : FScreenPassPipelineState::FDefaultDepthStencilState::GetRHI(),
+			Parameters,
+			EScreenPassDrawFlags::None);
+
+		if (RegionMask != nullptr)
+		{
+			AddMultipassPPRegionMaskFillPass(GraphBuilder, ViewInfo, Input, Output, RegionMask);
+		}
+	}
+};
@@ -0,0 +1,36 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "Engine/BlendableInterface.h"
+#include "SMAABlendable.generated.h"
+
+struct MULTIPASSPP_API FSMAANode
+{
+	static FName GetFName()
+	{
+		static FName Name = "FSMAANode";
+		return Name;
+	}
+
+	float Threshold = 0.f;
+};
+
+/**
+ * 
+ */
+UCLASS(BlueprintType, ClassGroup = ("Post Processing"))
+class MULTIPASSPP_API USMAABlendable : public UObject, public IBlendableInterface
+{
+	GENERATED_BODY()
+
+public:
+	virtual void OverrideBlendableSettings(class FSceneView& View, float Weight) const override;
+
+	// Smallest luma difference between two pixels that counts as an edge. Lower finds more edges and costs more
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SMAA", meta = (ExposeOnSpawn = true, ClampMin = "0.01", ClampMax = "0.5"))
+		float Threshold = 0.1f;
+	
+};
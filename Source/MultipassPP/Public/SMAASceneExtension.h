@@ -0,0 +1,165 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MultipassPPPipeline.h"
+
+class MULTIPASSPP_API FSMAAEdgeDetectionPS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FSMAAEdgeDetectionPS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FSMAAEdgeDetectionPS, FGlobalShader);
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+		SHADER_PARAMETER(FVector2f, InputExtent)
+		SHADER_PARAMETER(FIntPoint, InputViewMin)
+		SHADER_PARAMETER(FIntPoint, InputViewMax)
+		SHADER_PARAMETER(float, Threshold)
+		RENDER_TARGET_BINDING_SLOTS()
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+class MULTIPASSPP_API FSMAABlendingWeightPS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FSMAABlendingWeightPS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FSMAABlendingWeightPS, FGlobalShader);
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+		SHADER_PARAMETER(FVector2f, InputExtent)
+		SHADER_PARAMETER(FIntPoint, InputViewMin)
+		SHADER_PARAMETER(FIntPoint, InputViewMax)
+		SHADER_PARAMETER(int32, MaxSearchSteps)
+		RENDER_TARGET_BINDING_SLOTS()
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+class MULTIPASSPP_API FSMAANeighborhoodBlendingPS : public FGlobalShader
+{
+public:
+	DECLARE_SHADER_TYPE(FSMAANeighborhoodBlendingPS, Global);
+	SHADER_USE_PARAMETER_STRUCT(FSMAANeighborhoodBlendingPS, FGlobalShader);
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, InputTexture)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, SceneColorTexture)
+		SHADER_PARAMETER(FVector2f, InputExtent)
+		SHADER_PARAMETER(FIntPoint, InputViewMin)
+		SHADER_PARAMETER(FIntPoint, InputViewMax)
+		RENDER_TARGET_BINDING_SLOTS()
+	END_SHADER_PARAMETER_STRUCT()
+};
+
+// SMAA only needs this frame's targets, so the view data has no RT
+struct MULTIPASSPP_API FSMAAViewData : public IMultipassPPViewData
+{
+	float BlendableWeight = 0.f;
+	float Threshold = 0.1f;
+
+	virtual void SerializeParameters(FArchive& Ar) override
+	{
+		Ar << BlendableWeight << Threshold;
+	}
+};
+
+class FSMAASceneExtension;
+
+// Pass 1: Scene color -> edges. Also marks the pixels with an edge in the stencil
+struct FSMAAEdgeDetectionPass : public FMultipassPPPipelinePass
+{
+	using ShaderType = FSMAAEdgeDetectionPS;
+	static constexpr int32 Input = MultipassPPPipeline::SceneColor;
+	static constexpr EMultipassPPPassTarget Target = EMultipassPPPassTarget::Transient;
+	static constexpr EPixelFormat TransientFormat = PF_R8G8;
+	// Pixels without an edge are discarded, pass 2 reads them as no edge
+	static constexpr bool bClearTransient = true;
+	static constexpr EPixelFormat DepthStencilFormat = PF_DepthStencil;
+	static constexpr FExclusiveDepthStencil::Type DepthStencilAccess = FExclusiveDepthStencil::DepthNop_StencilWrite;
+
+	static const TCHAR* GetName() { return TEXT("SMAA.Edges"); }
+	static FRHIDepthStencilState* GetDepthStencilState() { return TStaticDepthStencilState<false, CF_Always, true, CF_Always, SO_Keep, SO_Keep, SO_SaturatedIncrement, true, CF_Always, SO_Keep, SO_Keep, SO_SaturatedIncrement>::GetRHI(); }
+	static void SetupParameters(FSMAASceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters);
+};
+
+// Pass 2: Edges -> blending weights, only on the pixels pass 1 marked in the stencil
+struct FSMAABlendingWeightPass : public FMultipassPPPipelinePass
+{
+	using ShaderType = FSMAABlendingWeightPS;
+	static constexpr int32 Input = 0;
+	static constexpr EMultipassPPPassTarget Target = EMultipassPPPassTarget::Transient;
+	static constexpr EPixelFormat TransientFormat = PF_B8G8R8A8;
+	// Only the edge pixels are drawn, everything else doesn't blend
+	static constexpr bool bClearTransient = true;
+	static constexpr EPixelFormat DepthStencilFormat = PF_DepthStencil;
+
+	static const TCHAR* GetName() { return TEXT("SMAA.Weights"); }
+	static FRHIDepthStencilState* GetDepthStencilState() { return TStaticDepthStencilState<false, CF_Always, true, CF_NotEqual, SO_Keep, SO_Keep, SO_Keep, true, CF_NotEqual, SO_Keep, SO_Keep, SO_Keep>::GetRHI(); }
+	static void SetupParameters(FSMAASceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters);
+};
+
+// Pass 3: Blending weights and scene color -> Output
+struct FSMAANeighborhoodBlendingPass : public FMultipassPPPipelinePass
+{
+	using ShaderType = FSMAANeighborhoodBlendingPS;
+	static constexpr int32 Input = 1;
+	static constexpr EMultipassPPPassTarget Target = EMultipassPPPassTarget::Output;
+
+	static const TCHAR* GetName() { return TEXT("SMAA.Blend"); }
+	static void SetupParameters(FSMAASceneExtension& Extension, const FMultipassPPPipelineContext& Context, ShaderType::FParameters* Parameters);
+};
+
+/**
+ * Morphological anti-aliasing after SMAA 1x, run after FXAA on the tonemapped scene color
+ */
+class MULTIPASSPP_API FSMAASceneExtension
+	: public TMultipassPPPipeline<FSMAASceneExtension, FSMAAEdgeDetectionPass, FSMAABlendingWeightPass, FSMAANeighborhoodBlendingPass>
+{
+public:
+	FSMAASceneExtension(const FAutoRegister& AutoReg);
+
+	static FName GetEffectName()
+	{
+		static FName Name = "SMAA";
+		return Name;
+	}
+
+	// r.MultipassPP.SMAA.Quality if the scalability settings set it, r.SMAA.Quality otherwise. Render thread
+	int32 GetQuality() const;
+	static constexpr int32 MaxQuality = 3;
+
+	// How far pass 2 follows an edge in each direction, in pixels, for the current quality. Render thread
+	int32 GetMaxSearchSteps() const;
+
+	virtual void SetupViewData_RenderThread(const FSceneView& View, IMultipassPPViewData& InViewData) override;
+	virtual bool IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const override;
+
+	virtual FScreenPassTexture PostProcessPass_RenderThread(
+		FRDGBuilder& GraphBuilder,
+		const FSceneView& View,
+		const FPostProcessMaterialInputs& InOutInputs,
+		EPostProcessingPass Pass
+	) override;
+
+	// Stencil pass 1 marks the edge pixels in and pass 2 tests against. Only valid while the pipeline's passes are being added. Render thread
+	FRDGTextureRef EdgeStencil = nullptr;
+
+	virtual size_t GetTypeHash() const override;
+
+protected:
+	// No history either, the output can be reused as soon as the view stops changing
+	virtual int32 GetOutputReuseSettleFrames(const FSceneView& View) const override { return 0; }
+	virtual uint32 GetOutputReuseParameterHash(const FSceneView& View) override;
+
+	// Only the pixels on edges are anti-aliased
+	virtual float GetImageStatsImpact(const FMultipassPPImageStatsResult& Stats) const override { return Stats.ActiveFraction; }
+
+	virtual TSharedPtr<IMultipassPPViewData> ConstructViewData(const FSceneView& InView) { return MakeShared<FSMAAViewData>(); };
+};